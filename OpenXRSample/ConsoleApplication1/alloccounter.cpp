@@ -0,0 +1,162 @@
+#include "alloccounter.hpp"
+#include <stdlib.h>
+#include <malloc.h>
+#include <new>
+
+#ifdef _DEBUG
+
+static thread_local uint64_t thread_allocations = 0;
+
+uint64_t AllocCounter::threadAllocations()
+{
+	return thread_allocations;
+}
+
+static void* countedAlloc(size_t size)
+{
+	thread_allocations++;
+	//malloc(0) may return NULL, operator new must not
+	void* ptr = malloc(size != 0 ? size : 1);
+	return ptr;
+}
+
+#ifdef __cpp_aligned_new
+//Over-aligned blocks have to go back through _aligned_free, so they get their own pair
+static void* countedAlignedAlloc(size_t size, std::align_val_t alignment)
+{
+	thread_allocations++;
+	return _aligned_malloc(size != 0 ? size : 1, static_cast<size_t>(alignment));
+}
+#endif
+
+void* operator new(size_t size)
+{
+	void* ptr = countedAlloc(size);
+	if (ptr == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	void* ptr = countedAlloc(size);
+	if (ptr == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+#ifdef __cpp_aligned_new
+//Without C++17 aligned new the compiler routes over-aligned types through the overloads above
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* ptr = countedAlignedAlloc(size, alignment);
+	if (ptr == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	void* ptr = countedAlignedAlloc(size, alignment);
+	if (ptr == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return countedAlignedAlloc(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return countedAlignedAlloc(size, alignment);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+	_aligned_free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+	_aligned_free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+	_aligned_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+	_aligned_free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	_aligned_free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	_aligned_free(ptr);
+}
+#endif
+
+#else
+
+uint64_t AllocCounter::threadAllocations()
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+#ifndef ALLOCCOUNTER_HPP
+#define ALLOCCOUNTER_HPP
+
+#include <stdint.h>
+
+/*
+ Debug builds replace the global operator new (aligned overloads included) so each thread counts its own heap allocations,
+ which lets hot loops assert they don't allocate. Release builds leave operator new alone.
+*/
+class AllocCounter
+{
+public:
+	/*
+	 threadAllocations:  Number of operator new calls made by the calling thread
+	 inputs:             None
+	 returns:            The count so far, always 0 in release builds
+	*/
+	static uint64_t threadAllocations();
+};
+
+#endif
@@ -0,0 +1,370 @@
+#include "bench.hpp"
+#include "instancebuffer.hpp"
+#include "scene.hpp"
+
+#include "gtc/matrix_transform.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+//Milliseconds between two points read from the steady clock
+static double elapsedMs(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void Bench::buildGrid(Scene* scene, uint32_t object_count, uint32_t mesh_count, float size)
+{
+	scene->reserve(object_count);
+	for (uint32_t mesh = 0; mesh < mesh_count; mesh++)
+	{
+		scene->addMesh(this->cube, this->cube->bounds);
+	}
+	uint32_t material = scene->addMaterial(glm::vec3(1.0f));
+
+	//Meshes are interleaved through the object arrays the way adding them in any order would leave them
+	uint32_t side = 1;
+	while (side * side < object_count)
+	{
+		side++;
+	}
+	float spacing = 20.0f / side;
+	for (uint32_t i = 0; i < object_count; i++)
+	{
+		glm::vec3 position((i % side) * spacing - 10.0f, (i / side) * spacing - 10.0f, 0.0f);
+		scene->add(i % mesh_count, material, position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(spacing * size));
+	}
+	scene->update();
+}
+
+bool Bench::init()
+{
+	if (!glfwInit())
+	{
+		fprintf(stderr, "Failed to initialize GLFW\n");
+		return false;
+	}
+
+	//Nothing is presented, the window only exists for its context
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	this->window = glfwCreateWindow(64, 64, "OpenXR Sample Bench", NULL, NULL);
+	if (this->window == NULL)
+	{
+		fprintf(stderr, "Failed to open GLFW window.\n");
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(this->window);
+
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK)
+	{
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		glfwTerminate();
+		return false;
+	}
+
+	try
+	{
+		this->per_object_shader = new Shader("Shaders\\vert.vsh", "Shaders\\frag.fg", true);
+		this->instanced_shader = new Shader("Shaders\\vert.vsh", "Shaders\\frag.fg", "#define INSTANCED_OBJECTS\n");
+		this->mask_shader = new Shader("Shaders\\mask.vsh", "Shaders\\frag.fg", "#define VIEW_COUNT 1\n");
+	}
+	catch (std::runtime_error&)
+	{
+		fprintf(stderr, "Failed to build the bench shaders\n");
+		glfwTerminate();
+		return false;
+	}
+	this->cube = new Square;
+
+	glGenTextures(1, &this->color_image);
+	glBindTexture(GL_TEXTURE_2D, this->color_image);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, WIDTH, HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glGenTextures(1, &this->depth_image);
+	glBindTexture(GL_TEXTURE_2D, this->depth_image);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, WIDTH, HEIGHT, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &this->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->color_image, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depth_image, 0);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete)
+	{
+		fprintf(stderr, "Bench framebuffer is incomplete\n");
+		return false;
+	}
+
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glEnable(GL_CULL_FACE);
+	return true;
+}
+
+void Bench::run()
+{
+	printf("Averages over %d runs, drawn at %dx%d\n", this->iterations, WIDTH, HEIGHT);
+
+	const uint32_t object_counts[] = { 1000, 10000, 100000 };
+	for (uint32_t object_count : object_counts)
+	{
+		this->benchInstancing(object_count);
+	}
+	this->benchVisibilityMask();
+}
+
+void Bench::benchInstancing(uint32_t object_count)
+{
+	//The same cube under a few mesh ids, so the objects have to be sorted into one run per mesh
+	Scene scene;
+	this->buildGrid(&scene, object_count, 4, 0.4f);
+
+	//Everything is drawn, visibility isn't what is being measured
+	std::vector<uint32_t> objects(object_count);
+	for (uint32_t i = 0; i < object_count; i++)
+	{
+		objects[i] = i;
+	}
+
+	glm::mat4 view_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f)
+		* glm::lookAt(glm::vec3(0.0f, 0.0f, 12.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	GLuint per_object_program = this->per_object_shader->getProgram();
+	GLint mvp_location = glGetUniformLocation(per_object_program, "mvp");
+	GLint color_location = glGetUniformLocation(per_object_program, "material_color");
+	GLuint instanced_program = this->instanced_shader->getProgram();
+	GLint view_projection_location = glGetUniformLocation(instanced_program, "mvp");
+
+	InstanceBuffer instances;
+	if (!instances.init())
+	{
+		printf("Unable to create the instance buffer\n");
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+	glViewport(0, 0, WIDTH, HEIGHT);
+
+	//One untimed run of each first, so buffer allocation and shader warm up don't count
+	double per_object_submit = 0, per_object_total = 0;
+	double sort_upload = 0, instanced_submit = 0, instanced_total = 0;
+	for (int run = 0; run <= this->iterations; run++)
+	{
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glFinish();
+
+		//A uniform upload and a draw per object, what drawScene does without instancing
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		glUseProgram(per_object_program);
+		for (uint32_t i = 0; i < object_count; i++)
+		{
+			glm::mat4 mvp = view_projection * scene.model_matrices[i];
+			glUniformMatrix4fv(mvp_location, 1, GL_FALSE, &mvp[0][0]);
+			glUniform3fv(color_location, 1, &scene.materials[scene.material_ids[i]].color[0]);
+			scene.meshes[scene.mesh_ids[i]].geometry->drawGeometry(1);
+		}
+		std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+		glFinish();
+		std::chrono::steady_clock::time_point finished = std::chrono::steady_clock::now();
+		if (run > 0)
+		{
+			per_object_submit += elapsedMs(start, submitted);
+			per_object_total += elapsedMs(start, finished);
+		}
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glFinish();
+
+		//Counting sort by mesh and upload, then an instanced draw per mesh
+		start = std::chrono::steady_clock::now();
+		instances.update(&scene, objects.data(), object_count);
+		std::chrono::steady_clock::time_point uploaded = std::chrono::steady_clock::now();
+		glUseProgram(instanced_program);
+		glUniformMatrix4fv(view_projection_location, 1, GL_FALSE, &view_projection[0][0]);
+		instances.draw(&scene, 1);
+		submitted = std::chrono::steady_clock::now();
+		glFinish();
+		finished = std::chrono::steady_clock::now();
+		if (run > 0)
+		{
+			sort_upload += elapsedMs(start, uploaded);
+			instanced_submit += elapsedMs(uploaded, submitted);
+			instanced_total += elapsedMs(start, finished);
+		}
+	}
+
+	glUseProgram(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	instances.destroy();
+
+	double runs = this->iterations;
+	printf("Instancing, %u cubes\n", object_count);
+	printf("  per object      submit %8.3fms  total %8.3fms  (%u draws)\n", per_object_submit / runs, per_object_total / runs, object_count);
+	printf("  sort + upload          %8.3fms\n", sort_upload / runs);
+	printf("  instanced       submit %8.3fms  total %8.3fms  (%u draws)\n", instanced_submit / runs, instanced_total / runs, instances.draw_calls);
+}
+
+void Bench::benchVisibilityMask()
+{
+	//Without a runtime there is no real mask, stand in with the usual shape: everything outside
+	//an ellipse touching the edges of the image, as triangles between the ellipse and the edges.
+	//With a 90 degree fov the image spans -1 to 1 on the z = -1 plane the mask is given on
+	const int SEGMENTS = 64;
+	const float PI_F = 3.14159265f;
+	std::vector<float> vertices;
+	float hidden_area = 0.0f;
+	for (int i = 0; i < SEGMENTS; i++)
+	{
+		float angles[2] = { 2.0f * PI_F * i / SEGMENTS, 2.0f * PI_F * (i + 1) / SEGMENTS };
+		glm::vec2 inner[2];
+		glm::vec2 outer[2];
+		for (int j = 0; j < 2; j++)
+		{
+			inner[j] = glm::vec2(cosf(angles[j]), sinf(angles[j]));
+			//Push the point out along its ray to the edge of the image
+			outer[j] = inner[j] / fmaxf(fabsf(inner[j].x), fabsf(inner[j].y));
+		}
+		const glm::vec2 triangles[6] = { inner[0], outer[0], outer[1], inner[0], outer[1], inner[1] };
+		for (int j = 0; j < 6; j += 3)
+		{
+			glm::vec2 a = triangles[j];
+			glm::vec2 b = triangles[j + 1];
+			glm::vec2 c = triangles[j + 2];
+			hidden_area += fabsf((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y)) * 0.5f;
+			for (int k = 0; k < 3; k++)
+			{
+				vertices.push_back(triangles[j + k].x);
+				vertices.push_back(triangles[j + k].y);
+				vertices.push_back(0.0f);
+			}
+		}
+	}
+	//Same measure as XrProgram::updateVisibilityMask, the covered area against the whole fov
+	float hidden_fraction = hidden_area / 4.0f;
+
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//Overlapping cubes covering the whole image, viewed up close so every pixel is shaded at least once
+	const uint32_t OBJECT_COUNT = 10000;
+	Scene scene;
+	this->buildGrid(&scene, OBJECT_COUNT, 1, 0.6f);
+	std::vector<uint32_t> objects(OBJECT_COUNT);
+	for (uint32_t i = 0; i < OBJECT_COUNT; i++)
+	{
+		objects[i] = i;
+	}
+	InstanceBuffer instances;
+	if (!instances.init())
+	{
+		printf("Unable to create the instance buffer\n");
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vbo);
+		return;
+	}
+	instances.update(&scene, objects.data(), OBJECT_COUNT);
+
+	glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+	glm::mat4 view_projection = projection * glm::lookAt(glm::vec3(0.0f, 0.0f, 6.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	GLuint instanced_program = this->instanced_shader->getProgram();
+	GLint view_projection_location = glGetUniformLocation(instanced_program, "mvp");
+	GLuint mask_program = this->mask_shader->getProgram();
+	GLint projection_location = glGetUniformLocation(mask_program, "projection");
+
+	//Samples passing the depth test are the ones the fragment shader runs for with early depth testing
+	GLuint queries[2];
+	glGenQueries(2, queries);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+	glViewport(0, 0, WIDTH, HEIGHT);
+
+	GLuint64 samples[2] = { 0, 0 };
+	double gpu_ms[2] = { 0, 0 };
+	for (int run = 0; run <= this->iterations; run++)
+	{
+		for (int masked = 0; masked < 2; masked++)
+		{
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			//What drawVisibilityMask does, depth only with culling off
+			if (masked)
+			{
+				glDisable(GL_CULL_FACE);
+				glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				glUseProgram(mask_program);
+				glUniformMatrix4fv(projection_location, 1, GL_FALSE, &projection[0][0]);
+				glBindVertexArray(vao);
+				glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size() / 3));
+				glBindVertexArray(0);
+				glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+				glEnable(GL_CULL_FACE);
+			}
+
+			glBeginQuery(GL_SAMPLES_PASSED, queries[0]);
+			glBeginQuery(GL_TIME_ELAPSED, queries[1]);
+			glUseProgram(instanced_program);
+			glUniformMatrix4fv(view_projection_location, 1, GL_FALSE, &view_projection[0][0]);
+			instances.draw(&scene, 1);
+			glEndQuery(GL_TIME_ELAPSED);
+			glEndQuery(GL_SAMPLES_PASSED);
+
+			//Waits for the GPU, fine here since nothing else is in flight
+			GLuint64 passed = 0;
+			GLuint64 elapsed_ns = 0;
+			glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &passed);
+			glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &elapsed_ns);
+			if (run > 0)
+			{
+				samples[masked] += passed;
+				gpu_ms[masked] += elapsed_ns / 1000000.0;
+			}
+		}
+	}
+
+	glUseProgram(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteQueries(2, queries);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+	instances.destroy();
+
+	double runs = this->iterations;
+	double saved = samples[0] > 0 ? 1.0 - (double)samples[1] / (double)samples[0] : 0.0;
+	printf("Visibility mask, %u cubes, mask hides %.1f%% of the image\n", OBJECT_COUNT, hidden_fraction * 100.0f);
+	printf("  no mask         %12.0f samples  gpu %8.3fms\n", samples[0] / runs, gpu_ms[0] / runs);
+	printf("  mask            %12.0f samples  gpu %8.3fms  (%.1f%% fewer samples)\n", samples[1] / runs, gpu_ms[1] / runs, saved * 100.0);
+}
+
+void Bench::destroy()
+{
+	glDeleteFramebuffers(1, &this->framebuffer);
+	glDeleteTextures(1, &this->color_image);
+	glDeleteTextures(1, &this->depth_image);
+
+	delete this->cube;
+	delete this->mask_shader;
+	delete this->instanced_shader;
+	delete this->per_object_shader;
+	Shader::default_shader = nullptr;
+
+	glfwTerminate();
+}
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+#include "shader.hpp"
+#include "square.hpp"
+#include "scene.hpp"
+
+#include <stdint.h>
+
+/*
+ Headless benchmarks, run with -bench instead of starting an OpenXR session. A hidden window
+ provides the GL context and everything is drawn into an offscreen framebuffer, so results
+ don't depend on a headset or the compositor. Every case ends with glFinish, so the times
+ include the GPU's share of the work.
+*/
+class Bench
+{
+private:
+	GLFWwindow* window = nullptr;
+
+	//Offscreen target every case draws into
+	GLuint framebuffer = 0;
+	GLuint color_image = 0;
+	GLuint depth_image = 0;
+
+	Shader* per_object_shader = nullptr;
+	Shader* instanced_shader = nullptr;
+	Shader* mask_shader = nullptr;
+	Square* cube = nullptr;
+
+	//Times each case is repeated, the average is printed
+	int iterations = 20;
+
+	/*
+	 buildGrid:  Fill a scene with a square grid of cubes 20 units across on the z = 0 plane, centered on the origin
+	 inputs:     The empty scene, how many cubes, how many mesh ids to spread them over and their size relative to the grid spacing
+	 returns:    None
+	*/
+	void buildGrid(Scene* scene, uint32_t object_count, uint32_t mesh_count, float size);
+
+	/*
+	 benchInstancing: Time per object draws against sorting, uploading and drawing an instance buffer
+	 inputs:          How many cubes the scene holds
+	 returns:         None
+	*/
+	void benchInstancing(uint32_t object_count);
+
+	/*
+	 benchVisibilityMask: Count the samples the scene shades with and without a hidden area mask drawn into depth first
+	 inputs:              None
+	 returns:             None
+	*/
+	void benchVisibilityMask();
+
+public:
+	static const int WIDTH = 1024;
+	static const int HEIGHT = 1024;
+
+	bool init();
+
+	//Runs every benchmark and prints the results
+	void run();
+
+	void destroy();
+};
+
+#endif
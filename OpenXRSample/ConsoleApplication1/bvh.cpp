@@ -0,0 +1,392 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <float.h>
+#include <thread>
+
+namespace
+{
+	float surfaceArea(const glm::vec3& min, const glm::vec3& max)
+	{
+		glm::vec3 size = max - min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	//Slab test, entry is where the ray enters the box, clamped to the origin
+	bool rayBox(const glm::vec3& origin, const glm::vec3& inverse_direction, const glm::vec3& min, const glm::vec3& max, float max_distance, float* entry)
+	{
+		glm::vec3 t0 = (min - origin) * inverse_direction;
+		glm::vec3 t1 = (max - origin) * inverse_direction;
+		glm::vec3 t_min = glm::min(t0, t1);
+		glm::vec3 t_max = glm::max(t0, t1);
+		float t_near = glm::max(glm::max(t_min.x, t_min.y), glm::max(t_min.z, 0.0f));
+		float t_far = glm::min(glm::min(t_max.x, t_max.y), glm::min(t_max.z, max_distance));
+		*entry = t_near;
+		return t_near <= t_far;
+	}
+}
+
+Bvh::Bvh() : node_count(0)
+{
+}
+
+void Bvh::build(const Aabb* bounds, uint32_t count)
+{
+	this->bounds = bounds;
+	this->object_count = count;
+
+	//At most one leaf per object, count - 1 inner nodes, and the slot left empty so child pairs start on a cache line
+	uint32_t max_nodes = count < 1 ? 2 : 2 * count;
+	size_t storage_size = max_nodes * sizeof(BvhNode) + 64;
+	if (this->node_storage.size() < storage_size)
+	{
+		this->node_storage.resize(storage_size);
+	}
+	uintptr_t address = reinterpret_cast<uintptr_t>(this->node_storage.data());
+	this->nodes = reinterpret_cast<BvhNode*>((address + 63) & ~static_cast<uintptr_t>(63));
+
+	this->parents.resize(max_nodes);
+	this->objects.resize(count);
+	this->object_leaves.resize(count);
+	this->centroids.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		this->objects[i] = i;
+		this->centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+	}
+
+	//Enough levels of two way splits to give every core a subtree
+	unsigned int threads = std::thread::hardware_concurrency();
+	this->parallel_depth = 0;
+	while ((1u << this->parallel_depth) < threads)
+	{
+		this->parallel_depth++;
+	}
+
+	//Pairs start at 2, node 1 stays unused
+	this->node_count = 2;
+	this->parents[ROOT] = ROOT;
+	this->buildNode(ROOT, 0, count, 0);
+
+	this->stats.builds++;
+}
+
+void Bvh::makeLeaf(uint32_t node, uint32_t first, uint32_t count)
+{
+	this->nodes[node].first = first;
+	this->nodes[node].count = count;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		this->object_leaves[this->objects[i]] = node;
+	}
+}
+
+void Bvh::buildNode(uint32_t node, uint32_t first, uint32_t count, int depth)
+{
+	glm::vec3 box_min(FLT_MAX);
+	glm::vec3 box_max(-FLT_MAX);
+	glm::vec3 centre_min(FLT_MAX);
+	glm::vec3 centre_max(-FLT_MAX);
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		uint32_t object = this->objects[i];
+		box_min = glm::min(box_min, this->bounds[object].min);
+		box_max = glm::max(box_max, this->bounds[object].max);
+		centre_min = glm::min(centre_min, this->centroids[object]);
+		centre_max = glm::max(centre_max, this->centroids[object]);
+	}
+	this->nodes[node].min = box_min;
+	this->nodes[node].max = box_max;
+
+	if (count <= 1 || depth >= MAX_DEPTH)
+	{
+		this->makeLeaf(node, first, count);
+		return;
+	}
+
+	//Bin the centres along each axis and price every split between bins by surface area times object count
+	float best_cost = FLT_MAX;
+	int best_axis = -1;
+	int best_bin = 0;
+	glm::vec3 extent = centre_max - centre_min;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (extent[axis] <= 0.0f)
+		{
+			continue;
+		}
+
+		uint32_t bin_counts[BIN_COUNT] = {};
+		glm::vec3 bin_min[BIN_COUNT];
+		glm::vec3 bin_max[BIN_COUNT];
+		for (int bin = 0; bin < BIN_COUNT; bin++)
+		{
+			bin_min[bin] = glm::vec3(FLT_MAX);
+			bin_max[bin] = glm::vec3(-FLT_MAX);
+		}
+
+		float scale = BIN_COUNT / extent[axis];
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			uint32_t object = this->objects[i];
+			int bin = static_cast<int>((this->centroids[object][axis] - centre_min[axis]) * scale);
+			if (bin >= BIN_COUNT)
+			{
+				bin = BIN_COUNT - 1;
+			}
+			bin_counts[bin]++;
+			bin_min[bin] = glm::min(bin_min[bin], this->bounds[object].min);
+			bin_max[bin] = glm::max(bin_max[bin], this->bounds[object].max);
+		}
+
+		//Sweep from the right first, then the left sweep can price each split as it goes
+		float right_area[BIN_COUNT];
+		uint32_t right_count[BIN_COUNT];
+		glm::vec3 sweep_min(FLT_MAX);
+		glm::vec3 sweep_max(-FLT_MAX);
+		uint32_t sweep_count = 0;
+		for (int bin = BIN_COUNT - 1; bin > 0; bin--)
+		{
+			sweep_count += bin_counts[bin];
+			sweep_min = glm::min(sweep_min, bin_min[bin]);
+			sweep_max = glm::max(sweep_max, bin_max[bin]);
+			right_count[bin] = sweep_count;
+			right_area[bin] = sweep_count > 0 ? surfaceArea(sweep_min, sweep_max) : 0.0f;
+		}
+
+		sweep_min = glm::vec3(FLT_MAX);
+		sweep_max = glm::vec3(-FLT_MAX);
+		sweep_count = 0;
+		for (int bin = 0; bin < BIN_COUNT - 1; bin++)
+		{
+			sweep_count += bin_counts[bin];
+			sweep_min = glm::min(sweep_min, bin_min[bin]);
+			sweep_max = glm::max(sweep_max, bin_max[bin]);
+			if (sweep_count == 0 || right_count[bin + 1] == 0)
+			{
+				continue;
+			}
+			float cost = surfaceArea(sweep_min, sweep_max) * sweep_count + right_area[bin + 1] * right_count[bin + 1];
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = bin + 1;
+			}
+		}
+	}
+
+	//In units of one box test, a split costs one more test for the children's boxes
+	float node_area = surfaceArea(box_min, box_max);
+	float leaf_cost = static_cast<float>(count);
+	float split_cost = best_axis < 0 ? FLT_MAX : 1.0f + best_cost / (node_area > 0.0f ? node_area : 1.0f);
+	if (count <= MAX_LEAF_SIZE && leaf_cost <= split_cost)
+	{
+		this->makeLeaf(node, first, count);
+		return;
+	}
+
+	uint32_t left_count;
+	if (best_axis < 0)
+	{
+		//Every centre is in the same place so no plane separates them, split the list in half
+		left_count = count / 2;
+	}
+	else
+	{
+		float axis_min = centre_min[best_axis];
+		float scale = BIN_COUNT / extent[best_axis];
+		const glm::vec3* centroids = this->centroids.data();
+		uint32_t* begin = this->objects.data() + first;
+		uint32_t* middle = std::partition(begin, begin + count, [=](uint32_t object)
+			{
+				int bin = static_cast<int>((centroids[object][best_axis] - axis_min) * scale);
+				return bin < best_bin;
+			});
+		left_count = static_cast<uint32_t>(middle - begin);
+	}
+
+	uint32_t left = this->node_count.fetch_add(2);
+	this->nodes[node].first = left;
+	this->nodes[node].count = 0;
+	this->parents[left] = node;
+	this->parents[left + 1] = node;
+
+	if (count > PARALLEL_THRESHOLD && depth < this->parallel_depth)
+	{
+		std::thread worker(&Bvh::buildNode, this, left, first, left_count, depth + 1);
+		this->buildNode(left + 1, first + left_count, count - left_count, depth + 1);
+		worker.join();
+	}
+	else
+	{
+		this->buildNode(left, first, left_count, depth + 1);
+		this->buildNode(left + 1, first + left_count, count - left_count, depth + 1);
+	}
+}
+
+bool Bvh::refitNode(uint32_t node)
+{
+	BvhNode& refit = this->nodes[node];
+	glm::vec3 box_min(FLT_MAX);
+	glm::vec3 box_max(-FLT_MAX);
+	if (refit.count > 0)
+	{
+		for (uint32_t i = refit.first; i < refit.first + refit.count; i++)
+		{
+			uint32_t object = this->objects[i];
+			box_min = glm::min(box_min, this->bounds[object].min);
+			box_max = glm::max(box_max, this->bounds[object].max);
+		}
+	}
+	else
+	{
+		const BvhNode& left = this->nodes[refit.first];
+		const BvhNode& right = this->nodes[refit.first + 1];
+		box_min = glm::min(left.min, right.min);
+		box_max = glm::max(left.max, right.max);
+	}
+
+	bool changed = box_min != refit.min || box_max != refit.max;
+	refit.min = box_min;
+	refit.max = box_max;
+	return changed;
+}
+
+void Bvh::refit(const Aabb* bounds, const uint32_t* moved, uint32_t moved_count)
+{
+	this->bounds = bounds;
+	this->stats.refits++;
+	this->stats.refit_nodes = 0;
+	if (this->object_count == 0)
+	{
+		return;
+	}
+
+	//Once a good share of the objects moved their paths to the root overlap, one pass over every node is cheaper
+	if (moved_count * 4 > this->object_count)
+	{
+		//Children are always handed out after their parent, so walking backwards refits children first
+		uint32_t node_count = this->node_count.load();
+		for (uint32_t node = node_count - 1; node > 1; node--)
+		{
+			this->refitNode(node);
+		}
+		this->refitNode(ROOT);
+		this->stats.refit_nodes = node_count - 1;
+		return;
+	}
+
+	for (uint32_t i = 0; i < moved_count; i++)
+	{
+		//Stop as soon as a box doesn't change, nothing above it will either
+		uint32_t node = this->object_leaves[moved[i]];
+		while (true)
+		{
+			this->stats.refit_nodes++;
+			if (!this->refitNode(node) || node == ROOT)
+			{
+				break;
+			}
+			node = this->parents[node];
+		}
+	}
+}
+
+void Bvh::update(Scene* scene)
+{
+	uint32_t count = scene->getCount();
+	if (scene->layout_version != this->layout_version || count != this->object_count)
+	{
+		this->build(scene->bounds.data(), count);
+		this->layout_version = scene->layout_version;
+	}
+	else if (!scene->moved.empty())
+	{
+		this->refit(scene->bounds.data(), scene->moved.data(), static_cast<uint32_t>(scene->moved.size()));
+	}
+}
+
+bool Bvh::raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, uint32_t* object, float* distance) const
+{
+	if (this->object_count == 0)
+	{
+		return false;
+	}
+
+	glm::vec3 inverse_direction = 1.0f / direction;
+	float nearest = max_distance;
+	bool hit = false;
+
+	uint32_t stack[MAX_DEPTH * 2];
+	int top = 0;
+	stack[top++] = ROOT;
+	while (top > 0)
+	{
+		//Boxes are tested again when popped, a closer hit may have been found since they were pushed
+		const BvhNode& node = this->nodes[stack[--top]];
+		float entry;
+		if (!rayBox(origin, inverse_direction, node.min, node.max, nearest, &entry))
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				uint32_t candidate = this->objects[i];
+				if (rayBox(origin, inverse_direction, this->bounds[candidate].min, this->bounds[candidate].max, nearest, &entry))
+				{
+					nearest = entry;
+					*object = candidate;
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		//Visit the nearer child first, its hits can then rule out the farther one
+		const BvhNode& left = this->nodes[node.first];
+		const BvhNode& right = this->nodes[node.first + 1];
+		float left_entry;
+		float right_entry;
+		bool left_hit = rayBox(origin, inverse_direction, left.min, left.max, nearest, &left_entry);
+		bool right_hit = rayBox(origin, inverse_direction, right.min, right.max, nearest, &right_entry);
+		if (left_hit && right_hit)
+		{
+			bool left_first = left_entry <= right_entry;
+			stack[top++] = left_first ? node.first + 1 : node.first;
+			stack[top++] = left_first ? node.first : node.first + 1;
+		}
+		else if (left_hit)
+		{
+			stack[top++] = node.first;
+		}
+		else if (right_hit)
+		{
+			stack[top++] = node.first + 1;
+		}
+	}
+
+	if (hit)
+	{
+		*distance = nearest;
+	}
+	return hit;
+}
+
+const BvhNode* Bvh::getNodes() const
+{
+	return this->nodes;
+}
+
+const uint32_t* Bvh::getObjects() const
+{
+	return this->objects.data();
+}
+
+uint32_t Bvh::getObjectCount() const
+{
+	return this->object_count;
+}
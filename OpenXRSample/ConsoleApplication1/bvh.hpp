@@ -0,0 +1,129 @@
+#pragma once
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include "scene.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/*
+ 32 bytes, so with the node array 64 byte aligned and children allocated in pairs from an even
+ index both children of a node share one cache line.
+*/
+struct BvhNode
+{
+	glm::vec3 min;
+	//Inner nodes: index of the left child, the right child follows it. Leaves: first entry in the object list
+	uint32_t first;
+	glm::vec3 max;
+	//Objects in a leaf, 0 for inner nodes
+	uint32_t count;
+};
+
+/*
+ Bounding volume hierarchy over the scene's object bounds, built top down with binned SAH splits.
+ Large subtrees are built on worker threads. When objects move the boxes are refit bottom up
+ from the moved objects' leaves instead of rebuilding, adding or removing objects rebuilds it.
+*/
+class Bvh
+{
+public:
+	static const uint32_t ROOT = 0;
+
+	//Candidate split planes per axis
+	static const int BIN_COUNT = 16;
+
+	//Leaves hold at most this many objects, fewer if the SAH says splitting further is cheaper
+	static const uint32_t MAX_LEAF_SIZE = 8;
+
+	//Deeper nodes are always made leaves, bounds the traversal stacks
+	static const int MAX_DEPTH = 64;
+
+	//Subtrees with more objects than this get a thread for their left child
+	static const uint32_t PARALLEL_THRESHOLD = 16384;
+
+private:
+	//Raw storage, nodes points at its first 64 byte boundary
+	std::vector<uint8_t> node_storage;
+	BvhNode* nodes = nullptr;
+
+	//Handed out in pairs while building, shared by the build threads
+	std::atomic<uint32_t> node_count;
+
+	//Per node, for refitting towards the root
+	std::vector<uint32_t> parents;
+
+	//Object indices, every leaf owns a contiguous run
+	std::vector<uint32_t> objects;
+
+	//Per object, the leaf it is in
+	std::vector<uint32_t> object_leaves;
+
+	//Per object, centre of its bounds, what the splits are chosen on
+	std::vector<glm::vec3> centroids;
+
+	const Aabb* bounds = nullptr;
+
+	uint32_t object_count = 0;
+
+	//Scene::layout_version the tree was built from
+	uint64_t layout_version = UINT64_MAX;
+
+	//Subtrees shallower than this are built in parallel
+	int parallel_depth = 0;
+
+	void buildNode(uint32_t node, uint32_t first, uint32_t count, int depth);
+
+	void makeLeaf(uint32_t node, uint32_t first, uint32_t count);
+
+	//Recompute a node's box from its objects or its children, returns false if it didn't change
+	bool refitNode(uint32_t node);
+
+public:
+	//What update has been doing, refit_nodes is the nodes the last refit touched
+	struct {
+		uint64_t builds = 0;
+		uint64_t refits = 0;
+		uint32_t refit_nodes = 0;
+	} stats;
+
+	Bvh();
+
+	/*
+	 build:      Build the tree over every object's bounds
+	 inputs:     The object bounds and how many there are
+	 returns:    None
+	*/
+	void build(const Aabb* bounds, uint32_t count);
+
+	/*
+	 refit:      Grow or shrink the boxes above the moved objects to their new bounds, the tree shape stays the same
+	 inputs:     The object bounds the tree was built over, moved since the last build or refit, and the moved objects
+	 returns:    None
+	*/
+	void refit(const Aabb* bounds, const uint32_t* moved, uint32_t moved_count);
+
+	/*
+	 update:     Rebuild if objects were added or removed since the last build, otherwise refit the moved ones
+	 inputs:     The scene, after Scene::update
+	 returns:    None
+	*/
+	void update(Scene* scene);
+
+	/*
+	 raycast:    Find the nearest object whose bounds the ray enters
+	 inputs:     The ray's origin and direction, how far along it to look, and where to put the object and distance hit
+	 returns:    false if nothing is hit within max_distance
+	*/
+	bool raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, uint32_t* object, float* distance) const;
+
+	const BvhNode* getNodes() const;
+
+	const uint32_t* getObjects() const;
+
+	uint32_t getObjectCount() const;
+};
+
+#endif
@@ -0,0 +1,399 @@
+#include "culling.hpp"
+
+#include <math.h>
+#include <float.h>
+
+#include <xmmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+XrFovf FrustumCuller::widenFov(const XrFovf& fov, float angle)
+{
+	const float max_angle = 1.55f;
+	XrFovf wide;
+	wide.angleLeft = fmaxf(fov.angleLeft - angle, -max_angle);
+	wide.angleRight = fminf(fov.angleRight + angle, max_angle);
+	wide.angleDown = fmaxf(fov.angleDown - angle, -max_angle);
+	wide.angleUp = fminf(fov.angleUp + angle, max_angle);
+	return wide;
+}
+
+void FrustumCuller::buildFrustum(CullFrustum* frustum, const XrQuaternionf& orientation, const XrFovf& fov, const XrView* views, uint32_t view_count, float near_z, float far_z, float margin)
+{
+	//Inward normals in view space, looking down -z
+	glm::vec3 normals[CullFrustum::PLANE_COUNT] = {
+		glm::vec3(1.0f, 0.0f, tanf(fov.angleLeft)),
+		glm::vec3(-1.0f, 0.0f, -tanf(fov.angleRight)),
+		glm::vec3(0.0f, 1.0f, tanf(fov.angleDown)),
+		glm::vec3(0.0f, -1.0f, -tanf(fov.angleUp)),
+		glm::vec3(0.0f, 0.0f, -1.0f),	//Near
+		glm::vec3(0.0f, 0.0f, 1.0f)		//Far
+	};
+
+	glm::quat rotation(orientation.w, orientation.x, orientation.y, orientation.z);
+	for (int plane = 0; plane < CullFrustum::PLANE_COUNT; plane++)
+	{
+		glm::vec3 normal = glm::normalize(rotation * normals[plane]);
+
+		//Each view's frustum lies on the inside of the plane through its own eye, so taking the
+		//loosest offset over the eyes gives a plane that has all of them on its inside
+		float offset = -FLT_MAX;
+		for (uint32_t i = 0; i < view_count; i++)
+		{
+			const XrVector3f& eye = views[i].pose.position;
+			float eye_offset = -(normal.x * eye.x + normal.y * eye.y + normal.z * eye.z);
+			if (plane == 4)
+			{
+				eye_offset -= near_z;
+			}
+			else if (plane == 5)
+			{
+				eye_offset += far_z;
+			}
+			if (eye_offset > offset)
+			{
+				offset = eye_offset;
+			}
+		}
+
+		frustum->normal_x[plane] = normal.x;
+		frustum->normal_y[plane] = normal.y;
+		frustum->normal_z[plane] = normal.z;
+		frustum->offset[plane] = offset + margin;
+	}
+}
+
+void FrustumCuller::setViews(const XrView* views, uint32_t view_count, float near_z, float far_z)
+{
+	this->frustum_count = 0;
+	if (view_count == 0)
+	{
+		return;
+	}
+
+	//Canted displays turn the views away from each other, the combined frustum only holds for views facing the same way
+	//Views close enough to share a frustum can still be turned slightly from the first, the largest such angle is added to the margin
+	bool shared_orientation = true;
+	float spread = 0.0f;
+	const XrQuaternionf& first = views[0].pose.orientation;
+	for (uint32_t i = 1; i < view_count; i++)
+	{
+		const XrQuaternionf& other = views[i].pose.orientation;
+		float dot = fabsf(first.x * other.x + first.y * other.y + first.z * other.z + first.w * other.w);
+		if (dot < 0.99999f)
+		{
+			shared_orientation = false;
+		}
+		else
+		{
+			float angle = 2.0f * acosf(fminf(dot, 1.0f));
+			if (angle > spread)
+			{
+				spread = angle;
+			}
+		}
+	}
+
+	if (shared_orientation)
+	{
+		//The widest angle on each side, the planes are then pushed out to cover every eye
+		XrFovf fov = views[0].fov;
+		for (uint32_t i = 1; i < view_count; i++)
+		{
+			if (views[i].fov.angleLeft < fov.angleLeft)
+			{
+				fov.angleLeft = views[i].fov.angleLeft;
+			}
+			if (views[i].fov.angleRight > fov.angleRight)
+			{
+				fov.angleRight = views[i].fov.angleRight;
+			}
+			if (views[i].fov.angleDown < fov.angleDown)
+			{
+				fov.angleDown = views[i].fov.angleDown;
+			}
+			if (views[i].fov.angleUp > fov.angleUp)
+			{
+				fov.angleUp = views[i].fov.angleUp;
+			}
+		}
+		buildFrustum(&this->frusta[0], first, widenFov(fov, this->angular_margin + spread), views, view_count, near_z, far_z, this->margin);
+		this->frustum_count = 1;
+	}
+	else if (view_count <= MAX_FRUSTA)
+	{
+		for (uint32_t i = 0; i < view_count; i++)
+		{
+			buildFrustum(&this->frusta[i], views[i].pose.orientation, widenFov(views[i].fov, this->angular_margin), &views[i], 1, near_z, far_z, this->margin);
+		}
+		this->frustum_count = view_count;
+	}
+}
+
+const CullFrustum* FrustumCuller::getFrusta()
+{
+	return this->frusta;
+}
+
+int FrustumCuller::getFrustumCount()
+{
+	return this->enabled ? this->frustum_count : 0;
+}
+
+int FrustumCuller::testBoxes4(const Aabb* bounds)
+{
+	__m128 min_x = _mm_setr_ps(bounds[0].min.x, bounds[1].min.x, bounds[2].min.x, bounds[3].min.x);
+	__m128 min_y = _mm_setr_ps(bounds[0].min.y, bounds[1].min.y, bounds[2].min.y, bounds[3].min.y);
+	__m128 min_z = _mm_setr_ps(bounds[0].min.z, bounds[1].min.z, bounds[2].min.z, bounds[3].min.z);
+	__m128 max_x = _mm_setr_ps(bounds[0].max.x, bounds[1].max.x, bounds[2].max.x, bounds[3].max.x);
+	__m128 max_y = _mm_setr_ps(bounds[0].max.y, bounds[1].max.y, bounds[2].max.y, bounds[3].max.y);
+	__m128 max_z = _mm_setr_ps(bounds[0].max.z, bounds[1].max.z, bounds[2].max.z, bounds[3].max.z);
+	__m128 zero = _mm_setzero_ps();
+
+	int visible = 0;
+	for (int f = 0; f < this->frustum_count; f++)
+	{
+		const CullFrustum& frustum = this->frusta[f];
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (int plane = 0; plane < CullFrustum::PLANE_COUNT; plane++)
+		{
+			//The corner furthest along the normal, if even that is behind the plane the whole box is
+			__m128 x = frustum.normal_x[plane] >= 0.0f ? max_x : min_x;
+			__m128 y = frustum.normal_y[plane] >= 0.0f ? max_y : min_y;
+			__m128 z = frustum.normal_z[plane] >= 0.0f ? max_z : min_z;
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(frustum.normal_x[plane])), _mm_mul_ps(y, _mm_set1_ps(frustum.normal_y[plane]))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(frustum.normal_z[plane])), _mm_set1_ps(frustum.offset[plane])));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+		}
+		visible |= _mm_movemask_ps(inside);
+	}
+	return visible;
+}
+
+int FrustumCuller::testBoxes8(const Aabb* bounds)
+{
+#ifdef __AVX__
+	__m256 min_x = _mm256_setr_ps(bounds[0].min.x, bounds[1].min.x, bounds[2].min.x, bounds[3].min.x, bounds[4].min.x, bounds[5].min.x, bounds[6].min.x, bounds[7].min.x);
+	__m256 min_y = _mm256_setr_ps(bounds[0].min.y, bounds[1].min.y, bounds[2].min.y, bounds[3].min.y, bounds[4].min.y, bounds[5].min.y, bounds[6].min.y, bounds[7].min.y);
+	__m256 min_z = _mm256_setr_ps(bounds[0].min.z, bounds[1].min.z, bounds[2].min.z, bounds[3].min.z, bounds[4].min.z, bounds[5].min.z, bounds[6].min.z, bounds[7].min.z);
+	__m256 max_x = _mm256_setr_ps(bounds[0].max.x, bounds[1].max.x, bounds[2].max.x, bounds[3].max.x, bounds[4].max.x, bounds[5].max.x, bounds[6].max.x, bounds[7].max.x);
+	__m256 max_y = _mm256_setr_ps(bounds[0].max.y, bounds[1].max.y, bounds[2].max.y, bounds[3].max.y, bounds[4].max.y, bounds[5].max.y, bounds[6].max.y, bounds[7].max.y);
+	__m256 max_z = _mm256_setr_ps(bounds[0].max.z, bounds[1].max.z, bounds[2].max.z, bounds[3].max.z, bounds[4].max.z, bounds[5].max.z, bounds[6].max.z, bounds[7].max.z);
+	__m256 zero = _mm256_setzero_ps();
+
+	int visible = 0;
+	for (int f = 0; f < this->frustum_count; f++)
+	{
+		const CullFrustum& frustum = this->frusta[f];
+		__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+		for (int plane = 0; plane < CullFrustum::PLANE_COUNT; plane++)
+		{
+			__m256 x = frustum.normal_x[plane] >= 0.0f ? max_x : min_x;
+			__m256 y = frustum.normal_y[plane] >= 0.0f ? max_y : min_y;
+			__m256 z = frustum.normal_z[plane] >= 0.0f ? max_z : min_z;
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(frustum.normal_x[plane])), _mm256_mul_ps(y, _mm256_set1_ps(frustum.normal_y[plane]))),
+				_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(frustum.normal_z[plane])), _mm256_set1_ps(frustum.offset[plane])));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+		}
+		visible |= _mm256_movemask_ps(inside);
+	}
+	return visible;
+#else
+	return testBoxes4(bounds) | (testBoxes4(bounds + 4) << 4);
+#endif
+}
+
+bool FrustumCuller::testBox(const Aabb& bounds)
+{
+	for (int f = 0; f < this->frustum_count; f++)
+	{
+		const CullFrustum& frustum = this->frusta[f];
+		bool inside = true;
+		for (int plane = 0; plane < CullFrustum::PLANE_COUNT && inside; plane++)
+		{
+			float x = frustum.normal_x[plane] >= 0.0f ? bounds.max.x : bounds.min.x;
+			float y = frustum.normal_y[plane] >= 0.0f ? bounds.max.y : bounds.min.y;
+			float z = frustum.normal_z[plane] >= 0.0f ? bounds.max.z : bounds.min.z;
+			inside = x * frustum.normal_x[plane] + y * frustum.normal_y[plane] + z * frustum.normal_z[plane] + frustum.offset[plane] >= 0.0f;
+		}
+		if (inside)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+CullResult FrustumCuller::classifyBox(const glm::vec3& min, const glm::vec3& max)
+{
+	CullResult result = CULL_OUTSIDE;
+	for (int f = 0; f < this->frustum_count; f++)
+	{
+		const CullFrustum& frustum = this->frusta[f];
+		bool outside = false;
+		bool crossing = false;
+		for (int plane = 0; plane < CullFrustum::PLANE_COUNT && !outside; plane++)
+		{
+			//Furthest corner along the normal decides outside, the nearest one decides whether the box crosses the plane
+			bool positive_x = frustum.normal_x[plane] >= 0.0f;
+			bool positive_y = frustum.normal_y[plane] >= 0.0f;
+			bool positive_z = frustum.normal_z[plane] >= 0.0f;
+			float far_distance = (positive_x ? max.x : min.x) * frustum.normal_x[plane] + (positive_y ? max.y : min.y) * frustum.normal_y[plane]
+				+ (positive_z ? max.z : min.z) * frustum.normal_z[plane] + frustum.offset[plane];
+			float near_distance = (positive_x ? min.x : max.x) * frustum.normal_x[plane] + (positive_y ? min.y : max.y) * frustum.normal_y[plane]
+				+ (positive_z ? min.z : max.z) * frustum.normal_z[plane] + frustum.offset[plane];
+			outside = far_distance < 0.0f;
+			crossing = crossing || near_distance < 0.0f;
+		}
+		if (outside)
+		{
+			continue;
+		}
+		if (!crossing)
+		{
+			return CULL_INSIDE;
+		}
+		result = CULL_INTERSECTS;
+	}
+	return result;
+}
+
+void FrustumCuller::appendVisible(uint32_t object)
+{
+	this->visible[this->visible_count++] = object;
+}
+
+uint32_t FrustumCuller::cull(const Aabb* bounds, uint32_t count)
+{
+	//Only grows, so a steady scene doesn't allocate
+	if (this->visible.size() < count)
+	{
+		this->visible.resize(count);
+	}
+	uint32_t* visible = this->visible.data();
+	uint32_t visible_count = 0;
+
+	if (!this->enabled || this->frustum_count == 0)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			visible[i] = i;
+		}
+		this->visible_count = count;
+		return count;
+	}
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		int mask = this->testBoxes8(bounds + i);
+		for (uint32_t lane = 0; lane < 8; lane++)
+		{
+			//Write unconditionally and only keep it if it passed, no branch to mispredict
+			visible[visible_count] = i + lane;
+			visible_count += (mask >> lane) & 1;
+		}
+	}
+	for (; i + 4 <= count; i += 4)
+	{
+		int mask = this->testBoxes4(bounds + i);
+		for (uint32_t lane = 0; lane < 4; lane++)
+		{
+			visible[visible_count] = i + lane;
+			visible_count += (mask >> lane) & 1;
+		}
+	}
+	for (; i < count; i++)
+	{
+		if (this->testBox(bounds[i]))
+		{
+			visible[visible_count++] = i;
+		}
+	}
+
+	this->visible_count = visible_count;
+	return visible_count;
+}
+
+uint32_t FrustumCuller::cull(const Bvh& bvh, const Aabb* bounds)
+{
+	uint32_t count = bvh.getObjectCount();
+	if (!this->enabled || this->frustum_count == 0 || count == 0)
+	{
+		return this->cull(bounds, count);
+	}
+
+	if (this->visible.size() < count)
+	{
+		this->visible.resize(count);
+	}
+	this->visible_count = 0;
+
+	const BvhNode* nodes = bvh.getNodes();
+	const uint32_t* objects = bvh.getObjects();
+
+	//Nodes still to visit, the top bit marks subtrees already known to be entirely inside
+	const uint32_t INSIDE_BIT = 0x80000000u;
+	uint32_t stack[Bvh::MAX_DEPTH * 2];
+	int top = 0;
+	stack[top++] = Bvh::ROOT;
+	while (top > 0)
+	{
+		uint32_t entry = stack[--top];
+		const BvhNode& node = nodes[entry & ~INSIDE_BIT];
+		bool inside = (entry & INSIDE_BIT) != 0;
+		if (!inside)
+		{
+			CullResult result = this->classifyBox(node.min, node.max);
+			if (result == CULL_OUTSIDE)
+			{
+				continue;
+			}
+			inside = result == CULL_INSIDE;
+		}
+
+		if (node.count == 0)
+		{
+			uint32_t flag = inside ? INSIDE_BIT : 0;
+			stack[top++] = (node.first + 1) | flag;
+			stack[top++] = node.first | flag;
+			continue;
+		}
+
+		if (inside)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				this->appendVisible(objects[i]);
+			}
+			continue;
+		}
+
+		//A leaf crossing a plane, test its objects eight at a time, repeating the last box to fill the batch
+		for (uint32_t i = node.first; i < node.first + node.count; i += 8)
+		{
+			uint32_t batch_count = node.first + node.count - i;
+			if (batch_count > 8)
+			{
+				batch_count = 8;
+			}
+			Aabb batch[8];
+			for (uint32_t lane = 0; lane < 8; lane++)
+			{
+				batch[lane] = bounds[objects[i + (lane < batch_count ? lane : batch_count - 1)]];
+			}
+			int mask = this->testBoxes8(batch);
+			for (uint32_t lane = 0; lane < batch_count; lane++)
+			{
+				if ((mask >> lane) & 1)
+				{
+					this->appendVisible(objects[i + lane]);
+				}
+			}
+		}
+	}
+	return this->visible_count;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+#include <openxr/openxr.h>
+
+#include "scene.hpp"
+#include "bvh.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+//Planes stored component by component, a point p is inside a plane when dot(normal, p) + offset >= 0
+struct CullFrustum
+{
+	static const int PLANE_COUNT = 6;
+
+	float normal_x[PLANE_COUNT];
+	float normal_y[PLANE_COUNT];
+	float normal_z[PLANE_COUNT];
+	float offset[PLANE_COUNT];
+};
+
+enum CullResult
+{
+	CULL_OUTSIDE,
+	CULL_INTERSECTS,
+	CULL_INSIDE
+};
+
+/*
+ Tests object bounds against one frustum covering every view, so each object is tested once per
+ frame and every view's draws share the result. Boxes go through the planes four at a time with
+ SSE, or eight at a time when built with AVX, the same test as XrMatrix4x4f_CullBounds in batches.
+*/
+class FrustumCuller
+{
+public:
+	//Views that don't share an orientation get a frustum each, beyond this nothing is culled
+	static const int MAX_FRUSTA = 4;
+
+private:
+	CullFrustum frusta[MAX_FRUSTA];
+
+	int frustum_count = 0;
+
+	//The fov with every side opened out by angle radians, kept short of a right angle
+	static XrFovf widenFov(const XrFovf& fov, float angle);
+
+	static void buildFrustum(CullFrustum* frustum, const XrQuaternionf& orientation, const XrFovf& fov, const XrView* views, uint32_t view_count, float near_z, float far_z, float margin);
+
+	//Bit i is set if box i is inside any of the frusta
+	int testBoxes4(const Aabb* bounds);
+	int testBoxes8(const Aabb* bounds);
+	bool testBox(const Aabb& bounds);
+
+	//Whether a box is outside every frustum, entirely inside one of them, or neither
+	CullResult classifyBox(const glm::vec3& min, const glm::vec3& max);
+
+	void appendVisible(uint32_t object);
+
+public:
+	bool enabled = true;
+
+	//Meters every plane is pushed out by, covers the views moving between culling and late latching
+	float margin = 0.05f;
+
+	//Radians each side plane is turned outwards by, covers the head turning between culling and late latching.
+	//About 2 degrees, a 200 degree per second turn over 10 ms
+	float angular_margin = 0.035f;
+
+	//Indices of the objects that passed the last cull, the first visible_count entries are valid
+	std::vector<uint32_t> visible;
+	uint32_t visible_count = 0;
+
+	/*
+	 setViews:   Build the frustum covering every view, one frustum per view if they face different ways
+	 inputs:     The located views, their count, and the near and far distances the projections were built with
+	 returns:    None
+	*/
+	void setViews(const XrView* views, uint32_t view_count, float near_z, float far_z);
+
+	//The frusta from the last setViews, none when culling is off
+	const CullFrustum* getFrusta();
+	int getFrustumCount();
+
+	/*
+	 cull:       Fill the visible list with the objects whose bounds touch the frustum
+	 inputs:     World bounds of every object and the object count
+	 returns:    The number of visible objects
+	*/
+	uint32_t cull(const Aabb* bounds, uint32_t count);
+
+	/*
+	 cull:       Same as the flat cull, walking a hierarchy built over the bounds so whole subtrees are kept or dropped with one test
+	 inputs:     The hierarchy and the object bounds it was built or last refit over
+	 returns:    The number of visible objects
+	*/
+	uint32_t cull(const Bvh& bvh, const Aabb* bounds);
+};
+
+#endif
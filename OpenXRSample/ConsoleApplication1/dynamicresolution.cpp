@@ -0,0 +1,75 @@
+#include "dynamicresolution.hpp"
+#include <math.h>
+
+float DynamicResolution::update(double gpu_ms, double display_period_ms)
+{
+	if (!this->enabled)
+	{
+		return 1.0f;
+	}
+
+	double target = this->target_ms > 0.0 ? this->target_ms : display_period_ms * this->budget_fraction;
+	this->average_ms = this->stats.frames_sampled == 0 ? gpu_ms : this->average_ms * 0.9 + gpu_ms * 0.1;
+
+	if (gpu_ms > target)
+	{
+		this->under_budget_frames = 0;
+		this->over_budget_frames++;
+		if (this->over_budget_frames >= this->shrink_frames)
+		{
+			//GPU time goes with the pixel count, so the scale goes with its square root
+			float wanted = this->scale * (float)sqrt(target / gpu_ms);
+			float step = this->scale - wanted;
+			if (step > this->max_shrink_step)
+			{
+				step = this->max_shrink_step;
+			}
+			this->scale -= step;
+			this->over_budget_frames = 0;
+			this->stats.decreases++;
+		}
+	}
+	else if (this->average_ms < target * this->grow_threshold)
+	{
+		this->over_budget_frames = 0;
+		this->under_budget_frames++;
+		if (this->under_budget_frames >= this->grow_frames && this->scale < this->max_scale)
+		{
+			this->scale += this->grow_step;
+			this->under_budget_frames = 0;
+			this->stats.increases++;
+		}
+	}
+	else
+	{
+		//Close to the budget, hold still
+		this->over_budget_frames = 0;
+		this->under_budget_frames = 0;
+	}
+
+	if (this->scale < this->min_scale)
+	{
+		this->scale = this->min_scale;
+	}
+	if (this->scale > this->max_scale)
+	{
+		this->scale = this->max_scale;
+	}
+
+	this->stats.scale = this->scale;
+	this->stats.last_gpu_ms = gpu_ms;
+	this->stats.average_gpu_ms = this->average_ms;
+	this->stats.target_ms = target;
+	this->stats.frames_sampled++;
+	return this->scale;
+}
+
+float DynamicResolution::getAllocationScale()
+{
+	return this->enabled ? this->max_scale : 1.0f;
+}
+
+float DynamicResolution::getScale()
+{
+	return this->enabled ? this->scale : 1.0f;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef DYNAMICRESOLUTION_HPP
+#define DYNAMICRESOLUTION_HPP
+
+#include <stdint.h>
+
+/*
+ Picks a render scale each frame from measured GPU frame time so the frame fits its budget.
+ Shrinking reacts within a couple of frames, growing waits for sustained headroom, so the
+ scale doesn't oscillate around the target.
+*/
+class DynamicResolution
+{
+private:
+	float scale = 1.0f;
+
+	//Consecutive frames over budget, and comfortably under it
+	int over_budget_frames = 0;
+	int under_budget_frames = 0;
+
+	//Smoothed GPU time, the raw timings are noisy
+	double average_ms = 0.0;
+
+public:
+	struct Stats
+	{
+		float scale;
+		double last_gpu_ms;
+		double average_gpu_ms;
+		double target_ms;
+		uint64_t frames_sampled;
+		uint64_t increases;
+		uint64_t decreases;
+	};
+
+	bool enabled = true;
+
+	//GPU time to fit each frame in, 0 takes budget_fraction of the runtime's display period
+	double target_ms = 0.0;
+
+	//Fraction of the display period the GPU may use when target_ms is 0
+	double budget_fraction = 0.85;
+
+	//Render scale bounds, relative to the recommended image size of each view
+	float min_scale = 0.5f;
+	float max_scale = 1.0f;
+
+	//Frames over budget before shrinking, and under grow_threshold of the budget before growing
+	int shrink_frames = 2;
+	int grow_frames = 45;
+	double grow_threshold = 0.75;
+
+	//Largest scale change a single shrink or grow step may make
+	float max_shrink_step = 0.1f;
+	float grow_step = 0.02f;
+
+	Stats stats = { 1.0f, 0.0, 0.0, 0.0, 0, 0, 0 };
+
+	/*
+	 update:     Feed in a finished frame's GPU time and pick the next scale
+	 inputs:     The frame's GPU time and the runtime's display period, both in milliseconds
+	 returns:    The render scale to use from now on
+	*/
+	float update(double gpu_ms, double display_period_ms);
+
+	//The scale to render at right now, 1 when disabled
+	float getScale();
+
+	//The scale swapchains are allocated at, so every scale up to max_scale fits without reallocating
+	float getAllocationScale();
+};
+
+#endif
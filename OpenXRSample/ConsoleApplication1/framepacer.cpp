@@ -0,0 +1,131 @@
+#include "framepacer.hpp"
+#include <stdio.h>
+
+bool FramePacer::start(XrSession session)
+{
+	if (this->running)
+	{
+		return true;
+	}
+
+	this->session = session;
+	this->failed = false;
+	this->published_frame = 0;
+	this->ended_frame = 0;
+	this->acquired_frame = 0;
+	this->running = true;
+
+	this->thread = std::thread(&FramePacer::pacingLoop, this);
+
+	HANDLE handle = (HANDLE)this->thread.native_handle();
+	if (!SetThreadPriority(handle, this->thread_priority))
+	{
+		printf("Unable to set frame pacing thread priority\n");
+	}
+	if (this->affinity_mask != 0 && SetThreadAffinityMask(handle, this->affinity_mask) == 0)
+	{
+		printf("Unable to set frame pacing thread affinity\n");
+	}
+	return true;
+}
+
+void FramePacer::stop()
+{
+	this->publish(this->running, false);
+	if (this->thread.joinable())
+	{
+		this->thread.join();
+	}
+}
+
+bool FramePacer::isRunning()
+{
+	return this->running;
+}
+
+void FramePacer::pacingLoop()
+{
+	uint64_t frame = 0;
+	while (this->running)
+	{
+		XrFrameWaitInfo frame_wait_info;
+		frame_wait_info.type = XR_TYPE_FRAME_WAIT_INFO;
+		frame_wait_info.next = XR_NULL_HANDLE;
+
+		XrFrameState frame_state;
+		frame_state.type = XR_TYPE_FRAME_STATE;
+		frame_state.next = XR_NULL_HANDLE;
+
+		//Blocks until the runtime wants the next frame, this overlaps the render thread submitting the current one
+		int64_t phase_start = FrameTelemetry::now();
+		if (xrWaitFrame(this->session, &frame_wait_info, &frame_state) != XR_SUCCESS)
+		{
+			printf("Unable to get Frame State\n");
+			this->publish(this->failed, true);
+			break;
+		}
+		if (this->telemetry != NULL)
+		{
+			this->telemetry->record(PHASE_WAIT_FRAME, frame, phase_start);
+		}
+
+		//Beginning a frame before the previous one ends would discard it, sleep until frameEnded says it has
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->changed.wait(lock, [&]() { return !this->running || this->ended_frame.load(std::memory_order_acquire) >= frame; });
+		}
+		if (!this->running)
+		{
+			break;
+		}
+
+		XrFrameBeginInfo frame_begin_info;
+		frame_begin_info.type = XR_TYPE_FRAME_BEGIN_INFO;
+		frame_begin_info.next = XR_NULL_HANDLE;
+
+		phase_start = FrameTelemetry::now();
+		if (xrBeginFrame(this->session, &frame_begin_info) != XR_SUCCESS)
+		{
+			printf("Couldn't begin frame\n");
+			this->publish(this->failed, true);
+			break;
+		}
+		if (this->telemetry != NULL)
+		{
+			this->telemetry->record(PHASE_BEGIN_FRAME, frame, phase_start);
+		}
+
+		//The render thread has ended frame - 1, so it is done with the slot frame - 2 used
+		frame++;
+		this->frame_states[frame % 2] = frame_state;
+		this->publish(this->published_frame, frame);
+	}
+}
+
+bool FramePacer::acquireFrame(XrFrameState* frame_state)
+{
+	//Sleeps until the pacing thread has waited on and begun the next frame
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->changed.wait(lock, [&]() { return this->published_frame.load(std::memory_order_acquire) > this->acquired_frame || !this->running || this->failed; });
+	}
+	if (this->published_frame.load(std::memory_order_acquire) <= this->acquired_frame)
+	{
+		return false;
+	}
+
+	//Frames are begun one at a time, so the next published frame is always acquired_frame + 1
+	this->acquired_frame++;
+	*frame_state = this->frame_states[this->acquired_frame % 2];
+	return true;
+}
+
+void FramePacer::frameEnded()
+{
+	this->publish(this->ended_frame, this->acquired_frame);
+}
+
+FramePacer::~FramePacer()
+{
+	stop();
+}
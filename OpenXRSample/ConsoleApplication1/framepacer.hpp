@@ -0,0 +1,106 @@
+#pragma once
+#ifndef FRAMEPACER_HPP
+#define FRAMEPACER_HPP
+
+#include <windows.h>
+
+#include <openxr/openxr.h>
+
+#include "frametelemetry.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+ Runs xrWaitFrame and xrBeginFrame on their own thread so the wait for frame N+1 overlaps
+ the rendering and submission of frame N. The render thread picks up each begun frame
+ through a double buffered handoff and reports back once it has called xrEndFrame. Both
+ threads sleep on a condition variable while waiting on the other, so neither holds a core.
+*/
+class FramePacer
+{
+private:
+	XrSession session = XR_NULL_HANDLE;
+
+	std::thread thread;
+
+	std::atomic<bool> running{ false };
+
+	//Set when xrWaitFrame or xrBeginFrame fails, the render thread stops on it
+	std::atomic<bool> failed{ false };
+
+	//Frame states of the last two begun frames, indexed by frame number
+	XrFrameState frame_states[2];
+
+	//Number of the last frame begun and published by the pacing thread
+	std::atomic<uint64_t> published_frame{ 0 };
+
+	//Number of the last frame the render thread has ended
+	std::atomic<uint64_t> ended_frame{ 0 };
+
+	//Number of the last frame the render thread picked up, only touched by the render thread
+	uint64_t acquired_frame = 0;
+
+	//Held while changing running, failed, published_frame or ended_frame, changed is notified after each change
+	std::mutex mutex;
+	std::condition_variable changed;
+
+	//Set a flag or counter under the mutex and wake whichever thread is waiting on it
+	template <typename T, typename V>
+	void publish(std::atomic<T>& target, V value)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			target.store(value, std::memory_order_release);
+		}
+		this->changed.notify_all();
+	}
+
+	void pacingLoop();
+
+public:
+	//Win32 priority of the pacing thread, eg THREAD_PRIORITY_HIGHEST
+	int thread_priority = THREAD_PRIORITY_HIGHEST;
+
+	//Cores the pacing thread may run on, 0 leaves it to the scheduler
+	DWORD_PTR affinity_mask = 0;
+
+	//Where the pacing thread records its xrWaitFrame and xrBeginFrame timings, NULL to not record them
+	FrameTelemetry* telemetry = NULL;
+
+	/*
+	 start:      Start pacing frames for a running session
+	 inputs:     The session to pace, it must already be begun
+	 returns:    false if the thread couldn't be started
+	*/
+	bool start(XrSession session);
+
+	/*
+	 stop:       Stop the pacing thread and wait for it to exit
+	 inputs:     None
+	 returns:    None
+	*/
+	void stop();
+
+	/*
+	 acquireFrame:   Wait for the next frame that has been waited on and begun
+	 inputs:         Frame state to fill in
+	 returns:        false if pacing stopped or failed
+	*/
+	bool acquireFrame(XrFrameState* frame_state);
+
+	/*
+	 frameEnded: Tell the pacing thread xrEndFrame was called, letting it begin the next frame
+	 inputs:     None
+	 returns:    None
+	*/
+	void frameEnded();
+
+	bool isRunning();
+
+	~FramePacer();
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "frametelemetry.hpp"
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+namespace
+{
+	//Small stable ids for the trace's thread lanes, assigned the first time a thread records
+	std::atomic<uint32_t> next_thread_id{ 0 };
+	thread_local uint32_t thread_id = UINT32_MAX;
+
+	uint32_t getThreadId()
+	{
+		if (thread_id == UINT32_MAX)
+		{
+			thread_id = next_thread_id.fetch_add(1, std::memory_order_relaxed);
+		}
+		return thread_id;
+	}
+}
+
+FrameTelemetry::FrameTelemetry()
+{
+	this->scratch.resize(CAPACITY);
+	this->snapshot_events.resize(CAPACITY);
+}
+
+int64_t FrameTelemetry::now()
+{
+	//steady_clock is QueryPerformanceCounter on windows
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FrameTelemetry::record(FramePhase phase, uint64_t frame, int64_t start_ns, int view)
+{
+	if (!this->enabled)
+	{
+		return;
+	}
+	int64_t end_ns = now();
+
+	uint64_t index = this->write_index.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = this->slots[index % CAPACITY];
+
+	//Readers that see the odd sequence, or a changed one after copying, throw the slot away
+	slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.event.frame = frame;
+	slot.event.start_ns = start_ns;
+	slot.event.duration_ns = end_ns - start_ns;
+	slot.event.thread = getThreadId();
+	slot.event.phase = (int16_t)phase;
+	slot.event.view = (int16_t)view;
+
+	slot.sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+uint32_t FrameTelemetry::snapshot(Event* events)
+{
+	uint64_t end = this->write_index.load(std::memory_order_acquire);
+	uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+
+	uint32_t count = 0;
+	for (uint64_t index = begin; index < end; index++)
+	{
+		Slot& slot = this->slots[index % CAPACITY];
+		uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if (sequence != index * 2 + 2)
+		{
+			//Still being written, or already overwritten by a newer record
+			continue;
+		}
+		Event event = slot.event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+		{
+			continue;
+		}
+		events[count] = event;
+		count++;
+	}
+	return count;
+}
+
+bool FrameTelemetry::getPercentiles(FramePhase phase, Percentiles* percentiles)
+{
+	uint32_t count = snapshot(this->snapshot_events.data());
+
+	uint32_t samples = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (this->snapshot_events[i].phase == phase)
+		{
+			this->scratch[samples] = this->snapshot_events[i].duration_ns;
+			samples++;
+		}
+	}
+	if (samples == 0)
+	{
+		return false;
+	}
+
+	std::sort(this->scratch.begin(), this->scratch.begin() + samples);
+
+	//Nearest rank
+	uint32_t p50 = (samples * 50 + 99) / 100;
+	uint32_t p95 = (samples * 95 + 99) / 100;
+	uint32_t p99 = (samples * 99 + 99) / 100;
+	percentiles->p50_ms = this->scratch[p50 - 1] / 1000000.0;
+	percentiles->p95_ms = this->scratch[p95 - 1] / 1000000.0;
+	percentiles->p99_ms = this->scratch[p99 - 1] / 1000000.0;
+	percentiles->samples = samples;
+	return true;
+}
+
+void FrameTelemetry::printPercentiles()
+{
+	for (int phase = 0; phase < PHASE_COUNT; phase++)
+	{
+		Percentiles percentiles;
+		if (getPercentiles((FramePhase)phase, &percentiles))
+		{
+			printf("%-16s p50 %7.3fms  p95 %7.3fms  p99 %7.3fms  (%u samples)\n", getPhaseName((FramePhase)phase), percentiles.p50_ms, percentiles.p95_ms, percentiles.p99_ms, percentiles.samples);
+		}
+	}
+}
+
+bool FrameTelemetry::exportChromeTrace(const char* file_path)
+{
+	uint32_t count = snapshot(this->snapshot_events.data());
+
+	std::ofstream file(file_path);
+	if (!file.is_open())
+	{
+		printf("Unable to open %s for the frame trace\n", file_path);
+		return false;
+	}
+
+	//Timestamps are relative to the oldest record so they stay readable in the viewer
+	int64_t origin_ns = count > 0 ? this->snapshot_events[0].start_ns : 0;
+	for (uint32_t i = 1; i < count; i++)
+	{
+		if (this->snapshot_events[i].start_ns < origin_ns)
+		{
+			origin_ns = this->snapshot_events[i].start_ns;
+		}
+	}
+
+	char line[256];
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const Event& event = this->snapshot_events[i];
+		snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu,\"view\":%d}}",
+			i == 0 ? "" : ",\n",
+			getPhaseName((FramePhase)event.phase),
+			event.thread,
+			(event.start_ns - origin_ns) / 1000.0,
+			event.duration_ns / 1000.0,
+			(unsigned long long)event.frame,
+			(int)event.view);
+		file << line;
+	}
+	file << "\n]}\n";
+
+	if (!file.good())
+	{
+		printf("Unable to write the frame trace to %s\n", file_path);
+		return false;
+	}
+	return true;
+}
+
+const char* FrameTelemetry::getPhaseName(FramePhase phase)
+{
+	switch (phase)
+	{
+	case(PHASE_CHECK_EVENTS):
+		return "checkEvents";
+	case(PHASE_WAIT_FRAME):
+		return "xrWaitFrame";
+	case(PHASE_ACQUIRE_FRAME):
+		return "acquireFrame";
+	case(PHASE_JUST_IN_TIME):
+		return "justInTime";
+	case(PHASE_LOCATE_VIEWS):
+		return "xrLocateViews";
+	case(PHASE_BEGIN_FRAME):
+		return "xrBeginFrame";
+	case(PHASE_SCENE):
+		return "scene";
+	case(PHASE_ACQUIRE_IMAGE):
+		return "acquireImage";
+	case(PHASE_WAIT_IMAGE):
+		return "waitImage";
+	case(PHASE_RENDER):
+		return "render";
+	case(PHASE_RELEASE_IMAGE):
+		return "releaseImage";
+	case(PHASE_UI_LAYERS):
+		return "uiLayers";
+	case(PHASE_LATE_LATCH):
+		return "lateLatch";
+	case(PHASE_END_FRAME):
+		return "xrEndFrame";
+	case(PHASE_MIRROR):
+		return "mirror";
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+#ifndef FRAMETELEMETRY_HPP
+#define FRAMETELEMETRY_HPP
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+//Phases of a frame that get timed, per view phases are recorded once for each view
+enum FramePhase
+{
+	PHASE_CHECK_EVENTS,
+	PHASE_WAIT_FRAME,
+	PHASE_ACQUIRE_FRAME,
+	PHASE_JUST_IN_TIME,
+	PHASE_LOCATE_VIEWS,
+	PHASE_BEGIN_FRAME,
+	PHASE_SCENE,
+	PHASE_ACQUIRE_IMAGE,
+	PHASE_WAIT_IMAGE,
+	PHASE_RENDER,
+	PHASE_RELEASE_IMAGE,
+	PHASE_UI_LAYERS,
+	PHASE_LATE_LATCH,
+	PHASE_END_FRAME,
+	PHASE_MIRROR,
+	PHASE_COUNT
+};
+
+/*
+ Records how long each phase of a frame takes into a fixed size ring, so the last few
+ thousand phases can be inspected in the field without attaching a profiler. Recording
+ is lock free and never allocates, any thread may record while another reads.
+*/
+class FrameTelemetry
+{
+public:
+	//Number of phase records kept, older ones are overwritten
+	static const uint32_t CAPACITY = 4096;
+
+	struct Event
+	{
+		uint64_t frame;
+		int64_t start_ns;
+		int64_t duration_ns;
+		uint32_t thread;
+		int16_t phase;
+		//View the phase was for, -1 for phases covering the whole frame
+		int16_t view;
+	};
+
+	struct Percentiles
+	{
+		double p50_ms;
+		double p95_ms;
+		double p99_ms;
+		uint32_t samples;
+	};
+
+private:
+	//A slot's sequence is odd while it is being written and 2 * (index + 1) once record index is complete
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence{ 0 };
+		Event event;
+	};
+
+	Slot slots[CAPACITY];
+
+	//Total records ever started, the next one goes in slot write_index % CAPACITY
+	std::atomic<uint64_t> write_index{ 0 };
+
+	//Sort space for percentiles, sized once so reading doesn't allocate either
+	std::vector<int64_t> scratch;
+
+	//Copy out a consistent snapshot of the ring, oldest first, returns the number copied
+	uint32_t snapshot(Event* events);
+
+	std::vector<Event> snapshot_events;
+
+public:
+	bool enabled = true;
+
+	FrameTelemetry();
+
+	/*
+	 now:        Monotonic timestamp to start a phase with
+	 inputs:     None
+	 returns:    Nanoseconds since an arbitrary fixed point
+	*/
+	static int64_t now();
+
+	/*
+	 record:     Record a phase that started at start_ns and ends now
+	 inputs:     The phase, the frame it belongs to, the start timestamp from now() and the view or -1
+	 returns:    None
+	*/
+	void record(FramePhase phase, uint64_t frame, int64_t start_ns, int view = -1);
+
+	/*
+	 getPercentiles: Duration percentiles of a phase over the records still in the ring
+	 inputs:         The phase and where to write its percentiles
+	 returns:        false if there are no records of that phase
+	*/
+	bool getPercentiles(FramePhase phase, Percentiles* percentiles);
+
+	/*
+	 exportChromeTrace:  Write the records in the ring as Chrome trace event JSON, open it in chrome://tracing or Perfetto
+	 inputs:             File to write
+	 returns:            false if the file couldn't be written
+	*/
+	bool exportChromeTrace(const char* file_path);
+
+	//Print p50/p95/p99 for every phase
+	void printPercentiles();
+
+	static const char* getPhaseName(FramePhase phase);
+};
+
+#endif
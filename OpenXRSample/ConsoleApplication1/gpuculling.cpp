@@ -0,0 +1,239 @@
+#include "gpuculling.hpp"
+#include <stdio.h>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+	//Matches local_size_x in cull.csh
+	const GLuint GROUP_SIZE = 64;
+
+	const GLuint OBJECT_BINDING = 0;
+	const GLuint COMMAND_BINDING = 1;
+	const GLuint INSTANCE_BINDING = 2;
+}
+
+bool GpuCuller::init()
+{
+	if (!GLEW_ARB_compute_shader || !GLEW_ARB_shader_storage_buffer_object || !GLEW_ARB_draw_indirect || !GLEW_ARB_base_instance)
+	{
+		return false;
+	}
+
+	try
+	{
+		std::string defines = "#define MAX_FRUSTA " + std::to_string(FrustumCuller::MAX_FRUSTA) + "\n";
+		this->shader = Shader::createCompute("Shaders\\cull.csh", defines.c_str());
+	}
+	catch (std::runtime_error&)
+	{
+		return false;
+	}
+	GLuint program = this->shader->getProgram();
+	this->object_count_location = glGetUniformLocation(program, "object_count");
+	this->views_per_instance_location = glGetUniformLocation(program, "views_per_instance");
+	this->frustum_count_location = glGetUniformLocation(program, "frustum_count");
+	this->planes_location = glGetUniformLocation(program, "planes");
+
+	glGenBuffers(1, &this->object_buffer);
+	glGenBuffers(1, &this->command_buffer);
+	glGenBuffers(1, &this->instance_buffer);
+	return true;
+}
+
+void GpuCuller::destroy()
+{
+	if (this->object_buffer != 0)
+	{
+		glDeleteBuffers(1, &this->object_buffer);
+		glDeleteBuffers(1, &this->command_buffer);
+		glDeleteBuffers(1, &this->instance_buffer);
+		this->object_buffer = 0;
+		this->command_buffer = 0;
+		this->instance_buffer = 0;
+	}
+	this->capacity = 0;
+}
+
+void GpuCuller::fillObject(Scene* scene, uint32_t index)
+{
+	GpuObject& object = this->objects[index];
+	object.model = scene->model_matrices[index];
+	object.color = glm::vec4(scene->materials[scene->material_ids[index]].color, 1.0f);
+	object.bounds_min = scene->bounds[index].min;
+	object.mesh = scene->mesh_ids[index];
+	object.bounds_max = scene->bounds[index].max;
+	object.padding = 0;
+}
+
+void GpuCuller::update(Scene* scene)
+{
+	uint32_t count = scene->getCount();
+	if (scene->layout_version == this->layout_version && count == this->object_count)
+	{
+		//Only what moved, unless so much did that one upload of everything is cheaper
+		uint32_t moved_count = static_cast<uint32_t>(scene->moved.size());
+		if (moved_count == 0)
+		{
+			return;
+		}
+		for (uint32_t i = 0; i < moved_count; i++)
+		{
+			this->fillObject(scene, scene->moved[i]);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->object_buffer);
+		if (moved_count * 8 > count)
+		{
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GpuObject), this->objects.data());
+		}
+		else
+		{
+			for (uint32_t i = 0; i < moved_count; i++)
+			{
+				uint32_t index = scene->moved[i];
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, index * sizeof(GpuObject), sizeof(GpuObject), &this->objects[index]);
+			}
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return;
+	}
+
+	this->layout_version = scene->layout_version;
+	this->object_count = count;
+
+	this->objects.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		this->fillObject(scene, i);
+	}
+
+	//Give every mesh a run of the instance buffer big enough for all of its objects
+	uint32_t mesh_count = static_cast<uint32_t>(scene->meshes.size());
+	this->commands.resize(mesh_count);
+	for (uint32_t mesh = 0; mesh < mesh_count; mesh++)
+	{
+		this->commands[mesh].count = scene->meshes[mesh].geometry->getIndexCount();
+		this->commands[mesh].instance_count = 0;
+		this->commands[mesh].first_index = scene->meshes[mesh].geometry->getFirstIndex();
+		this->commands[mesh].base_vertex = 0;
+		this->commands[mesh].base_instance = 0;
+	}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		this->commands[scene->mesh_ids[i]].base_instance++;
+	}
+	GLuint first = 0;
+	for (uint32_t mesh = 0; mesh < mesh_count; mesh++)
+	{
+		GLuint mesh_objects = this->commands[mesh].base_instance;
+		this->commands[mesh].base_instance = first;
+		first += mesh_objects;
+	}
+
+	if (count > this->capacity)
+	{
+		this->capacity = count + count / 2;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->instance_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, this->capacity * sizeof(InstanceData), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->object_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, this->capacity * sizeof(GpuObject), nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->object_buffer);
+	if (count > 0)
+	{
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GpuObject), this->objects.data());
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->command_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, mesh_count * sizeof(DrawElementsCommand), this->commands.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCuller::cull(const CullFrustum* frusta, int frustum_count, GLuint views_per_instance)
+{
+	if (this->commands.empty())
+	{
+		return;
+	}
+
+	//Back to no instances, the shader counts them up again
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->command_buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, this->commands.size() * sizeof(DrawElementsCommand), this->commands.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	GLfloat planes[FrustumCuller::MAX_FRUSTA * CullFrustum::PLANE_COUNT * 4];
+	for (int f = 0; f < frustum_count; f++)
+	{
+		for (int plane = 0; plane < CullFrustum::PLANE_COUNT; plane++)
+		{
+			GLfloat* equation = &planes[(f * CullFrustum::PLANE_COUNT + plane) * 4];
+			equation[0] = frusta[f].normal_x[plane];
+			equation[1] = frusta[f].normal_y[plane];
+			equation[2] = frusta[f].normal_z[plane];
+			equation[3] = frusta[f].offset[plane];
+		}
+	}
+
+	glUseProgram(this->shader->getProgram());
+	glUniform1ui(this->object_count_location, this->object_count);
+	glUniform1ui(this->views_per_instance_location, views_per_instance);
+	glUniform1i(this->frustum_count_location, frustum_count);
+	if (frustum_count > 0)
+	{
+		glUniform4fv(this->planes_location, frustum_count * CullFrustum::PLANE_COUNT, planes);
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, this->object_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, this->command_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, this->instance_buffer);
+	glDispatchCompute((this->object_count + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+	//The draws read the counts as commands and the instances as vertex attributes
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GpuCuller::draw(Scene* scene, GLuint views_per_instance)
+{
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->command_buffer);
+	uint32_t mesh_count = static_cast<uint32_t>(this->commands.size());
+	for (uint32_t mesh = 0; mesh < mesh_count; mesh++)
+	{
+		//The command's base instance offsets the attributes to the mesh's run
+		Mesh* geometry = scene->meshes[mesh].geometry;
+		geometry->setInstanceAttributes(this->instance_buffer, 0, views_per_instance);
+		geometry->drawGeometryIndirect(mesh * sizeof(DrawElementsCommand));
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+bool GpuCuller::verify(Scene* scene, const uint32_t* visible, uint32_t visible_count, GLuint views_per_instance)
+{
+	uint32_t mesh_count = static_cast<uint32_t>(this->commands.size());
+	this->expected.assign(mesh_count, 0);
+	for (uint32_t i = 0; i < visible_count; i++)
+	{
+		this->expected[scene->mesh_ids[visible[i]]]++;
+	}
+
+	this->readback.resize(mesh_count);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->command_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mesh_count * sizeof(DrawElementsCommand), this->readback.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	bool match = true;
+	for (uint32_t mesh = 0; mesh < mesh_count; mesh++)
+	{
+		GLuint gpu_count = this->readback[mesh].instance_count / views_per_instance;
+		if (gpu_count != this->expected[mesh])
+		{
+			printf("GPU culling kept %u objects of mesh %u, CPU culling kept %u\n", gpu_count, mesh, this->expected[mesh]);
+			match = false;
+		}
+	}
+
+	this->stats.verified_frames++;
+	if (!match)
+	{
+		this->stats.mismatched_frames++;
+	}
+	return match;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#ifndef GPUCULLING_HPP
+#define GPUCULLING_HPP
+
+#include "GL/glew.h"
+#include "glm.hpp"
+#include "scene.hpp"
+#include "shader.hpp"
+#include "culling.hpp"
+#include "instancebuffer.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+//An object as the cull shader reads it, std430 layout
+struct GpuObject
+{
+	glm::mat4 model;
+	glm::vec4 color;
+	glm::vec3 bounds_min;
+	uint32_t mesh;
+	glm::vec3 bounds_max;
+	uint32_t padding;
+};
+
+//Layout glDrawElementsIndirect reads
+struct DrawElementsCommand
+{
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+};
+
+/*
+ Culls and compacts the scene on the GPU. Every object lives in a storage buffer that is only
+ written when objects move, and each frame a compute shader tests every object against the
+ frusta and appends the visible ones to their mesh's run in the instance buffer, counting them
+ into that mesh's indirect draw command. The CPU never learns what is visible, so its cost
+ per frame is a dispatch and one indirect draw per mesh whatever the object count.
+*/
+class GpuCuller
+{
+private:
+	Shader* shader = nullptr;
+
+	GLint object_count_location = -1;
+	GLint views_per_instance_location = -1;
+	GLint frustum_count_location = -1;
+	GLint planes_location = -1;
+
+	GLuint object_buffer = 0;
+	GLuint command_buffer = 0;
+	GLuint instance_buffer = 0;
+
+	//Objects the buffers have room for
+	uint32_t capacity = 0;
+
+	uint32_t object_count = 0;
+
+	//Scene::layout_version the object buffer was filled from
+	uint64_t layout_version = UINT64_MAX;
+
+	//Copy of the object buffer, so moved objects can be written without rebuilding the rest
+	std::vector<GpuObject> objects;
+
+	//Indexed by mesh id, instance_count is reset to 0 every frame
+	std::vector<DrawElementsCommand> commands;
+
+	//Read back for verification
+	std::vector<DrawElementsCommand> readback;
+	std::vector<uint32_t> expected;
+
+	void fillObject(Scene* scene, uint32_t index);
+
+public:
+	struct {
+		uint64_t verified_frames = 0;
+		uint64_t mismatched_frames = 0;
+	} stats;
+
+	/*
+	 init:       Check for compute shaders, storage buffers and indirect draws with a base instance, and build the cull shader
+	 inputs:     None
+	 returns:    false if any of them are missing, the caller should keep culling on the CPU
+	*/
+	bool init();
+
+	void destroy();
+
+	/*
+	 update:     Refill the object buffer if objects were added or removed, otherwise write just the moved objects
+	 inputs:     The scene, after Scene::update
+	 returns:    None
+	*/
+	void update(Scene* scene);
+
+	/*
+	 cull:       Reset the draw commands and run the cull shader over every object
+	 inputs:     The frusta to test against, their count, 0 to keep everything, and the instances each object is drawn with
+	 returns:    None
+	*/
+	void cull(const CullFrustum* frusta, int frustum_count, GLuint views_per_instance);
+
+	/*
+	 draw:       One indirect draw per mesh, with a program built with INSTANCED_OBJECTS already bound
+	 inputs:     The scene and the instances each object is drawn with, the same as given to cull
+	 returns:    None
+	*/
+	void draw(Scene* scene, GLuint views_per_instance);
+
+	/*
+	 verify:     Read the draw commands back and compare each mesh's instance count with a CPU cull, stalls on the GPU
+	 inputs:     The scene, the CPU cull's visible objects and their count, and the instances each object is drawn with
+	 returns:    false if any mesh's count differs
+	*/
+	bool verify(Scene* scene, const uint32_t* visible, uint32_t visible_count, GLuint views_per_instance);
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "gputimer.hpp"
+
+bool GpuTimer::init()
+{
+	if (!GLEW_ARB_timer_query && !GLEW_VERSION_3_3)
+	{
+		return false;
+	}
+
+	glGenQueries(FRAME_LATENCY * (MAX_PASSES + 1) * 2, &this->queries[0][0][0]);
+	for (int i = 0; i < FRAME_LATENCY; i++)
+	{
+		this->pending[i] = false;
+		for (int pass = 0; pass < MAX_PASSES; pass++)
+		{
+			this->pass_pending[i][pass] = false;
+		}
+	}
+	this->initialized = true;
+	return true;
+}
+
+void GpuTimer::destroy()
+{
+	if (this->initialized)
+	{
+		glDeleteQueries(FRAME_LATENCY * (MAX_PASSES + 1) * 2, &this->queries[0][0][0]);
+		this->initialized = false;
+	}
+}
+
+int GpuTimer::addPass(const char* name)
+{
+	if (this->pass_count == MAX_PASSES)
+	{
+		return -1;
+	}
+	this->pass_names[this->pass_count] = name;
+	this->pass_count++;
+	return this->pass_count - 1;
+}
+
+const char* GpuTimer::getPassName(int pass)
+{
+	return this->pass_names[pass];
+}
+
+int GpuTimer::getPassCount()
+{
+	return this->pass_count;
+}
+
+uint64_t GpuTimer::getFrame()
+{
+	return this->frame;
+}
+
+void GpuTimer::beginFrame()
+{
+	int slot = this->frame % FRAME_LATENCY;
+
+	//The GPU is more than FRAME_LATENCY frames behind, skip timing rather than wait on it
+	this->timing = this->initialized && !this->pending[slot];
+	if (this->timing)
+	{
+		glQueryCounter(this->queries[slot][0][0], GL_TIMESTAMP);
+		for (int pass = 0; pass < MAX_PASSES; pass++)
+		{
+			this->pass_pending[slot][pass] = false;
+		}
+	}
+}
+
+void GpuTimer::endFrame()
+{
+	int slot = this->frame % FRAME_LATENCY;
+	if (this->timing)
+	{
+		glQueryCounter(this->queries[slot][0][1], GL_TIMESTAMP);
+		this->pending[slot] = true;
+	}
+	this->timing = false;
+	this->frame++;
+}
+
+void GpuTimer::beginPass(int pass)
+{
+	if (!this->timing || pass < 0)
+	{
+		return;
+	}
+	int slot = this->frame % FRAME_LATENCY;
+	glQueryCounter(this->queries[slot][pass + 1][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::endPass(int pass)
+{
+	if (!this->timing || pass < 0)
+	{
+		return;
+	}
+	int slot = this->frame % FRAME_LATENCY;
+	glQueryCounter(this->queries[slot][pass + 1][1], GL_TIMESTAMP);
+	this->pass_pending[slot][pass] = true;
+}
+
+bool GpuTimer::collect(FrameTimes* times)
+{
+	bool found = false;
+
+	//Walk from the oldest frame in flight to the newest, stopping at the first one the GPU hasn't finished
+	for (uint64_t i = 0; i < FRAME_LATENCY; i++)
+	{
+		uint64_t slot_frame = this->frame + i;
+		int slot = slot_frame % FRAME_LATENCY;
+		if (!this->pending[slot])
+		{
+			continue;
+		}
+
+		//The frame's end timestamp is written after every pass in it, so once it is available they all are
+		GLint available = 0;
+		glGetQueryObjectiv(this->queries[slot][0][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			break;
+		}
+
+		GLuint64 begin_time = 0;
+		GLuint64 end_time = 0;
+		glGetQueryObjectui64v(this->queries[slot][0][0], GL_QUERY_RESULT, &begin_time);
+		glGetQueryObjectui64v(this->queries[slot][0][1], GL_QUERY_RESULT, &end_time);
+		times->frame = slot_frame - FRAME_LATENCY;
+		times->frame_ms = (end_time - begin_time) / 1000000.0;
+
+		for (int pass = 0; pass < MAX_PASSES; pass++)
+		{
+			times->pass_timed[pass] = this->pass_pending[slot][pass];
+			times->pass_ms[pass] = 0.0;
+			if (this->pass_pending[slot][pass])
+			{
+				glGetQueryObjectui64v(this->queries[slot][pass + 1][0], GL_QUERY_RESULT, &begin_time);
+				glGetQueryObjectui64v(this->queries[slot][pass + 1][1], GL_QUERY_RESULT, &end_time);
+				times->pass_ms[pass] = (end_time - begin_time) / 1000000.0;
+			}
+		}
+		this->pending[slot] = false;
+		found = true;
+	}
+	return found;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#ifndef GPUTIMER_HPP
+#define GPUTIMER_HPP
+
+#include "GL/glew.h"
+#include <stdint.h>
+
+/*
+ Measures GPU time per frame, and per named pass within it, with GL_TIMESTAMP queries kept
+ in a ring. Results are only read once the GPU reports them available so timing never stalls
+ the pipeline, they arrive a few frames after the frame they belong to.
+*/
+class GpuTimer
+{
+public:
+	//Frames that can be in flight before their queries are reused
+	static const int FRAME_LATENCY = 4;
+
+	//Named passes that can be timed inside a frame
+	static const int MAX_PASSES = 8;
+
+	//GPU timings of one finished frame
+	struct FrameTimes
+	{
+		//Which frame these are, counted by endFrame calls
+		uint64_t frame;
+		double frame_ms;
+		double pass_ms[MAX_PASSES];
+		//Whether each pass ran in that frame
+		bool pass_timed[MAX_PASSES];
+	};
+
+private:
+	//A begin and end timestamp query for the whole frame, then for each pass, per frame in the ring.
+	//Timestamps rather than GL_TIME_ELAPSED so passes can nest inside each other and the frame
+	GLuint queries[FRAME_LATENCY][MAX_PASSES + 1][2];
+
+	//Whether the frame in each slot was timed and still needs reading back
+	bool pending[FRAME_LATENCY];
+
+	//Which passes were timed in each slot's frame
+	bool pass_pending[FRAME_LATENCY][MAX_PASSES];
+
+	const char* pass_names[MAX_PASSES];
+
+	int pass_count = 0;
+
+	//Whether the current frame is being timed, frames are skipped if their slot is still busy
+	bool timing = false;
+
+	uint64_t frame = 0;
+
+	bool initialized = false;
+
+public:
+	/*
+	 init:       Create the query objects, needs a current GL context
+	 inputs:     None
+	 returns:    false if timer queries aren't supported
+	*/
+	bool init();
+
+	void destroy();
+
+	/*
+	 addPass:    Register a pass to time, do this before rendering starts
+	 inputs:     Name of the pass, the string has to outlive the timer
+	 returns:    Id of the pass, or -1 if MAX_PASSES are already registered
+	*/
+	int addPass(const char* name);
+
+	const char* getPassName(int pass);
+
+	int getPassCount();
+
+	/*
+	 getFrame:   Number of the frame being timed, the one FrameTimes::frame reports once it comes back
+	 inputs:     None
+	 returns:    The frame between beginFrame and endFrame, or the next one outside them
+	*/
+	uint64_t getFrame();
+
+	/*
+	 beginFrame: Mark the start of a frame's GPU work
+	 inputs:     None
+	 returns:    None
+	*/
+	void beginFrame();
+
+	/*
+	 endFrame:   Mark the end of a frame's GPU work
+	 inputs:     None
+	 returns:    None
+	*/
+	void endFrame();
+
+	/*
+	 beginPass:  Mark the start of a pass, each pass is timed once per frame between beginFrame and endFrame
+	 inputs:     Id from addPass, -1 is ignored
+	 returns:    None
+	*/
+	void beginPass(int pass);
+
+	/*
+	 endPass:    Mark the end of a pass
+	 inputs:     Id from addPass, -1 is ignored
+	 returns:    None
+	*/
+	void endPass(int pass);
+
+	/*
+	 collect:    Read back the newest finished frame without waiting on the GPU
+	 inputs:     Where to write that frame's timings
+	 returns:    false if no new frame has finished
+	*/
+	bool collect(FrameTimes* times);
+};
+
+#endif
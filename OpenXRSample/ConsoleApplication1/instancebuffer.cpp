@@ -0,0 +1,87 @@
+#include "instancebuffer.hpp"
+
+bool InstanceBuffer::init()
+{
+	glGenBuffers(1, &this->buffer);
+	return this->buffer != 0;
+}
+
+void InstanceBuffer::destroy()
+{
+	if (this->buffer != 0)
+	{
+		glDeleteBuffers(1, &this->buffer);
+		this->buffer = 0;
+	}
+	this->capacity = 0;
+}
+
+void InstanceBuffer::update(Scene* scene, const uint32_t* objects, uint32_t count)
+{
+	uint32_t mesh_count = static_cast<uint32_t>(scene->meshes.size());
+
+	//Counting sort by mesh, count each mesh's objects and give each its run
+	this->batches.resize(mesh_count);
+	this->cursors.resize(mesh_count);
+	for (uint32_t mesh = 0; mesh < mesh_count; mesh++)
+	{
+		this->batches[mesh].count = 0;
+	}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		this->batches[scene->mesh_ids[objects[i]]].count++;
+	}
+	uint32_t first = 0;
+	for (uint32_t mesh = 0; mesh < mesh_count; mesh++)
+	{
+		this->batches[mesh].first = first;
+		this->cursors[mesh] = first;
+		first += this->batches[mesh].count;
+	}
+
+	if (this->staging.size() < count)
+	{
+		this->staging.resize(count);
+	}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t object = objects[i];
+		InstanceData& instance = this->staging[this->cursors[scene->mesh_ids[object]]++];
+		instance.model = scene->model_matrices[object];
+		instance.color = glm::vec4(scene->materials[scene->material_ids[object]].color, 1.0f);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+	if (count > this->capacity)
+	{
+		//Grow with headroom so a slowly growing scene doesn't reallocate every frame
+		this->capacity = count + count / 2;
+	}
+	//Orphan last frame's storage, the driver hands back fresh memory instead of waiting for the GPU to finish reading it
+	glBufferData(GL_ARRAY_BUFFER, this->capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+	if (count > 0)
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), this->staging.data());
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::draw(Scene* scene, GLsizei views_per_instance)
+{
+	this->draw_calls = 0;
+	uint32_t mesh_count = static_cast<uint32_t>(this->batches.size());
+	for (uint32_t mesh = 0; mesh < mesh_count; mesh++)
+	{
+		const InstanceBatch& batch = this->batches[mesh];
+		if (batch.count == 0)
+		{
+			continue;
+		}
+
+		//Instanced stereo draws each object once per view, so the attributes only advance every views_per_instance instances
+		Mesh* geometry = scene->meshes[mesh].geometry;
+		geometry->setInstanceAttributes(this->buffer, batch.first * sizeof(InstanceData), views_per_instance);
+		geometry->drawGeometry(batch.count * views_per_instance);
+		this->draw_calls++;
+	}
+}
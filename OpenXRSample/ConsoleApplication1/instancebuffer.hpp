@@ -0,0 +1,72 @@
+#pragma once
+#ifndef INSTANCEBUFFER_HPP
+#define INSTANCEBUFFER_HPP
+
+#include "GL/glew.h"
+#include "glm.hpp"
+#include "scene.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+//What the vertex shader reads per object with INSTANCED_OBJECTS, see Mesh::setInstanceAttributes
+struct InstanceData
+{
+	glm::mat4 model;
+	glm::vec4 color;
+};
+
+//A run of instances in the buffer that all use the same mesh
+struct InstanceBatch
+{
+	uint32_t first;
+	uint32_t count;
+};
+
+/*
+ Per object data for the whole scene, grouped by mesh and uploaded once per frame into a
+ buffer read as instanced vertex attributes. Every pass of the frame then draws all the
+ objects sharing a mesh with a single instanced draw, instead of a uniform upload and a
+ draw per object.
+*/
+class InstanceBuffer
+{
+private:
+	GLuint buffer = 0;
+
+	//Objects the buffer has room for, it only grows
+	uint32_t capacity = 0;
+
+	//Instance data sorted by mesh, written here first so the upload is one sequential copy
+	std::vector<InstanceData> staging;
+
+	//Indexed by mesh id
+	std::vector<InstanceBatch> batches;
+
+	//Next free instance of each mesh while sorting
+	std::vector<uint32_t> cursors;
+
+public:
+	//Draw calls made by the last draw
+	uint32_t draw_calls = 0;
+
+	bool init();
+
+	void destroy();
+
+	/*
+	 update:     Sort the scene's visible objects by mesh and upload their model matrices and colors
+	 inputs:     The scene, after Scene::update, and the indices of the objects to draw
+	 returns:    None
+	*/
+	void update(Scene* scene, const uint32_t* objects, uint32_t count);
+
+	/*
+	 draw:       One instanced draw per mesh, with a program built with INSTANCED_OBJECTS already bound
+	 inputs:     The scene uploaded in update, and how many instances each object takes for instanced stereo
+	 returns:    None
+	*/
+	void draw(Scene* scene, GLsizei views_per_instance);
+};
+
+#endif
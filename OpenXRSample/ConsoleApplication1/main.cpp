@@ -1,6 +1,7 @@
 // Include standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -14,8 +15,10 @@
 
 //Local Class Includes
 #include "square.hpp"
+#include "scene.hpp"
 #include "shader.hpp"
 #include "xrprogram.hpp"
+#include "bench.hpp"
 
 // Timing Includes
 #include <chrono>
@@ -25,6 +28,19 @@
 
 #define PI 3.14159265
 
+//Content of the panel layer, the square seen from a fixed camera
+static void drawPanel(UiLayer* layer, void* user_data)
+{
+	Square* square = (Square*)user_data;
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)layer->width / (float)layer->height, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(4, 3, 3), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+
+	glClearColor(0.1f, 0.1f, 0.2f, 0.8f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	square->draw(projection * view);
+}
+
 class Program
 {
 private:
@@ -44,6 +60,11 @@ private:
 
 	Square* sqr;
 
+	//Imported with the mesh importer, absent unless one has been cooked
+	Mesh model;
+
+	Scene scene;
+
 	int width = 1024;
 
 	int height = 768;
@@ -58,12 +79,16 @@ private:
 
 	float verticle_angle = 0;
 
-	int fps = 60;
+	//Show the headset's left eye in the window instead of rendering the scene again with the desktop camera
+	bool mirror = true;
 
 	GLFWwindow* window;
 
 	XrProgram* xr_program;
 
+	//A small panel in front of the user, rendered once and left to the compositor
+	UiLayer panel;
+
 public:
 	bool init() 
 	{
@@ -75,7 +100,11 @@ public:
 			return false;
 		}
 
-		glfwWindowHint(GLFW_SAMPLES, 4);
+		//The mirror blits single sampled eye images into the window, which can't be done into a multisampled one
+		if (!this->mirror)
+		{
+			glfwWindowHint(GLFW_SAMPLES, 4);
+		}
 		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
@@ -133,10 +162,37 @@ public:
 		//XrProgram program("OpenXR Sample", this->window);
 
 		this->xr_program = new XrProgram("OpenXR Sample", this->window);
+
+		this->xr_program->mirror.enabled = this->mirror;
+		this->xr_program->mirror.view = MIRROR_VIEW_LEFT;
 		
 		this->xr_program->init();
 
-		this->xr_program->square = this->sqr;
+		//Dump frame phase timings on exit
+		this->xr_program->telemetry_trace_path = "frame_trace.json";
+
+		//One cube at the origin, its optimizer stats go out with the rest of the telemetry
+		if (this->xr_program->telemetry_trace_path != NULL)
+		{
+			this->sqr->printStats("Cube");
+		}
+		uint32_t cube = this->scene.addMesh(this->sqr, this->sqr->bounds);
+		uint32_t white = this->scene.addMaterial(glm::vec3(1.0f));
+		this->scene.add(cube, white, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+		if (this->model.load("Meshes\\model.xrmesh"))
+		{
+			uint32_t model_mesh = this->scene.addMesh(&this->model, this->model.bounds);
+			this->scene.add(model_mesh, white, glm::vec3(0.0f, 0.0f, -3.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+		}
+		this->xr_program->scene = &this->scene;
+
+		this->panel.shape = LAYER_SHAPE_QUAD;
+		this->panel.policy = LAYER_UPDATE_STATIC;
+		this->panel.pose = { {0, 0, 0, 1}, {0.6f, 0, -1.5f} };
+		this->panel.size = { 0.4f, 0.4f };
+		this->panel.render = drawPanel;
+		this->panel.user_data = this->sqr;
+		this->xr_program->addUiLayer(&this->panel);
 
 		//program.destroy();
 
@@ -145,27 +201,37 @@ public:
 
 	int main_loop() 
 	{
-		using clock = std::chrono::steady_clock;
-		
-		auto next_frame = clock::now();
-
 		do {
 			
-			//Calculate next frame time
-			next_frame += std::chrono::milliseconds(1000/this->fps);
-
-			checkKeys();
-			checkMouse();
+			//Nothing to render until the runtime is ready for frames, sleep on events instead of spinning
+			if (!this->xr_program->isSessionRunning())
+			{
+				if (!this->xr_program->XrMainFunction() || !this->xr_program->waitForEvents(1.0))
+				{
+					break;
+				}
+				continue;
+			}
 
-			drawThings();
+			//Blocks in xrWaitFrame, or on the pacing thread, so the runtime's display period paces the loop
 			bool result = this->xr_program->XrMainFunction();
 			if (!result) 
 			{
 				break;
 			}
-			
-			//Wait for next frame
-			std::this_thread::sleep_until(next_frame);
+
+			//Input and the desktop window get whatever the frame left before the next one is due
+			if (this->xr_program->getNonXrBudgetMs() > 0.0)
+			{
+				checkKeys();
+				checkMouse();
+
+				drawThings();
+			}
+			else
+			{
+				glfwPollEvents();
+			}
 		} // Check if the ESC key was pressed or the window was closed
 		while (glfwGetKey(this->window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
 			glfwWindowShouldClose(this->window) == 0);
@@ -178,6 +244,13 @@ public:
 
 	void drawThings()
 	{
+		//The XR frame fills and presents the window itself
+		if (this->mirror)
+		{
+			glfwPollEvents();
+			return;
+		}
+
 		// Clear the screen
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		
@@ -249,8 +322,21 @@ public:
 	}
 };
 
-int main(void) 
+int main(int argc, char** argv) 
 {
+	//-bench times the renderer's hot paths offscreen and exits, no headset needed
+	if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+	{
+		Bench bench;
+		if (!bench.init())
+		{
+			return 1;
+		}
+		bench.run();
+		bench.destroy();
+		return 0;
+	}
+
 	Program main_program;
 	main_program.init();
 	main_program.main_loop();
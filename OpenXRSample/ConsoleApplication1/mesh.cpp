@@ -0,0 +1,275 @@
+#include "mesh.hpp"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+
+namespace
+{
+	//Corners are merged only when every attribute matches bit for bit
+	struct VertexHash
+	{
+		size_t operator()(const MeshVertex& vertex) const
+		{
+			//FNV-1a over the bytes
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&vertex);
+			uint32_t hash = 2166136261u;
+			for (size_t i = 0; i < sizeof(MeshVertex); i++)
+			{
+				hash = (hash ^ bytes[i]) * 16777619u;
+			}
+			return hash;
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()(const MeshVertex& a, const MeshVertex& b) const
+		{
+			return memcmp(&a, &b, sizeof(MeshVertex)) == 0;
+		}
+	};
+
+	Aabb computeBounds(const std::vector<MeshVertex>& vertices)
+	{
+		if (vertices.empty())
+		{
+			return { glm::vec3(0.0f), glm::vec3(0.0f) };
+		}
+		Aabb bounds = { vertices[0].position, vertices[0].position };
+		for (size_t i = 1; i < vertices.size(); i++)
+		{
+			bounds.min = glm::min(bounds.min, vertices[i].position);
+			bounds.max = glm::max(bounds.max, vertices[i].position);
+		}
+		return bounds;
+	}
+}
+
+Mesh::~Mesh()
+{
+}
+
+void Mesh::setTriangles(const MeshVertex* corners, uint32_t corner_count)
+{
+	this->vertices.clear();
+	this->indices.resize(corner_count);
+
+	std::unordered_map<MeshVertex, uint32_t, VertexHash, VertexEqual> unique;
+	unique.reserve(corner_count);
+	for (uint32_t i = 0; i < corner_count; i++)
+	{
+		auto inserted = unique.insert({ corners[i], static_cast<uint32_t>(this->vertices.size()) });
+		if (inserted.second)
+		{
+			this->vertices.push_back(corners[i]);
+		}
+		this->indices[i] = inserted.first->second;
+	}
+	this->bounds = computeBounds(this->vertices);
+}
+
+void Mesh::setIndexed(const MeshVertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count)
+{
+	this->vertices.assign(vertices, vertices + vertex_count);
+	this->indices.assign(indices, indices + index_count);
+	this->bounds = computeBounds(this->vertices);
+}
+
+void Mesh::optimize(float overdraw_threshold)
+{
+	uint32_t vertex_count = static_cast<uint32_t>(this->vertices.size());
+	uint32_t index_count = static_cast<uint32_t>(this->indices.size());
+	this->stats.before = MeshOptimizer::analyzeVertexCache(this->indices.data(), index_count, vertex_count, MeshOptimizer::ANALYZE_CACHE_SIZE);
+
+	//Order matters, the overdraw pass keeps the cache order inside its clusters and the fetch pass follows the final index order
+	MeshOptimizer::optimizeVertexCache(this->indices.data(), index_count, vertex_count);
+	MeshOptimizer::optimizeOverdraw(this->indices.data(), index_count, this->vertices.data(), vertex_count, overdraw_threshold);
+	vertex_count = MeshOptimizer::optimizeVertexFetch(this->vertices.data(), vertex_count, this->indices.data(), index_count);
+	this->vertices.resize(vertex_count);
+
+	this->stats.after = MeshOptimizer::analyzeVertexCache(this->indices.data(), index_count, vertex_count, MeshOptimizer::ANALYZE_CACHE_SIZE);
+}
+
+bool Mesh::upload()
+{
+	if (this->vertices.empty() || this->indices.empty())
+	{
+		printf("Mesh has no triangles to upload\n");
+		return false;
+	}
+
+	//Buffers loaded from a file may be immutable, so always start from new ones
+	this->createBuffers();
+	glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(MeshVertex), this->vertices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, position));
+	glEnableVertexAttribArray(0);
+
+	//Half the index bandwidth whenever every vertex can be reached with 16 bits
+	if (this->vertices.size() <= 65536)
+	{
+		std::vector<uint16_t> narrow(this->indices.begin(), this->indices.end());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, narrow.size() * sizeof(uint16_t), narrow.data(), GL_STATIC_DRAW);
+		this->index_type = GL_UNSIGNED_SHORT;
+	}
+	else
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(uint32_t), this->indices.data(), GL_STATIC_DRAW);
+		this->index_type = GL_UNSIGNED_INT;
+	}
+	glBindVertexArray(0);
+
+	this->lods.clear();
+	this->first_index = 0;
+	this->index_count = static_cast<GLuint>(this->indices.size());
+	return true;
+}
+
+void Mesh::createBuffers()
+{
+	this->destroy();
+	glGenVertexArrays(1, &this->vao);
+	glGenBuffers(1, &this->vbo);
+	glGenBuffers(1, &this->ebo);
+
+	//The element buffer binding is part of the VAO, so it has to be bound after it
+	glBindVertexArray(this->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
+}
+
+bool Mesh::load(const char* path)
+{
+	MeshFile file;
+	if (!file.open(path))
+	{
+		return false;
+	}
+	const MeshFileHeader* header = file.header;
+	if (header->vertex_count == 0 || header->index_count == 0)
+	{
+		printf("Mesh file %s has no triangles\n", path);
+		return false;
+	}
+
+	//The sections go to the GL straight from the mapping, pages are read from disk as the driver copies them
+	this->createBuffers();
+	if (GLEW_ARB_buffer_storage)
+	{
+		glBufferStorage(GL_ARRAY_BUFFER, file.getVertexBytes(), file.getVertices(), 0);
+		glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, file.getIndexBytes(), file.getIndices(), 0);
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, file.getVertexBytes(), file.getVertices(), GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, file.getIndexBytes(), file.getIndices(), GL_STATIC_DRAW);
+	}
+	glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, position));
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+
+	this->vertices.clear();
+	this->indices.clear();
+	this->index_type = header->index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	this->bounds = { glm::vec3(header->bounds_min[0], header->bounds_min[1], header->bounds_min[2]),
+		glm::vec3(header->bounds_max[0], header->bounds_max[1], header->bounds_max[2]) };
+	this->lods.assign(file.getLods(), file.getLods() + header->lod_count);
+	this->first_index = 0;
+	this->index_count = header->index_count;
+	this->selectLod(0);
+
+	//Nothing points into the mapping any more, the GL has its own copy
+	file.close();
+	return true;
+}
+
+bool Mesh::save(const char* path)
+{
+	return MeshFile::write(path, this->vertices.data(), static_cast<uint32_t>(this->vertices.size()), this->indices.data(),
+		static_cast<uint32_t>(this->indices.size()), this->bounds.min, this->bounds.max, this->lods.data(), static_cast<uint32_t>(this->lods.size()));
+}
+
+void Mesh::selectLod(uint32_t lod)
+{
+	if (this->lods.empty())
+	{
+		return;
+	}
+	if (lod >= this->lods.size())
+	{
+		lod = static_cast<uint32_t>(this->lods.size() - 1);
+	}
+	this->first_index = this->lods[lod].first_index;
+	this->index_count = this->lods[lod].index_count;
+}
+
+void Mesh::destroy()
+{
+	if (this->vao != 0)
+	{
+		glDeleteVertexArrays(1, &this->vao);
+		glDeleteBuffers(1, &this->vbo);
+		glDeleteBuffers(1, &this->ebo);
+		this->vao = 0;
+		this->vbo = 0;
+		this->ebo = 0;
+	}
+	this->first_index = 0;
+	this->index_count = 0;
+}
+
+void Mesh::printStats(const char* name)
+{
+	printf("%s: %u vertices, %u triangles, %s indices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		name, static_cast<uint32_t>(this->vertices.size()), static_cast<uint32_t>(this->indices.size() / 3),
+		this->index_type == GL_UNSIGNED_SHORT ? "16 bit" : "32 bit",
+		this->stats.before.acmr, this->stats.after.acmr, this->stats.before.atvr, this->stats.after.atvr);
+}
+
+void Mesh::setInstanceAttributes(GLuint buffer, GLintptr offset, GLuint divisor)
+{
+	//Locations 1 to 4 are the model matrix columns and 5 the color, they stay part of the VAO
+	const GLsizei stride = 20 * sizeof(float);
+	glBindVertexArray(this->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (GLuint column = 0; column < 4; column++)
+	{
+		glVertexAttribPointer(1 + column, 4, GL_FLOAT, false, stride, (const void*)(offset + column * 4 * sizeof(float)));
+		glVertexAttribDivisor(1 + column, divisor);
+		glEnableVertexAttribArray(1 + column);
+	}
+	glVertexAttribPointer(5, 4, GL_FLOAT, false, stride, (const void*)(offset + 16 * sizeof(float)));
+	glVertexAttribDivisor(5, divisor);
+	glEnableVertexAttribArray(5);
+}
+
+void Mesh::drawGeometry(GLsizei instance_count)
+{
+	GLuint index_size = this->index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+	const void* first = (const void*)((uintptr_t)this->first_index * index_size);
+	glBindVertexArray(this->vao);
+	if (instance_count > 1)
+	{
+		glDrawElementsInstanced(GL_TRIANGLES, this->index_count, this->index_type, first, instance_count);
+	}
+	else
+	{
+		glDrawElements(GL_TRIANGLES, this->index_count, this->index_type, first);
+	}
+}
+
+void Mesh::drawGeometryIndirect(GLintptr command_offset)
+{
+	glBindVertexArray(this->vao);
+	glDrawElementsIndirect(GL_TRIANGLES, this->index_type, (const void*)command_offset);
+}
+
+GLuint Mesh::getIndexCount()
+{
+	return this->index_count;
+}
+
+GLuint Mesh::getFirstIndex()
+{
+	return this->first_index;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include "GL/glew.h"
+#include "glm.hpp"
+#include "meshoptimizer.hpp"
+#include "meshfile.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+//Axis aligned box, in the mesh's space for meshes and in world space for objects
+struct Aabb
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+/*
+ Indexed triangle list geometry. Built on the CPU from a plain list of triangle corners, with
+ identical corners merged into one vertex, then optimized once and uploaded to a VAO with
+ 16 bit indices whenever the vertex count allows, or loaded ready to draw from a mesh file.
+ Position is attribute 0, the per instance attributes set by setInstanceAttributes start at 1.
+*/
+class Mesh
+{
+protected:
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	GLuint ebo = 0;
+
+	GLenum index_type = GL_UNSIGNED_INT;
+
+	//Range of the index buffer the draws use, the selected LOD's
+	GLuint first_index = 0;
+	GLuint index_count = 0;
+
+	void createBuffers();
+
+public:
+	//Kept after upload for culling and picking, index i of indices refers to vertices. Empty for loaded meshes
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	//Bounds of the vertices in the mesh's own space
+	Aabb bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+
+	//Index ranges per level of detail, from a mesh file, empty if the mesh has one level
+	std::vector<MeshFileLod> lods;
+
+	//Vertex cache behaviour before and after optimize, simulated with MeshOptimizer::ANALYZE_CACHE_SIZE entries
+	struct {
+		VertexCacheStats before = { 0.0f, 0.0f, 0 };
+		VertexCacheStats after = { 0.0f, 0.0f, 0 };
+	} stats;
+
+	virtual ~Mesh();
+
+	/*
+	 setTriangles: Replace the geometry with a triangle list, merging corners that are identical in every attribute
+	 inputs:       Three corners per triangle and the number of corners
+	 returns:      None
+	*/
+	void setTriangles(const MeshVertex* corners, uint32_t corner_count);
+
+	/*
+	 setIndexed:   Replace the geometry with already indexed vertices
+	 inputs:       The vertices, their count, the indices and their count
+	 returns:      None
+	*/
+	void setIndexed(const MeshVertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count);
+
+	/*
+	 optimize:     Reorder for the vertex cache, then for overdraw, then for vertex fetch, and record the cache stats
+	 inputs:       How much ACMR the overdraw pass may give up, 1.05 allows 5%
+	 returns:      None
+	*/
+	void optimize(float overdraw_threshold = 1.05f);
+
+	/*
+	 upload:       Create or replace the GPU buffers from vertices and indices
+	 inputs:       None
+	 returns:      false if there is nothing to upload
+	*/
+	bool upload();
+
+	/*
+	 load:         Map a mesh file and create the GPU buffers straight from the mapping, nothing is parsed or copied on the CPU
+	 inputs:       Path to the file
+	 returns:      false if the file couldn't be opened or isn't a mesh file
+	*/
+	bool load(const char* path);
+
+	/*
+	 save:         Write vertices and indices to a mesh file, with lods as its LOD table
+	 inputs:       Path to the file
+	 returns:      false if the file couldn't be written
+	*/
+	bool save(const char* path);
+
+	/*
+	 selectLod:    Make draws use one level of detail's range of the indices
+	 inputs:       Index into lods, clamped to the last level
+	 returns:      None
+	*/
+	void selectLod(uint32_t lod);
+
+	void destroy();
+
+	void printStats(const char* name);
+
+	/*
+	 setInstanceAttributes:  Read per instance model matrices and colors out of a buffer of InstanceData
+	 inputs:                 The buffer, the byte offset of the first instance, and the instances each entry lasts for
+	 returns:                None
+	*/
+	void setInstanceAttributes(GLuint buffer, GLintptr offset, GLuint divisor);
+
+	/*
+	 drawGeometry:  Draw the mesh with whatever program and uniforms are already bound
+	 inputs:        Number of instances to draw
+	 returns:       None
+	*/
+	void drawGeometry(GLsizei instance_count = 1);
+
+	/*
+	 drawGeometryIndirect:   Draw the mesh with the counts in a command in the bound GL_DRAW_INDIRECT_BUFFER
+	 inputs:                 Byte offset of the DrawElementsIndirectCommand
+	 returns:                None
+	*/
+	void drawGeometryIndirect(GLintptr command_offset);
+
+	GLuint getIndexCount();
+	GLuint getFirstIndex();
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "meshfile.hpp"
+#include <windows.h>
+#include <stdio.h>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+	uint64_t alignUp(uint64_t offset)
+	{
+		return (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+	}
+
+	bool sectionInside(uint64_t offset, uint64_t bytes, uint64_t file_size)
+	{
+		return offset <= file_size && bytes <= file_size - offset;
+	}
+
+	template <typename T>
+	bool indicesBelow(const T* indices, uint32_t count, uint32_t vertex_count)
+	{
+		//Or'ing in the comparison keeps the loop branch free so it runs at memory speed
+		bool outside = false;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			outside |= indices[i] >= vertex_count;
+		}
+		return !outside;
+	}
+
+	bool indicesInRange(const uint8_t* indices, uint32_t index_size, uint32_t count, uint32_t vertex_count)
+	{
+		if (index_size == 2)
+		{
+			return indicesBelow((const uint16_t*)indices, count, vertex_count);
+		}
+		return indicesBelow((const uint32_t*)indices, count, vertex_count);
+	}
+}
+
+MeshFile::~MeshFile()
+{
+	this->close();
+}
+
+bool MeshFile::open(const char* path)
+{
+	this->close();
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("Couldn't open mesh file %s\n", path);
+		return false;
+	}
+	this->file = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || (uint64_t)file_size.QuadPart < sizeof(MeshFileHeader))
+	{
+		printf("Mesh file %s is too small\n", path);
+		this->close();
+		return false;
+	}
+	this->size = (uint64_t)file_size.QuadPart;
+
+	this->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (this->mapping == NULL)
+	{
+		printf("Couldn't map mesh file %s\n", path);
+		this->close();
+		return false;
+	}
+	this->data = (const uint8_t*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (this->data == nullptr)
+	{
+		printf("Couldn't map mesh file %s\n", path);
+		this->close();
+		return false;
+	}
+
+	const MeshFileHeader* header = (const MeshFileHeader*)this->data;
+	if (header->magic != MESH_FILE_MAGIC)
+	{
+		printf("%s is not a mesh file\n", path);
+		this->close();
+		return false;
+	}
+	if (header->version != MESH_FILE_VERSION || header->header_size != sizeof(MeshFileHeader) || header->vertex_stride != sizeof(MeshVertex))
+	{
+		printf("Mesh file %s is version %u, expected %u, it needs importing again\n", path, header->version, MESH_FILE_VERSION);
+		this->close();
+		return false;
+	}
+	if (header->index_size != 2 && header->index_size != 4)
+	{
+		printf("Mesh file %s has %u byte indices\n", path, header->index_size);
+		this->close();
+		return false;
+	}
+
+	//Sizes come from the counts so a damaged header can't point the GL at memory past the mapping
+	uint64_t vertex_bytes = (uint64_t)header->vertex_count * sizeof(MeshVertex);
+	uint64_t index_bytes = (uint64_t)header->index_count * header->index_size;
+	uint64_t lod_bytes = (uint64_t)header->lod_count * sizeof(MeshFileLod);
+	if (header->file_size != this->size || !sectionInside(header->vertex_offset, vertex_bytes, this->size) ||
+		!sectionInside(header->index_offset, index_bytes, this->size) || !sectionInside(header->lod_offset, lod_bytes, this->size) ||
+		header->vertex_offset % MESH_FILE_ALIGNMENT != 0 || header->index_offset % MESH_FILE_ALIGNMENT != 0)
+	{
+		printf("Mesh file %s is truncated or damaged\n", path);
+		this->close();
+		return false;
+	}
+
+	//Every draw is of whole triangles inside the index section, check each level too since the table is only a few entries
+	if (header->index_count % 3 != 0 || header->lod_offset % alignof(MeshFileLod) != 0)
+	{
+		printf("Mesh file %s is truncated or damaged\n", path);
+		this->close();
+		return false;
+	}
+	const MeshFileLod* lods = (const MeshFileLod*)(this->data + header->lod_offset);
+	for (uint32_t i = 0; i < header->lod_count; i++)
+	{
+		if (lods[i].index_count % 3 != 0 || (uint64_t)lods[i].first_index + lods[i].index_count > header->index_count)
+		{
+			printf("Mesh file %s has a damaged LOD %u\n", path, i);
+			this->close();
+			return false;
+		}
+	}
+
+	//An index past the vertices would have the GPU fetch outside the vertex buffer, one pass over them is the price of trusting nothing
+	if (!indicesInRange(this->data + header->index_offset, header->index_size, header->index_count, header->vertex_count))
+	{
+		printf("Mesh file %s has indices past its %u vertices\n", path, header->vertex_count);
+		this->close();
+		return false;
+	}
+
+	this->header = header;
+	return true;
+}
+
+void MeshFile::close()
+{
+	if (this->data != nullptr)
+	{
+		UnmapViewOfFile(this->data);
+		this->data = nullptr;
+	}
+	if (this->mapping != nullptr)
+	{
+		CloseHandle(this->mapping);
+		this->mapping = nullptr;
+	}
+	if (this->file != nullptr)
+	{
+		CloseHandle(this->file);
+		this->file = nullptr;
+	}
+	this->header = nullptr;
+	this->size = 0;
+}
+
+const MeshVertex* MeshFile::getVertices()
+{
+	return (const MeshVertex*)(this->data + this->header->vertex_offset);
+}
+
+const void* MeshFile::getIndices()
+{
+	return this->data + this->header->index_offset;
+}
+
+const MeshFileLod* MeshFile::getLods()
+{
+	return this->header->lod_count > 0 ? (const MeshFileLod*)(this->data + this->header->lod_offset) : nullptr;
+}
+
+uint64_t MeshFile::getVertexBytes()
+{
+	return (uint64_t)this->header->vertex_count * sizeof(MeshVertex);
+}
+
+uint64_t MeshFile::getIndexBytes()
+{
+	return (uint64_t)this->header->index_count * this->header->index_size;
+}
+
+bool MeshFile::write(const char* path, const MeshVertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count,
+	glm::vec3 bounds_min, glm::vec3 bounds_max, const MeshFileLod* lods, uint32_t lod_count)
+{
+	MeshFileHeader header = {};
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.header_size = sizeof(MeshFileHeader);
+	header.vertex_stride = sizeof(MeshVertex);
+	header.vertex_count = vertex_count;
+	header.index_size = vertex_count <= 65536 ? 2 : 4;
+	header.index_count = index_count;
+	header.lod_count = lod_count;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		header.bounds_min[axis] = bounds_min[axis];
+		header.bounds_max[axis] = bounds_max[axis];
+	}
+
+	//The LOD table is small and goes straight after the header, the big sections get their own pages
+	uint64_t lod_bytes = (uint64_t)lod_count * sizeof(MeshFileLod);
+	header.lod_offset = sizeof(MeshFileHeader);
+	header.vertex_offset = alignUp(header.lod_offset + lod_bytes);
+	header.index_offset = alignUp(header.vertex_offset + (uint64_t)vertex_count * sizeof(MeshVertex));
+	header.file_size = header.index_offset + (uint64_t)index_count * header.index_size;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		printf("Couldn't create mesh file %s\n", path);
+		return false;
+	}
+
+	static const char zeros[MESH_FILE_ALIGNMENT] = {};
+	file.write((const char*)&header, sizeof(MeshFileHeader));
+	file.write((const char*)lods, lod_bytes);
+	file.write(zeros, header.vertex_offset - (header.lod_offset + lod_bytes));
+	file.write((const char*)vertices, (uint64_t)vertex_count * sizeof(MeshVertex));
+	file.write(zeros, header.index_offset - (header.vertex_offset + (uint64_t)vertex_count * sizeof(MeshVertex)));
+	if (header.index_size == 2)
+	{
+		std::vector<uint16_t> narrow(indices, indices + index_count);
+		file.write((const char*)narrow.data(), narrow.size() * sizeof(uint16_t));
+	}
+	else
+	{
+		file.write((const char*)indices, (uint64_t)index_count * sizeof(uint32_t));
+	}
+
+	if (!file.good())
+	{
+		printf("Couldn't write mesh file %s\n", path);
+		return false;
+	}
+	return true;
+}
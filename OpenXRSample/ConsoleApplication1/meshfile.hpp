@@ -0,0 +1,98 @@
+#pragma once
+#ifndef MESHFILE_HPP
+#define MESHFILE_HPP
+
+#include "glm.hpp"
+#include "meshoptimizer.hpp"
+
+#include <stdint.h>
+
+//"XRMS" read as a little endian uint32_t
+static const uint32_t MESH_FILE_MAGIC = 0x534D5258;
+
+//Bumped whenever the header, the LOD entry or MeshVertex changes layout
+static const uint32_t MESH_FILE_VERSION = 1;
+
+//Sections start on page boundaries so each one is a run of whole pages of the mapping
+static const uint32_t MESH_FILE_ALIGNMENT = 4096;
+
+//A range of the index section drawn at and beyond a distance
+struct MeshFileLod
+{
+	uint32_t first_index;
+	uint32_t index_count;
+	//Camera distance in meters from which this level is used, 0 for the full detail level
+	float min_distance;
+	uint32_t padding;
+};
+
+/*
+ At the start of the file. Everything else is found through the offsets, which are from the
+ start of the file. The vertex section is vertex_count MeshVertex, the index section index_count
+ uint16_t or uint32_t as index_size says, and the LOD table lod_count MeshFileLod, absent if 0.
+*/
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t vertex_stride;
+	uint32_t vertex_count;
+	uint32_t index_size;
+	uint32_t index_count;
+	uint32_t lod_count;
+	float bounds_min[3];
+	float bounds_max[3];
+	uint64_t vertex_offset;
+	uint64_t index_offset;
+	uint64_t lod_offset;
+	uint64_t file_size;
+};
+static_assert(sizeof(MeshFileHeader) == 88, "MeshFileHeader layout is part of the file format");
+static_assert(sizeof(MeshVertex) == 48, "MeshVertex layout is part of the file format");
+
+/*
+ A mesh file mapped into memory. Nothing is copied on open, the sections are handed out as
+ pointers into the mapping, so loading costs what reading the pages costs. The only parsing is
+ one pass over the indices to check each against the vertex count, which reads the index pages
+ in ahead of the GL upload anyway. The pointers are valid until close.
+*/
+class MeshFile
+{
+private:
+	void* file = nullptr;
+	void* mapping = nullptr;
+	const uint8_t* data = nullptr;
+	uint64_t size = 0;
+
+public:
+	const MeshFileHeader* header = nullptr;
+
+	~MeshFile();
+
+	/*
+	 open:       Map a mesh file and check its header, that every section is inside the file, every LOD inside the indices and every index inside the vertices
+	 inputs:     Path to the file
+	 returns:    false if it can't be mapped or isn't a mesh file of this version
+	*/
+	bool open(const char* path);
+
+	void close();
+
+	const MeshVertex* getVertices();
+	const void* getIndices();
+	const MeshFileLod* getLods();
+
+	uint64_t getVertexBytes();
+	uint64_t getIndexBytes();
+
+	/*
+	 write:      Write a mesh file, with 16 bit indices when every vertex can be reached with them
+	 inputs:     The vertices and indices with their counts, the bounds of the vertices, and the LOD table and its length, which can be empty
+	 returns:    false if the file couldn't be written
+	*/
+	static bool write(const char* path, const MeshVertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count,
+		glm::vec3 bounds_min, glm::vec3 bounds_max, const MeshFileLod* lods, uint32_t lod_count);
+};
+
+#endif
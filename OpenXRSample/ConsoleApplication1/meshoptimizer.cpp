@@ -0,0 +1,324 @@
+#include "meshoptimizer.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+	//Forsyth's tuned constants
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	float vertexScore(int cache_position, uint32_t remaining_triangles)
+	{
+		if (remaining_triangles == 0)
+		{
+			//Nothing left to use it
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cache_position >= 0)
+		{
+			if (cache_position < 3)
+			{
+				//Used by the last triangle, fixed score so the next triangle doesn't just reuse the same edge every time
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else
+			{
+				float scaler = 1.0f / (MeshOptimizer::CACHE_SIZE - 3);
+				score = powf(1.0f - (cache_position - 3) * scaler, CACHE_DECAY_POWER);
+			}
+		}
+
+		//Vertices with few triangles left get finished off before they drop out of the cache
+		score += VALENCE_BOOST_SCALE * powf((float)remaining_triangles, -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	struct TriangleCluster
+	{
+		uint32_t first;
+		uint32_t count;
+		float sort_key;
+	};
+}
+
+void MeshOptimizer::optimizeVertexCache(uint32_t* indices, uint32_t index_count, uint32_t vertex_count)
+{
+	uint32_t triangle_count = index_count / 3;
+	if (triangle_count == 0)
+	{
+		return;
+	}
+
+	//Triangles using each vertex, a vertex's unemitted triangles are kept at the front of its list
+	std::vector<uint32_t> remaining(vertex_count, 0);
+	for (uint32_t i = 0; i < index_count; i++)
+	{
+		remaining[indices[i]]++;
+	}
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+	std::vector<uint32_t> adjacency(index_count);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (uint32_t i = 0; i < index_count; i++)
+	{
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int> cache_positions(vertex_count, -1);
+	std::vector<float> vertex_scores(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		vertex_scores[v] = vertexScore(-1, remaining[v]);
+	}
+	std::vector<float> triangle_scores(triangle_count);
+	for (uint32_t t = 0; t < triangle_count; t++)
+	{
+		triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+	}
+	std::vector<uint8_t> emitted(triangle_count, 0);
+	std::vector<uint32_t> output(index_count);
+
+	//Room for a whole triangle pushed in front of a full cache
+	uint32_t cache[CACHE_SIZE + 3];
+	uint32_t new_cache[CACHE_SIZE + 3];
+	uint32_t cache_count = 0;
+
+	int64_t best = -1;
+	uint32_t scan = 0;
+	for (uint32_t out = 0; out < triangle_count; out++)
+	{
+		//Nothing in the cache has triangles left, carry on with the next triangle in the original order
+		if (best < 0)
+		{
+			while (emitted[scan])
+			{
+				scan++;
+			}
+			best = scan;
+		}
+
+		uint32_t triangle = static_cast<uint32_t>(best);
+		const uint32_t* corners = &indices[triangle * 3];
+		memcpy(&output[out * 3], corners, 3 * sizeof(uint32_t));
+		emitted[triangle] = 1;
+
+		//Take the triangle out of its vertices' lists
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = corners[k];
+			uint32_t* list = &adjacency[offsets[v]];
+			for (uint32_t j = 0; j < remaining[v]; j++)
+			{
+				if (list[j] == triangle)
+				{
+					list[j] = list[remaining[v] - 1];
+					remaining[v]--;
+					break;
+				}
+			}
+		}
+
+		//The triangle's vertices move to the front of the cache, everything else shifts back
+		uint32_t new_count = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			bool present = false;
+			for (uint32_t c = 0; c < new_count; c++)
+			{
+				present = present || new_cache[c] == corners[k];
+			}
+			if (!present)
+			{
+				new_cache[new_count++] = corners[k];
+			}
+		}
+		for (uint32_t c = 0; c < cache_count; c++)
+		{
+			uint32_t v = cache[c];
+			if (v != corners[0] && v != corners[1] && v != corners[2])
+			{
+				new_cache[new_count++] = v;
+			}
+		}
+
+		//Rescore everything whose position changed, including the ones that just fell out
+		for (uint32_t c = 0; c < new_count; c++)
+		{
+			uint32_t v = new_cache[c];
+			cache_positions[v] = c < CACHE_SIZE ? static_cast<int>(c) : -1;
+			float score = vertexScore(cache_positions[v], remaining[v]);
+			float delta = score - vertex_scores[v];
+			vertex_scores[v] = score;
+			const uint32_t* list = &adjacency[offsets[v]];
+			for (uint32_t j = 0; j < remaining[v]; j++)
+			{
+				triangle_scores[list[j]] += delta;
+			}
+		}
+
+		//The next triangle is the best one touching the cache
+		best = -1;
+		float best_score = -1.0f;
+		cache_count = new_count < CACHE_SIZE ? new_count : CACHE_SIZE;
+		for (uint32_t c = 0; c < cache_count; c++)
+		{
+			uint32_t v = new_cache[c];
+			cache[c] = v;
+			const uint32_t* list = &adjacency[offsets[v]];
+			for (uint32_t j = 0; j < remaining[v]; j++)
+			{
+				if (triangle_scores[list[j]] > best_score)
+				{
+					best_score = triangle_scores[list[j]];
+					best = list[j];
+				}
+			}
+		}
+	}
+
+	memcpy(indices, output.data(), index_count * sizeof(uint32_t));
+}
+
+void MeshOptimizer::optimizeOverdraw(uint32_t* indices, uint32_t index_count, const MeshVertex* vertices, uint32_t vertex_count, float threshold)
+{
+	uint32_t triangle_count = index_count / 3;
+	if (triangle_count == 0)
+	{
+		return;
+	}
+	VertexCacheStats baseline = analyzeVertexCache(indices, index_count, vertex_count, ANALYZE_CACHE_SIZE);
+
+	//A triangle missing the cache on all three vertices starts a cluster, reordering clusters then barely touches the cache hits
+	std::vector<TriangleCluster> clusters;
+	std::vector<uint32_t> timestamps(vertex_count, 0);
+	uint32_t time = ANALYZE_CACHE_SIZE + 1;
+	for (uint32_t t = 0; t < triangle_count; t++)
+	{
+		int misses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = indices[t * 3 + k];
+			if (time - timestamps[v] > ANALYZE_CACHE_SIZE)
+			{
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		if (misses == 3 || clusters.empty())
+		{
+			clusters.push_back({ t, 0, 0.0f });
+		}
+		clusters.back().count++;
+	}
+
+	glm::vec3 mesh_centre(0.0f);
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		mesh_centre += vertices[v].position;
+	}
+	mesh_centre /= (float)(vertex_count > 0 ? vertex_count : 1);
+
+	//Clusters far out along their own facing are likely to hide the rest, so they go first
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		TriangleCluster& cluster = clusters[c];
+		glm::vec3 centre(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		for (uint32_t t = cluster.first; t < cluster.first + cluster.count; t++)
+		{
+			glm::vec3 a = vertices[indices[t * 3]].position;
+			glm::vec3 b = vertices[indices[t * 3 + 1]].position;
+			glm::vec3 c2 = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 cross = glm::cross(b - a, c2 - a);
+			float triangle_area = glm::length(cross);
+			centre += (a + b + c2) * (triangle_area / 3.0f);
+			normal += cross;
+			area += triangle_area;
+		}
+		float normal_length = glm::length(normal);
+		if (area > 0.0f && normal_length > 0.0f)
+		{
+			cluster.sort_key = glm::dot(centre / area - mesh_centre, normal / normal_length);
+		}
+	}
+
+	std::vector<TriangleCluster> sorted(clusters);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const TriangleCluster& a, const TriangleCluster& b)
+		{
+			return a.sort_key > b.sort_key;
+		});
+
+	std::vector<uint32_t> output;
+	output.reserve(index_count);
+	for (size_t c = 0; c < sorted.size(); c++)
+	{
+		output.insert(output.end(), indices + sorted[c].first * 3, indices + (sorted[c].first + sorted[c].count) * 3);
+	}
+
+	//Keep the cache order if reordering costs more vertex work than allowed
+	VertexCacheStats reordered = analyzeVertexCache(output.data(), index_count, vertex_count, ANALYZE_CACHE_SIZE);
+	if (reordered.acmr <= baseline.acmr * threshold)
+	{
+		memcpy(indices, output.data(), index_count * sizeof(uint32_t));
+	}
+}
+
+uint32_t MeshOptimizer::optimizeVertexFetch(MeshVertex* vertices, uint32_t vertex_count, uint32_t* indices, uint32_t index_count)
+{
+	std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < index_count; i++)
+	{
+		uint32_t& target = remap[indices[i]];
+		if (target == UINT32_MAX)
+		{
+			target = next++;
+		}
+		indices[i] = target;
+	}
+
+	std::vector<MeshVertex> original(vertices, vertices + vertex_count);
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		if (remap[v] != UINT32_MAX)
+		{
+			vertices[remap[v]] = original[v];
+		}
+	}
+	return next;
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const uint32_t* indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size)
+{
+	VertexCacheStats stats = { 0.0f, 0.0f, 0 };
+
+	//A vertex is still cached if fewer than cache_size vertices were transformed since it was
+	std::vector<uint32_t> timestamps(vertex_count, 0);
+	uint32_t time = cache_size + 1;
+	for (uint32_t i = 0; i < index_count; i++)
+	{
+		uint32_t v = indices[i];
+		if (time - timestamps[v] > cache_size)
+		{
+			timestamps[v] = time++;
+			stats.transformed++;
+		}
+	}
+
+	uint32_t triangle_count = index_count / 3;
+	stats.acmr = triangle_count > 0 ? (float)stats.transformed / triangle_count : 0.0f;
+	stats.atvr = vertex_count > 0 ? (float)stats.transformed / vertex_count : 0.0f;
+	return stats;
+}
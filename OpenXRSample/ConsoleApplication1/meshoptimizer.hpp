@@ -0,0 +1,71 @@
+#pragma once
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include "glm.hpp"
+
+#include <stdint.h>
+
+struct MeshVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 uv;
+	//xyz along increasing u, w the sign of the bitangent
+	glm::vec4 tangent;
+};
+
+//How often a post transform vertex cache of a given size misses
+struct VertexCacheStats
+{
+	//Vertex shader runs per triangle, 0.5 is the best a regular grid can do and 3 means no reuse at all
+	float acmr;
+	//Vertex shader runs per vertex, 1 means every vertex is transformed exactly once
+	float atvr;
+	uint32_t transformed;
+};
+
+/*
+ Build time reordering of indexed triangle lists so the GPU does less vertex work. Triangles are
+ ordered for the post transform vertex cache, then groups of them are ordered so outward facing
+ parts are drawn first, and finally the vertices are renumbered in the order they are first used.
+*/
+class MeshOptimizer
+{
+public:
+	//Cache the triangle order is optimized for, larger than any real cache since the score only depends on recency
+	static const int CACHE_SIZE = 32;
+
+	//FIFO size the statistics and the overdraw pass simulate, close to what desktop GPUs have
+	static const uint32_t ANALYZE_CACHE_SIZE = 16;
+
+	/*
+	 optimizeVertexCache: Reorder triangles so their vertices are still in the cache when they are reused, Forsyth's linear speed algorithm
+	 inputs:              The index list, rewritten in place, its length, and the number of vertices it indexes
+	 returns:             None
+	*/
+	static void optimizeVertexCache(uint32_t* indices, uint32_t index_count, uint32_t vertex_count);
+
+	/*
+	 optimizeOverdraw:    Split the cache ordered triangles into clusters where the cache empties and draw clusters facing away from the centre first
+	 inputs:              The index list, rewritten in place, its length, the vertices, and how much worse the ACMR is allowed to get, 1.05 allows 5%
+	 returns:             None
+	*/
+	static void optimizeOverdraw(uint32_t* indices, uint32_t index_count, const MeshVertex* vertices, uint32_t vertex_count, float threshold);
+
+	/*
+	 optimizeVertexFetch: Renumber vertices in the order the indices first use them so fetches walk memory forwards, unused vertices are dropped
+	 inputs:              The vertices and indices, both rewritten in place, and their counts
+	 returns:             The number of vertices left
+	*/
+	static uint32_t optimizeVertexFetch(MeshVertex* vertices, uint32_t vertex_count, uint32_t* indices, uint32_t index_count);
+
+	/*
+	 analyzeVertexCache:  Simulate a FIFO post transform cache over the index list
+	 inputs:              The index list, its length, the number of vertices and the cache size
+	 returns:             ACMR, ATVR and how many vertices were transformed
+	*/
+	static VertexCacheStats analyzeVertexCache(const uint32_t* indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size);
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "mirror.hpp"
+
+#include <chrono>
+
+namespace
+{
+	int64_t nowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+void DesktopMirror::init(GLFWwindow* window, int view_count)
+{
+	this->window = window;
+	this->view_count = view_count;
+
+	//A swap never waits for the monitor, so it can't hold up the XR frame loop
+	glfwSwapInterval(0);
+
+	glGenFramebuffers(1, &this->framebuffer);
+}
+
+void DesktopMirror::destroy()
+{
+	if (this->framebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &this->framebuffer);
+		this->framebuffer = 0;
+	}
+}
+
+bool DesktopMirror::beginFrame()
+{
+	this->presenting = false;
+	if (!this->enabled || this->framebuffer == 0)
+	{
+		return false;
+	}
+
+	int64_t now = nowNs();
+	if (now - this->last_present_ns < (int64_t)(this->present_interval * 1000000000.0))
+	{
+		return false;
+	}
+
+	glfwGetFramebufferSize(this->window, &this->window_width, &this->window_height);
+	if (this->window_width == 0 || this->window_height == 0)
+	{
+		//Minimized
+		return false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, this->window_width, this->window_height);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	this->presenting = true;
+	return true;
+}
+
+void DesktopMirror::blitView(int view, GLuint texture, int layer, XrRect2Di rect)
+{
+	if (!this->presenting)
+	{
+		return;
+	}
+
+	//Pick this view's slot in the window, either all of it or its share of a side by side row
+	int slot = 0;
+	int slot_count = 1;
+	if (this->view == MIRROR_VIEW_BOTH)
+	{
+		slot = view;
+		slot_count = this->view_count;
+	}
+	else if ((this->view == MIRROR_VIEW_LEFT && view != 0) || (this->view == MIRROR_VIEW_RIGHT && view != 1))
+	{
+		return;
+	}
+
+	//Fit the view inside the slot keeping its aspect ratio
+	int slot_width = this->window_width / slot_count;
+	int dest_width = slot_width;
+	int dest_height = (int)((int64_t)slot_width * rect.extent.height / rect.extent.width);
+	if (dest_height > this->window_height)
+	{
+		dest_height = this->window_height;
+		dest_width = (int)((int64_t)this->window_height * rect.extent.width / rect.extent.height);
+	}
+	int dest_x = slot * slot_width + (slot_width - dest_width) / 2;
+	int dest_y = (this->window_height - dest_height) / 2;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffer);
+	if (layer < 0)
+	{
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	}
+	else
+	{
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+	}
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+	glBlitFramebuffer(rect.offset.x, rect.offset.y, rect.offset.x + rect.extent.width, rect.offset.y + rect.extent.height,
+		dest_x, dest_y, dest_x + dest_width, dest_y + dest_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DesktopMirror::present()
+{
+	if (!this->presenting)
+	{
+		return;
+	}
+	glfwSwapBuffers(this->window);
+	this->last_present_ns = nowNs();
+	this->presenting = false;
+}
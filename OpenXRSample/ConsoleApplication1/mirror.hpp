@@ -0,0 +1,82 @@
+#pragma once
+#ifndef MIRROR_HPP
+#define MIRROR_HPP
+
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+
+#include <openxr/openxr.h>
+
+#include <stdint.h>
+
+//Which of the rendered views the desktop window shows
+enum MirrorView
+{
+	MIRROR_VIEW_LEFT,
+	MIRROR_VIEW_RIGHT,
+	MIRROR_VIEW_BOTH	//Every view side by side
+};
+
+/*
+ Shows the eye images in the desktop window by blitting them out of the swapchain images
+ while they are still held, instead of rendering the scene again. It presents at its own
+ rate with vsync off, so swapping the window never blocks XR frame submission.
+*/
+class DesktopMirror
+{
+private:
+	GLFWwindow* window = nullptr;
+
+	//Read framebuffer the swapchain images are attached to one at a time
+	GLuint framebuffer = 0;
+
+	int view_count = 0;
+
+	//Whether this frame's images are being copied and presented
+	bool presenting = false;
+
+	int64_t last_present_ns = 0;
+
+	int window_width = 0;
+	int window_height = 0;
+
+public:
+	bool enabled = false;
+
+	MirrorView view = MIRROR_VIEW_LEFT;
+
+	//Seconds between presents, the window doesn't need the headset's refresh rate
+	double present_interval = 1.0 / 30.0;
+
+	/*
+	 init:       Turn off vsync on the window and create the read framebuffer
+	 inputs:     The window, its context has to be current, and the number of views rendered
+	 returns:    None
+	*/
+	void init(GLFWwindow* window, int view_count);
+
+	void destroy();
+
+	/*
+	 beginFrame: Decide whether this frame is mirrored and clear the window if it is
+	 inputs:     None
+	 returns:    true if blitView should be called for this frame's images
+	*/
+	bool beginFrame();
+
+	/*
+	 blitView:   Copy a view out of a swapchain image into its place in the window
+	 inputs:     The view, the swapchain image, its layer or -1 for a 2D image, and the part of the image the view was rendered to
+	 returns:    None
+	*/
+	void blitView(int view, GLuint texture, int layer, XrRect2Di rect);
+
+	/*
+	 present:    Swap the window if this frame was mirrored
+	 inputs:     None
+	 returns:    None
+	*/
+	void present();
+};
+
+#endif
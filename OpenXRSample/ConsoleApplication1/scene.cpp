@@ -0,0 +1,182 @@
+#include "scene.hpp"
+
+void Scene::reserve(uint32_t count)
+{
+	this->slot_objects.reserve(count);
+	this->slot_generations.reserve(count);
+	this->free_slots.reserve(count);
+	this->object_slots.reserve(count);
+	this->dirty.reserve(count);
+	this->positions.reserve(count);
+	this->rotations.reserve(count);
+	this->scales.reserve(count);
+	this->mesh_ids.reserve(count);
+	this->material_ids.reserve(count);
+	this->model_matrices.reserve(count);
+	this->bounds.reserve(count);
+	this->moved.reserve(count);
+}
+
+uint32_t Scene::addMesh(Mesh* geometry, Aabb bounds)
+{
+	this->meshes.push_back({ geometry, bounds });
+	return static_cast<uint32_t>(this->meshes.size() - 1);
+}
+
+uint32_t Scene::addMaterial(glm::vec3 color)
+{
+	this->materials.push_back({ color });
+	return static_cast<uint32_t>(this->materials.size() - 1);
+}
+
+SceneHandle Scene::add(uint32_t mesh, uint32_t material, glm::vec3 position, glm::quat rotation, glm::vec3 scale)
+{
+	uint32_t index = static_cast<uint32_t>(this->positions.size());
+
+	//Reuse a freed slot when there is one, its generation already moved on when it was freed
+	SceneHandle handle;
+	if (!this->free_slots.empty())
+	{
+		handle.slot = this->free_slots.back();
+		this->free_slots.pop_back();
+		this->slot_objects[handle.slot] = index;
+	}
+	else
+	{
+		handle.slot = static_cast<uint32_t>(this->slot_objects.size());
+		this->slot_objects.push_back(index);
+		this->slot_generations.push_back(0);
+	}
+	handle.generation = this->slot_generations[handle.slot];
+
+	this->object_slots.push_back(handle.slot);
+	this->dirty.push_back(1);
+	this->positions.push_back(position);
+	this->rotations.push_back(rotation);
+	this->scales.push_back(scale);
+	this->mesh_ids.push_back(mesh);
+	this->material_ids.push_back(material);
+	this->model_matrices.push_back(glm::mat4(1.0f));
+	this->bounds.push_back(this->meshes[mesh].bounds);
+	this->any_dirty = true;
+	this->layout_version++;
+
+	return handle;
+}
+
+bool Scene::remove(SceneHandle handle)
+{
+	uint32_t index;
+	if (!this->getIndex(handle, &index))
+	{
+		return false;
+	}
+
+	//Fill the gap with the last object so the arrays stay packed
+	uint32_t last = static_cast<uint32_t>(this->positions.size() - 1);
+	if (index != last)
+	{
+		this->object_slots[index] = this->object_slots[last];
+		this->dirty[index] = this->dirty[last];
+		this->positions[index] = this->positions[last];
+		this->rotations[index] = this->rotations[last];
+		this->scales[index] = this->scales[last];
+		this->mesh_ids[index] = this->mesh_ids[last];
+		this->material_ids[index] = this->material_ids[last];
+		this->model_matrices[index] = this->model_matrices[last];
+		this->bounds[index] = this->bounds[last];
+		this->slot_objects[this->object_slots[index]] = index;
+	}
+
+	this->object_slots.pop_back();
+	this->dirty.pop_back();
+	this->positions.pop_back();
+	this->rotations.pop_back();
+	this->scales.pop_back();
+	this->mesh_ids.pop_back();
+	this->material_ids.pop_back();
+	this->model_matrices.pop_back();
+	this->bounds.pop_back();
+
+	//Any copies of the handle are stale from here on
+	this->slot_generations[handle.slot]++;
+	this->free_slots.push_back(handle.slot);
+	this->layout_version++;
+	return true;
+}
+
+bool Scene::isValid(SceneHandle handle)
+{
+	return handle.slot < this->slot_generations.size() && this->slot_generations[handle.slot] == handle.generation;
+}
+
+bool Scene::getIndex(SceneHandle handle, uint32_t* index)
+{
+	if (!this->isValid(handle))
+	{
+		return false;
+	}
+	*index = this->slot_objects[handle.slot];
+	return true;
+}
+
+bool Scene::setTransform(SceneHandle handle, glm::vec3 position, glm::quat rotation, glm::vec3 scale)
+{
+	uint32_t index;
+	if (!this->getIndex(handle, &index))
+	{
+		return false;
+	}
+	this->positions[index] = position;
+	this->rotations[index] = rotation;
+	this->scales[index] = scale;
+	this->dirty[index] = 1;
+	this->any_dirty = true;
+	return true;
+}
+
+void Scene::update()
+{
+	this->moved.clear();
+	if (!this->any_dirty)
+	{
+		return;
+	}
+
+	uint32_t count = this->getCount();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (!this->dirty[i])
+		{
+			continue;
+		}
+
+		glm::mat4 rotation = glm::toMat4(this->rotations[i]);
+		glm::mat4 translation = glm::translate(glm::mat4(1.0f), this->positions[i]);
+		glm::mat4 scale = glm::scale(glm::mat4(1.0f), this->scales[i]);
+		glm::mat4 model = translation * rotation * scale;
+		this->model_matrices[i] = model;
+
+		//Move the mesh's box centre and take the extent of each world axis from the absolute rotation and scale
+		const Aabb& local = this->meshes[this->mesh_ids[i]].bounds;
+		glm::vec3 centre = (local.min + local.max) * 0.5f;
+		glm::vec3 extent = (local.max - local.min) * 0.5f;
+		glm::vec3 world_centre = glm::vec3(model * glm::vec4(centre, 1.0f));
+		glm::vec3 world_extent = glm::vec3(0.0f);
+		for (int column = 0; column < 3; column++)
+		{
+			world_extent += glm::abs(glm::vec3(model[column])) * extent[column];
+		}
+		this->bounds[i].min = world_centre - world_extent;
+		this->bounds[i].max = world_centre + world_extent;
+
+		this->dirty[i] = 0;
+		this->moved.push_back(i);
+	}
+	this->any_dirty = false;
+}
+
+uint32_t Scene::getCount()
+{
+	return static_cast<uint32_t>(this->positions.size());
+}
@@ -0,0 +1,125 @@
+#pragma once
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include "mesh.hpp"
+#include "glm.hpp"
+#include "gtx/quaternion.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+//Refers to one object for as long as it exists, removing other objects doesn't change it
+struct SceneHandle
+{
+	uint32_t slot = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+struct SceneMesh
+{
+	Mesh* geometry;
+	Aabb bounds;
+};
+
+struct SceneMaterial
+{
+	glm::vec3 color;
+};
+
+/*
+ Every object in the scene, stored as structure of arrays. Index i of each per object array
+ belongs to the same object and the arrays stay packed, so a pass over one attribute only
+ touches that attribute's memory. Objects are moved to fill the gap when one is removed,
+ handles go through a slot table to find wherever their object is now.
+*/
+class Scene
+{
+private:
+	//Per slot, the object it points at and a generation bumped every time the slot is freed
+	std::vector<uint32_t> slot_objects;
+	std::vector<uint32_t> slot_generations;
+	std::vector<uint32_t> free_slots;
+
+	//Per object, the slot pointing back at it so moving the object can fix the slot up
+	std::vector<uint32_t> object_slots;
+
+	//Per object, whether its transform changed since the last update
+	std::vector<uint8_t> dirty;
+	bool any_dirty = false;
+
+public:
+	std::vector<SceneMesh> meshes;
+	std::vector<SceneMaterial> materials;
+
+	//Per object
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<uint32_t> mesh_ids;
+	std::vector<uint32_t> material_ids;
+
+	//Per object, worked out from the transform in update
+	std::vector<glm::mat4> model_matrices;
+	std::vector<Aabb> bounds;
+
+	//Objects whose bounds the last update changed
+	std::vector<uint32_t> moved;
+
+	//Bumped whenever objects are added or removed, which changes what the indices refer to
+	uint64_t layout_version = 0;
+
+	//Allocate room for this many objects up front, so adding them doesn't reallocate mid frame
+	void reserve(uint32_t count);
+
+	/*
+	 addMesh:    Register geometry objects can be drawn with
+	 inputs:     The geometry and its bounds in its own space
+	 returns:    The mesh id to add objects with
+	*/
+	uint32_t addMesh(Mesh* geometry, Aabb bounds);
+
+	/*
+	 addMaterial: Register a material objects can be drawn with
+	 inputs:      The color the geometry's vertex colors are multiplied by
+	 returns:     The material id to add objects with
+	*/
+	uint32_t addMaterial(glm::vec3 color);
+
+	/*
+	 add:        Add an object to the end of the per object arrays
+	 inputs:     Its mesh and material ids and its transform
+	 returns:    The object's handle
+	*/
+	SceneHandle add(uint32_t mesh, uint32_t material, glm::vec3 position, glm::quat rotation, glm::vec3 scale);
+
+	/*
+	 remove:     Remove an object, the last object moves into its place
+	 inputs:     The object's handle
+	 returns:    false if the handle was already stale
+	*/
+	bool remove(SceneHandle handle);
+
+	bool isValid(SceneHandle handle);
+
+	/*
+	 getIndex:   Find an object in the per object arrays, the index changes when other objects are removed
+	 inputs:     The object's handle and where to put its index
+	 returns:    false if the handle is stale
+	*/
+	bool getIndex(SceneHandle handle, uint32_t* index);
+
+	//Move an object, its model matrix and bounds catch up on the next update
+	bool setTransform(SceneHandle handle, glm::vec3 position, glm::quat rotation, glm::vec3 scale);
+
+	/*
+	 update:     Rebuild the model matrices and world bounds of every object moved since the last update
+	 inputs:     None
+	 returns:    None
+	*/
+	void update();
+
+	uint32_t getCount();
+};
+
+#endif
@@ -3,6 +3,7 @@
 #include <iostream>
 #include "liststring.h"
 #include <vector>
+#include <cstring>
 
 Shader* Shader::default_shader = 0;
 
@@ -27,6 +28,97 @@ char* Shader::loadShaderText(const char* file_path)
 	return result;
 }
 
+char* Shader::insertDefines(char* shader_text, const char* defines)
+{
+	if (shader_text == NULL || defines == NULL)
+	{
+		return shader_text;
+	}
+
+	//#version has to stay the first line, so the defines go right after it
+	const char* version_end = strchr(shader_text, '\n');
+	size_t head_length = version_end != NULL ? (version_end - shader_text) + 1 : 0;
+	size_t text_length = strlen(shader_text);
+	size_t defines_length = strlen(defines);
+
+	char* result = (char*)malloc(text_length + defines_length + 1);
+	memcpy(result, shader_text, head_length);
+	memcpy(result + head_length, defines, defines_length);
+	memcpy(result + head_length + defines_length, shader_text + head_length, text_length - head_length + 1);
+	free(shader_text);
+	return result;
+}
+
+void Shader::compileProgram(const char* vert_path, const char* frag_path, const char* defines)
+{
+	GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+	GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+
+	char* vert_text = insertDefines(loadShaderText(vert_path), defines);
+	char* frag_text = insertDefines(loadShaderText(frag_path), defines);
+
+	if (!compileShader(vertex_shader_id, vert_text))
+	{
+		free(vert_text);
+		free(frag_text);
+		throw::std::runtime_error("Unable to generate Vertex Shader");
+	}
+
+	if (!compileShader(fragment_shader_id, frag_text))
+	{
+		free(vert_text);
+		free(frag_text);
+		throw::std::runtime_error("Unable to generate Fragment Shader");
+	}
+
+	this->program_id = 0;
+	buildProgram(vertex_shader_id, fragment_shader_id);
+
+	free(vert_text);
+	free(frag_text);
+
+	if (this->program_id == 0)
+	{
+		throw::std::runtime_error("Unable to link Shader Program");
+	}
+}
+
+void Shader::compileComputeProgram(const char* compute_path, const char* defines)
+{
+	GLuint compute_shader_id = glCreateShader(GL_COMPUTE_SHADER);
+
+	char* compute_text = insertDefines(loadShaderText(compute_path), defines);
+
+	if (!compileShader(compute_shader_id, compute_text))
+	{
+		free(compute_text);
+		glDeleteShader(compute_shader_id);
+		throw::std::runtime_error("Unable to generate Compute Shader");
+	}
+	free(compute_text);
+
+	GLuint program = glCreateProgram();
+	GLint result = GL_FALSE;
+	glAttachShader(program, compute_shader_id);
+	glLinkProgram(program);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	if (result == GL_FALSE) {
+		int InfoLogLength;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+		glGetProgramInfoLog(program, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		printf("%s\n", &ProgramErrorMessage[0]);
+		glDeleteShader(compute_shader_id);
+		glDeleteProgram(program);
+		throw::std::runtime_error("Unable to link Compute Program");
+	}
+
+	glDetachShader(program, compute_shader_id);
+	glDeleteShader(compute_shader_id);
+	this->program_id = program;
+}
+
 bool Shader::compileShader(GLuint shader_id, const char* shader_text)
 {
 	GLint result = GL_FALSE;
@@ -86,52 +178,48 @@ GLuint Shader::getProgram()
 
 Shader::Shader(const char* vert_path, const char* frag_path, bool default_shader)
 {
-	GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
-	GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-	char* vert_text = loadShaderText(vert_path);
-	char* frag_text = loadShaderText(frag_path);
-
-	if (!compileShader(vertex_shader_id ,vert_text)) 
-	{
-		throw::std::runtime_error("Unable to generate Vertex Shader");
-	}
-
-	if (!compileShader(fragment_shader_id, frag_text))
-	{
-		throw::std::runtime_error("Unable to generate Vertex Shader");
-	}
-
-	buildProgram(vertex_shader_id, fragment_shader_id);
+	compileProgram(vert_path, frag_path, NULL);
 
 	if (default_shader) 
 	{
 		Shader::default_shader = this;
 	}
-	free(vert_text);
-	free(frag_text);
 }
 
 Shader::Shader(const char* vert_path, const char* frag_path)
 {
-	GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
-	GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+	compileProgram(vert_path, frag_path, NULL);
+}
 
-	char* vert_text = loadShaderText(vert_path);
-	char* frag_text = loadShaderText(frag_path);
+Shader::Shader(const char* vert_path, const char* frag_path, const char* defines)
+{
+	compileProgram(vert_path, frag_path, defines);
+}
 
-	if (!compileShader(vertex_shader_id, vert_text))
+Shader::Shader()
+{
+	this->program_id = 0;
+}
+
+Shader::~Shader()
+{
+	if (this->program_id != 0)
 	{
-		throw::std::runtime_error("Unable to generate Vertex Shader");
+		glDeleteProgram(this->program_id);
 	}
+}
 
-	if (!compileShader(fragment_shader_id, frag_text))
+Shader* Shader::createCompute(const char* compute_path, const char* defines)
+{
+	Shader* shader = new Shader();
+	try
 	{
-		throw::std::runtime_error("Unable to generate Vertex Shader");
+		shader->compileComputeProgram(compute_path, defines);
 	}
-
-	buildProgram(vertex_shader_id, fragment_shader_id);
-
-	free(vert_text);
-	free(frag_text);
+	catch (std::runtime_error&)
+	{
+		delete shader;
+		throw;
+	}
+	return shader;
 }
@@ -12,6 +12,15 @@ class Shader
 private:
 	static char* loadShaderText(const char* file_path);
 
+	//Insert preprocessor defines directly after the #version line of the shader text
+	static char* insertDefines(char* shader_text, const char* defines);
+
+	void compileProgram(const char* vert_path, const char* frag_path, const char* defines);
+
+	void compileComputeProgram(const char* compute_path, const char* defines);
+
+	Shader();
+
 	GLuint program_id;
 
 public: 
@@ -27,6 +36,15 @@ public:
 
 	Shader(const char* vert_path, const char* frag_path);
 
+	//Build a variant of the shaders with the given #define lines, eg "#define MULTIVIEW\n"
+	Shader(const char* vert_path, const char* frag_path, const char* defines);
+
+	//Build a compute program, needs GL 4.3 or ARB_compute_shader, throws like the constructors
+	static Shader* createCompute(const char* compute_path, const char* defines);
+
+	//Deletes the program, needs the context it was built on to be current
+	~Shader();
+
 };
 
 #endif 
\ No newline at end of file
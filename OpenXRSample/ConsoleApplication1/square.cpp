@@ -1,6 +1,44 @@
 #include "square.hpp"
 #include "GL/glew.h"
 
+const float Square::corners[108] = {-1.0f, -1.0f, -1.0f, // triangle 1 : begin
+    -1.0f, -1.0f, 1.0f,
+    -1.0f, 1.0f, 1.0f, // triangle 1 : end
+    1.0f, 1.0f, -1.0f, // triangle 2 : begin
+    -1.0f, -1.0f, -1.0f,
+    -1.0f, 1.0f, -1.0f, // triangle 2 : end
+    1.0f, -1.0f, 1.0f,
+    -1.0f, -1.0f, -1.0f,
+    1.0f, -1.0f, -1.0f,
+    1.0f, 1.0f, -1.0f,
+    1.0f, -1.0f, -1.0f,
+    -1.0f, -1.0f, -1.0f,
+    -1.0f, -1.0f, -1.0f,
+    -1.0f, 1.0f, 1.0f,
+    -1.0f, 1.0f, -1.0f,
+    1.0f, -1.0f, 1.0f,
+    -1.0f, -1.0f, 1.0f,
+    -1.0f, -1.0f, -1.0f,
+    -1.0f, 1.0f, 1.0f,
+    -1.0f, -1.0f, 1.0f,
+    1.0f, -1.0f, 1.0f,
+    1.0f, 1.0f, 1.0f,
+    1.0f, -1.0f, -1.0f,
+    1.0f, 1.0f, -1.0f,
+    1.0f, -1.0f, -1.0f,
+    1.0f, 1.0f, 1.0f,
+    1.0f, -1.0f, 1.0f,
+    1.0f, 1.0f, 1.0f,
+    1.0f, 1.0f, -1.0f,
+    -1.0f, 1.0f, -1.0f,
+    1.0f, 1.0f, 1.0f,
+    -1.0f, 1.0f, -1.0f,
+    -1.0f, 1.0f, 1.0f,
+    1.0f, 1.0f, 1.0f,
+    -1.0f, 1.0f, 1.0f,
+    1.0f, -1.0f, 1.0f
+};
+
 /*
     Constructor: Run when square is created
     inputs:     The shader program for this square
@@ -8,8 +46,7 @@
    */
 Square::Square(Shader* shader)
 {
-    initVAO();
-    initVBO();
+    initMesh();
     this->shader = shader;
     return;
 }
@@ -21,43 +58,34 @@ Square::Square(Shader* shader)
 */
 Square::Square()
 {
-    initVAO();
-    initVBO();
+    initMesh();
     
     this->shader = Shader::default_shader;
     GLuint program = this->shader->getProgram();
     this->mvp_location = glGetUniformLocation(program, "mvp");
-
-    //Create the model matrix
-    model_matrix = glm::mat4(1.0f);
-
-    glm::mat4 rot = glm::toMat4(this->rotation);
-    glm::mat4 trans = glm::translate(glm::mat4(1.0f), this->position);
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), this->scale);
-    model_matrix = trans * rot * scale;
-}
-
-void Square::initVBO()
-{
-    glGenBuffers(1, &(this->vbo));
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 }
 
 /*
- initVBO:    Initialize the Vertex Array Object
+ initMesh:   Build, optimize and upload the indexed cube
  inputs:     None
  returns:    None
 */
-void Square::initVAO()
+void Square::initMesh()
 {
-    glGenVertexArrays(1, &this->vao);
-    glBindVertexArray(this->vao);
+    //The 36 corners only have 8 distinct positions
+    MeshVertex cube[36] = {};
+    for (int i = 0; i < 36; i++)
+    {
+        cube[i].position = glm::vec3(corners[i * 3], corners[i * 3 + 1], corners[i * 3 + 2]);
+    }
+    setTriangles(cube, 36);
+    optimize();
+    upload();
 }
 
 
 /*
-    initVBO:    Draw the Square
+    draw:       Draw the Square
     inputs:     View Projection matrix for Camera
     returns:    None
    */
@@ -67,14 +95,10 @@ void Square::draw(glm::mat4 vp_matrix)
     /*Matrix4f mvp = new Matrix4f();
     vp_matrix.mul(model_matrix, mvp);
     */
-    glUniformMatrix4fv(mvp_location, 1, GL_FALSE, &vp_matrix[0][0]);
-    //Draw the Square
+    //Bind the program first, the uniform goes to whichever program is current
     uint32_t program = this->shader->getProgram();
     glUseProgram(program);
-    glBindVertexArray(this->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-    glVertexAttribPointer(0, 3, GL_FLOAT, false, 0, 0);
-    glEnableVertexAttribArray(0);
-    glDrawArrays(GL_TRIANGLES, 0, 12 * 3);
-    glDisableVertexAttribArray(0);
+    glUniformMatrix4fv(mvp_location, 1, GL_FALSE, &vp_matrix[0][0]);
+    //Draw the Square
+    drawGeometry();
 }
@@ -4,67 +4,30 @@
 
 
 #include "shader.hpp"
+#include "mesh.hpp"
 #include "glm.hpp"
 #include "gtx/quaternion.hpp"
 
-class Square
+class Square : public Mesh
 {
 private:
 
 	Shader* shader;
 	uint32_t program;
 
-    //Values needed for Model Matrix
-    glm::vec3 position = glm::vec3(0, 0, 0);
-    glm::quat rotation = glm::quat(0, 0, 0, 0);
-    glm::vec3 scale = glm::vec3(1, 1, 1);
-
-    glm::mat4 model_matrix = glm::mat4(1);
-
-    //Vertices to make up square, for this program not bothering with index buffer objects
-    const float vertices[108] = {-1.0f, -1.0f, -1.0f, // triangle 1 : begin
-        -1.0f, -1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f, // triangle 1 : end
-        1.0f, 1.0f, -1.0f, // triangle 2 : begin
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f, // triangle 2 : end
-        1.0f, -1.0f, 1.0f,
-        -1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, -1.0f,
-        1.0f, -1.0f, 1.0f,
-        -1.0f, -1.0f, 1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f
-    };
-
-    GLuint vao;
-    GLuint vbo;
+    //Corners of the cube's triangles, merged into an indexed Mesh on construction.
+    //Shared by every Square, objects' transforms live in the Scene
+    static const float corners[108];
 
     GLuint mvp_location;
 
+    /*
+     initMesh:   Build, optimize and upload the indexed cube
+     inputs:     None
+     returns:    None
+    */
+    void initMesh();
+
 public:
     /*
      Constructor: Run when square is created
@@ -75,22 +38,13 @@ public:
 
     Square();
 
-    void initVBO();
-
-    /*
-     initVBO:    Initialize the Vertex Array Object
-     inputs:     None
-     returns:    None
-    */
-    void initVAO();
-
 
     /*
-        initVBO:    Draw the Square
+        draw:       Draw the Square
         inputs:     View Projection matrix for Camera
         returns:    None
        */
     void draw(glm::mat4 vp_matrix);
 };
 
-#endif 
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "uilayer.hpp"
+#include <stdio.h>
+
+bool UiLayer::init(XrSession session, XrSpace space, int64_t format)
+{
+	XrSwapchainCreateInfo swapchain_create_info;
+	swapchain_create_info.type = XR_TYPE_SWAPCHAIN_CREATE_INFO;
+	swapchain_create_info.next = NULL;
+	//A static image can only be acquired once, the runtime can then keep it in whatever memory suits it best
+	swapchain_create_info.createFlags = this->policy == LAYER_UPDATE_STATIC ? XR_SWAPCHAIN_CREATE_STATIC_IMAGE_BIT : 0;
+	swapchain_create_info.usageFlags = XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT | XR_SWAPCHAIN_USAGE_SAMPLED_BIT;
+	swapchain_create_info.format = format;
+	swapchain_create_info.sampleCount = 1;
+	swapchain_create_info.width = this->width;
+	swapchain_create_info.height = this->height;
+	swapchain_create_info.faceCount = 1;
+	swapchain_create_info.arraySize = 1;
+	swapchain_create_info.mipCount = 1;
+
+	if (xrCreateSwapchain(session, &swapchain_create_info, &this->swapchain) != XR_SUCCESS)
+	{
+		printf("Unable to create layer swapchain\n");
+		return false;
+	}
+
+	uint32_t image_count = 0;
+	if (xrEnumerateSwapchainImages(this->swapchain, image_count, &image_count, NULL) != XR_SUCCESS)
+	{
+		return false;
+	}
+	this->images.resize(image_count, { XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR, nullptr });
+	if (xrEnumerateSwapchainImages(this->swapchain, image_count, &image_count, (XrSwapchainImageBaseHeader*)this->images.data()) != XR_SUCCESS)
+	{
+		return false;
+	}
+
+	this->framebuffers.resize(image_count);
+	glGenFramebuffers(image_count, this->framebuffers.data());
+	for (uint32_t i = 0; i < image_count; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->images[i].image, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			printf("Layer framebuffer %u incomplete\n", i);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return false;
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	XrSwapchainSubImage sub_image;
+	sub_image.swapchain = this->swapchain;
+	sub_image.imageRect = { {0, 0}, {this->width, this->height} };
+	sub_image.imageArrayIndex = 0;
+
+	//Render callbacks write straight alpha, without the unpremultiplied bit the compositor would brighten the edges
+	XrCompositionLayerFlags flags = this->alpha_blend ? XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT | XR_COMPOSITION_LAYER_UNPREMULTIPLIED_ALPHA_BIT : 0;
+
+	this->quad.type = XR_TYPE_COMPOSITION_LAYER_QUAD;
+	this->quad.next = NULL;
+	this->quad.layerFlags = flags;
+	this->quad.space = space;
+	this->quad.eyeVisibility = XR_EYE_VISIBILITY_BOTH;
+	this->quad.subImage = sub_image;
+
+	this->cylinder.type = XR_TYPE_COMPOSITION_LAYER_CYLINDER_KHR;
+	this->cylinder.next = NULL;
+	this->cylinder.layerFlags = flags;
+	this->cylinder.space = space;
+	this->cylinder.eyeVisibility = XR_EYE_VISIBILITY_BOTH;
+	this->cylinder.subImage = sub_image;
+
+	this->dirty = true;
+	this->has_content = false;
+	return true;
+}
+
+void UiLayer::destroy()
+{
+	if (!this->framebuffers.empty())
+	{
+		glDeleteFramebuffers(static_cast<GLsizei>(this->framebuffers.size()), this->framebuffers.data());
+		this->framebuffers.clear();
+	}
+	if (this->swapchain != XR_NULL_HANDLE)
+	{
+		xrDestroySwapchain(this->swapchain);
+		this->swapchain = XR_NULL_HANDLE;
+	}
+}
+
+void UiLayer::markDirty()
+{
+	this->dirty = true;
+}
+
+bool UiLayer::update(uint64_t frame)
+{
+	//Everything gets rendered once, after that it's down to the policy
+	bool render_now = !this->has_content;
+	if (!render_now && this->policy == LAYER_UPDATE_INTERVAL)
+	{
+		render_now = frame - this->last_update_frame >= this->update_interval;
+	}
+	else if (!render_now && this->policy == LAYER_UPDATE_DIRTY)
+	{
+		render_now = this->dirty;
+	}
+	if (!render_now)
+	{
+		return true;
+	}
+
+	XrSwapchainImageAcquireInfo acquire_info = { XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO, nullptr };
+	uint32_t index;
+	if (xrAcquireSwapchainImage(this->swapchain, &acquire_info, &index) != XR_SUCCESS)
+	{
+		printf("Unable to acquire layer swapchain image\n");
+		return false;
+	}
+
+	XrSwapchainImageWaitInfo wait_info = { XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO, nullptr, XR_INFINITE_DURATION };
+	if (xrWaitSwapchainImage(this->swapchain, &wait_info) != XR_SUCCESS)
+	{
+		printf("Unable to wait for layer swapchain image\n");
+		return false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[index]);
+	glViewport(0, 0, this->width, this->height);
+	if (this->render != nullptr)
+	{
+		this->render(this, this->user_data);
+	}
+	else
+	{
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	XrSwapchainImageReleaseInfo release_info = { XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO, nullptr };
+	if (xrReleaseSwapchainImage(this->swapchain, &release_info) != XR_SUCCESS)
+	{
+		printf("Unable to release layer swapchain image\n");
+		return false;
+	}
+
+	this->has_content = true;
+	this->dirty = false;
+	this->last_update_frame = frame;
+	return true;
+}
+
+XrCompositionLayerBaseHeader* UiLayer::getLayer()
+{
+	if (!this->has_content)
+	{
+		return nullptr;
+	}
+
+	//Placement can change every frame without re-rendering anything
+	if (this->shape == LAYER_SHAPE_CYLINDER)
+	{
+		this->cylinder.pose = this->pose;
+		this->cylinder.radius = this->radius;
+		this->cylinder.centralAngle = this->central_angle;
+		this->cylinder.aspectRatio = this->aspect_ratio;
+		return (XrCompositionLayerBaseHeader*)&this->cylinder;
+	}
+	this->quad.pose = this->pose;
+	this->quad.size = this->size;
+	return (XrCompositionLayerBaseHeader*)&this->quad;
+}
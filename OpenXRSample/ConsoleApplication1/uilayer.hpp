@@ -0,0 +1,122 @@
+#pragma once
+#ifndef UILAYER_HPP
+#define UILAYER_HPP
+
+#ifndef XR_USE_GRAPHICS_API_OPENGL
+#define XR_USE_GRAPHICS_API_OPENGL
+#endif
+#ifndef XR_USE_PLATFORM_WIN32
+#define XR_USE_PLATFORM_WIN32
+#endif
+
+#include <windows.h>
+
+#include "GL/glew.h"
+
+#include <openxr/openxr.h>
+#include <openxr/openxr_platform.h>
+
+#include <stdint.h>
+#include <vector>
+
+enum LayerShape
+{
+	LAYER_SHAPE_QUAD,		//A flat rectangle in the scene
+	LAYER_SHAPE_CYLINDER	//A section of a cylinder around a point, needs XR_KHR_composition_layer_cylinder
+};
+
+//When a layer's swapchain image is rendered again, the compositor resamples the last one every frame in between
+enum LayerUpdatePolicy
+{
+	LAYER_UPDATE_STATIC,	//Rendered once into a static swapchain image
+	LAYER_UPDATE_INTERVAL,	//Rendered every update_interval frames
+	LAYER_UPDATE_DIRTY		//Rendered on the frame after markDirty is called
+};
+
+class UiLayer;
+
+//Draws a layer's content, the layer's framebuffer and viewport are already bound
+typedef void (*UiLayerRenderFunction)(UiLayer* layer, void* user_data);
+
+/*
+ A quad or cylinder composition layer with its own swapchain, submitted after the projection
+ layer. Its content is only rendered when its update policy asks for it, so flat UI doesn't
+ get drawn into both eyes of the projection layer every frame.
+*/
+class UiLayer
+{
+private:
+	XrSwapchain swapchain = XR_NULL_HANDLE;
+
+	std::vector<XrSwapchainImageOpenGLKHR> images;
+
+	std::vector<GLuint> framebuffers;
+
+	//A layer can only be submitted once its swapchain has had an image released
+	bool has_content = false;
+
+	bool dirty = true;
+
+	uint64_t last_update_frame = 0;
+
+	XrCompositionLayerQuad quad;
+
+	XrCompositionLayerCylinderKHR cylinder;
+
+public:
+	LayerShape shape = LAYER_SHAPE_QUAD;
+
+	LayerUpdatePolicy policy = LAYER_UPDATE_DIRTY;
+
+	//Frames between renders with LAYER_UPDATE_INTERVAL
+	uint32_t update_interval = 10;
+
+	//Swapchain size in pixels
+	int32_t width = 512;
+	int32_t height = 512;
+
+	//Centre of a quad, or of the cylinder's axis, in the reference space
+	XrPosef pose = { {0, 0, 0, 1}, {0, 0, -1} };
+
+	//Quad size in meters
+	XrExtent2Df size = { 1.0f, 1.0f };
+
+	//Cylinder shape, the arc is radius * central_angle wide and that divided by aspect_ratio high
+	float radius = 1.0f;
+	float central_angle = 1.0f;
+	float aspect_ratio = 1.0f;
+
+	//Blend with the layers below using the image's alpha, taken as straight rather than premultiplied
+	bool alpha_blend = true;
+
+	UiLayerRenderFunction render = nullptr;
+	void* user_data = nullptr;
+
+	/*
+	 init:       Create the layer's swapchain and a framebuffer for each of its images
+	 inputs:     The session, the space the layer is placed in and the swapchain color format
+	 returns:    false if the swapchain couldn't be created
+	*/
+	bool init(XrSession session, XrSpace space, int64_t format);
+
+	void destroy();
+
+	//Ask for the content to be rendered again on the next frame, the other policies ignore it
+	void markDirty();
+
+	/*
+	 update:     Render the content into the next swapchain image if the update policy asks for it
+	 inputs:     The frame number
+	 returns:    false if the swapchain image couldn't be acquired or released
+	*/
+	bool update(uint64_t frame);
+
+	/*
+	 getLayer:   The composition layer to pass to xrEndFrame
+	 inputs:     None
+	 returns:    The layer, or nullptr if there is nothing to submit yet
+	*/
+	XrCompositionLayerBaseHeader* getLayer();
+};
+
+#endif
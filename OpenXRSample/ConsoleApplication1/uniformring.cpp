@@ -0,0 +1,104 @@
+#include "uniformring.hpp"
+#include <stdio.h>
+
+bool UniformRing::init(GLsizeiptr size, bool readable)
+{
+	if (!GLEW_ARB_buffer_storage)
+	{
+		return false;
+	}
+
+	//Every slot has to start on an offset glBindBufferRange accepts
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	this->slot_size = ((size + alignment - 1) / alignment) * alignment;
+
+	//Coherent, so writes land without flushing even while the GPU may be about to read them
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	if (readable)
+	{
+		flags |= GL_MAP_READ_BIT;
+	}
+	glGenBuffers(1, &this->buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+	glBufferStorage(GL_UNIFORM_BUFFER, this->slot_size * SLOT_COUNT, nullptr, flags);
+	this->mapped = (uint8_t*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, this->slot_size * SLOT_COUNT, flags);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	if (this->mapped == nullptr)
+	{
+		glDeleteBuffers(1, &this->buffer);
+		this->buffer = 0;
+		return false;
+	}
+	return true;
+}
+
+void UniformRing::destroy()
+{
+	for (int i = 0; i < SLOT_COUNT; i++)
+	{
+		if (this->fences[i] != nullptr)
+		{
+			glDeleteSync(this->fences[i]);
+			this->fences[i] = nullptr;
+		}
+	}
+	if (this->buffer != 0)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glDeleteBuffers(1, &this->buffer);
+		this->buffer = 0;
+		this->mapped = nullptr;
+	}
+}
+
+bool UniformRing::beginFrame()
+{
+	this->slot = this->frame % SLOT_COUNT;
+	this->frame++;
+
+	GLsync fence = this->fences[this->slot];
+	if (fence == nullptr)
+	{
+		return true;
+	}
+
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, this->fence_timeout);
+	if (result == GL_WAIT_FAILED || result == GL_TIMEOUT_EXPIRED)
+	{
+		printf("Timed out waiting on uniform ring slot %d\n", this->slot);
+		return false;
+	}
+
+	glDeleteSync(fence);
+	this->fences[this->slot] = nullptr;
+	return true;
+}
+
+void UniformRing::endFrame()
+{
+	this->fences[this->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void* UniformRing::getSlot()
+{
+	return this->mapped + this->slot * this->slot_size;
+}
+
+void UniformRing::copyInSlot(GLintptr read_offset, GLintptr write_offset, GLsizeiptr size)
+{
+	GLintptr slot_offset = this->slot * this->slot_size;
+	glBindBuffer(GL_COPY_READ_BUFFER, this->buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, slot_offset + read_offset, slot_offset + write_offset, size);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void UniformRing::bind(GLuint binding)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, this->buffer, this->slot * this->slot_size, this->slot_size);
+}
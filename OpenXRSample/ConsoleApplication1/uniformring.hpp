@@ -0,0 +1,83 @@
+#pragma once
+#ifndef UNIFORMRING_HPP
+#define UNIFORMRING_HPP
+
+#include "GL/glew.h"
+#include <stdint.h>
+
+/*
+ A uniform buffer split into one slot per frame in flight, persistently and coherently
+ mapped so the CPU can write a slot at any time, including after the draws reading it
+ have been submitted. Each slot is fenced when its frame is done with it and only
+ reused once the GPU has passed that fence.
+*/
+class UniformRing
+{
+public:
+	//Frames that can be in flight before a slot is reused
+	static const int SLOT_COUNT = 3;
+
+private:
+	GLuint buffer = 0;
+
+	//Size of each slot, rounded up to the uniform buffer offset alignment
+	GLsizeiptr slot_size = 0;
+
+	uint8_t* mapped = nullptr;
+
+	GLsync fences[SLOT_COUNT] = {};
+
+	int slot = 0;
+
+	uint64_t frame = 0;
+
+public:
+	//How long beginFrame waits for a slot to come free
+	GLuint64 fence_timeout = 1000000000;
+
+	/*
+	 init:       Create and map the buffer, needs ARB_buffer_storage
+	 inputs:     Bytes each frame needs, whether the CPU reads back what the GPU writes into a slot
+	 returns:    false if persistent mapping isn't supported
+	*/
+	bool init(GLsizeiptr size, bool readable = false);
+
+	void destroy();
+
+	/*
+	 beginFrame: Move to the next slot, waiting for the GPU to finish with it if it is still in use
+	 inputs:     None
+	 returns:    false if the GPU didn't release the slot in time
+	*/
+	bool beginFrame();
+
+	/*
+	 endFrame:   Fence the current slot after the last draw reading it
+	 inputs:     None
+	 returns:    None
+	*/
+	void endFrame();
+
+	/*
+	 getSlot:    Where to write the current frame's data, stays valid until the next beginFrame
+	 inputs:     None
+	 returns:    Pointer into the mapped buffer
+	*/
+	void* getSlot();
+
+	/*
+	 copyInSlot: Have the GPU copy bytes from one place in the current slot to another, in order with the commands around it
+	 inputs:     Offsets into the slot to copy from and to, bytes to copy
+	 returns:    None
+	*/
+	void copyInSlot(GLintptr read_offset, GLintptr write_offset, GLsizeiptr size);
+
+	/*
+	 bind:       Bind the current slot to a uniform block binding point
+	 inputs:     The binding point
+	 returns:    None
+	*/
+	void bind(GLuint binding);
+};
+
+#endif
@@ -3,6 +3,16 @@
 #define GLFW_EXPOSE_NATIVE_WGL
 #include "GLFW/glfw3native.h"
 #include <gtc/type_ptr.hpp>
+#include <mmsystem.h>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <thread>
+
+//Only in Windows 10 1803 SDKs and later, older systems fail the call and get the fallback
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
 
 XrProgram::XrProgram(const char* application_name, GLFWwindow* window) 
 {
@@ -24,6 +34,31 @@ bool XrProgram::init()
 	{
 		return false;
 	}
+
+	if (this->frame_timing.time_conversion_supported)
+	{
+		xrGetInstanceProcAddr(this->instance, "xrConvertTimeToWin32PerformanceCounterKHR", (PFN_xrVoidFunction*)&this->frame_timing.convert_time);
+	}
+	if (this->visibility_mask.supported)
+	{
+		xrGetInstanceProcAddr(this->instance, "xrGetVisibilityMaskKHR", (PFN_xrVoidFunction*)&this->visibility_mask.get_mask);
+	}
+	if (this->frame_timing.just_in_time && this->frame_timing.convert_time == nullptr)
+	{
+		printf("XR_KHR_win32_convert_performance_counter_time not supported, just in time frame starts disabled\n");
+		this->frame_timing.just_in_time = false;
+	}
+	if (this->frame_timing.just_in_time)
+	{
+		//sleep_for rounds up to the default 15.6 ms timer tick, longer than a whole frame at 90 Hz
+		this->frame_timing.wait_timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (this->frame_timing.wait_timer == NULL)
+		{
+			//Windows before 10 1803, a plain timer only fires on the system timer tick, so shorten the tick for the session
+			this->frame_timing.wait_timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+			this->frame_timing.raised_timer_period = timeBeginPeriod(1) == TIMERR_NOERROR;
+		}
+	}
 	if (!this->createReferenceSpace())
 	{
 		return false;
@@ -34,10 +69,31 @@ bool XrProgram::init()
 		return false;
 	}
 
-	if (!this->beginSession()) 
+	//The depth images are handed to the runtime, so the scene has to actually write them
+	glEnable(GL_DEPTH_TEST);
+
+	if (!this->gpu_timer.init() && this->dynamic_resolution.enabled)
 	{
-		return false;
+		printf("GPU timer queries not supported, dynamic resolution disabled\n");
+		this->dynamic_resolution.enabled = false;
+		this->updateViewRects(this->dynamic_resolution.getScale());
+	}
+	this->addGpuPasses();
+
+	if (this->visibility_mask.enabled && !this->initVisibilityMask())
+	{
+		printf("Visibility mask not available, hidden areas will be shaded\n");
+		this->visibility_mask.enabled = false;
+	}
+
+	if (this->mirror.enabled)
+	{
+		this->mirror.init(this->window, static_cast<int>(this->xr_config_views.size()));
 	}
+
+	//The session is begun once the runtime reports it READY, see checkEvents
+	this->frame_pacer.telemetry = &this->telemetry;
+
 	//Enumerate Extensions and Check if GL is supported
 	return true;
 }
@@ -164,10 +220,30 @@ bool XrProgram::checkExtensionSupport()
 			}
 		}
 
-		if (!strcmp(this->optional_extensions[0], properties.extensionName))
+		for (char* extension : this->optional_extensions)
 		{
-			this->depth.supported = true;
-			this->enabled_extensions.push_back(this->optional_extensions[0]);
+			if (strcmp(properties.extensionName, extension))
+			{
+				continue;
+			}
+			this->enabled_extensions.push_back(extension);
+			if (!strcmp(extension, XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME))
+			{
+				this->depth.supported = true;
+				this->depth.extension_enabled = true;
+			}
+			else if (!strcmp(extension, XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME))
+			{
+				this->cylinder_layers_supported = true;
+			}
+			else if (!strcmp(extension, XR_KHR_WIN32_CONVERT_PERFORMANCE_COUNTER_TIME_EXTENSION_NAME))
+			{
+				this->frame_timing.time_conversion_supported = true;
+			}
+			else if (!strcmp(extension, XR_KHR_VISIBILITY_MASK_EXTENSION_NAME))
+			{
+				this->visibility_mask.supported = true;
+			}
 		}
 	}
 	return true;
@@ -210,16 +286,21 @@ bool XrProgram::createViews()
 		return false;
 	}
 
+	if (!chooseStereoMode(view_count))
+	{
+		return false;
+	}
+
 	if (!createSwapchains(view_count)) 
 	{
 		printf("Unable to create Swapchain\n");
 		return false;
 	}
 	
-	this->images.resize(view_count);
+	this->images.resize(this->swapchains.size());
 	if (this->depth.supported) 
 	{
-		this->depth_images.resize(view_count);
+		this->depth_images.resize(this->depth_swapchains.size());
 	}
 
 	if (!getSwapchainImages()) 
@@ -234,41 +315,231 @@ bool XrProgram::createViews()
 		return false;
 	}
 
+	if (!genFences())
+	{
+		return false;
+	}
+
+	//Without the viewport array both eyes of the double wide image share one scissor, which would have to span nearly all of it
+	if (this->multires.enabled && this->stereo_mode == STEREO_MODE_INSTANCED && !this->instanced.viewport_array)
+	{
+		printf("Multires needs ARB_viewport_array with instanced stereo, rendering at full resolution\n");
+		this->multires.enabled = false;
+	}
+	if (this->multires.enabled && !genMultiresTargets())
+	{
+		printf("Unable to create multires targets, rendering at full resolution\n");
+		this->multires.enabled = false;
+	}
+
 	this->projection_views.resize(view_count);
 
-	//Allocate Composition Layer Projection View. Everything can be filled in except FOV and Pose
+	//With multiview every view lives in its own layer of the one array swapchain, with instanced stereo in its own half
+	bool multiview = this->stereo_mode == STEREO_MODE_MULTIVIEW;
+	bool instanced = this->stereo_mode == STEREO_MODE_INSTANCED;
+
+	//Allocate Composition Layer Projection View. Everything can be filled in except FOV, Pose and the image rects set by updateViewRects
 	for (uint32_t i = 0; i < view_count; i++) 
 	{
+		uint32_t swapchain_index = (multiview || instanced) ? 0 : i;
 		this->projection_views[i].type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
 		this->projection_views[i].next = NULL;
-		this->projection_views[i].subImage.swapchain = this->swapchains[i];
-		this->projection_views[i].subImage.imageArrayIndex = 0;
-		this->projection_views[i].subImage.imageRect.offset.x = 0;
-		this->projection_views[i].subImage.imageRect.offset.y = 0;
-		this->projection_views[i].subImage.imageRect.extent.height = this->xr_config_views[i].recommendedImageRectHeight;
-		this->projection_views[i].subImage.imageRect.extent.width = this->xr_config_views[i].recommendedImageRectWidth;
+		this->projection_views[i].subImage.swapchain = this->swapchains[swapchain_index];
+		this->projection_views[i].subImage.imageArrayIndex = multiview ? i : 0;
 	}
 
-	if (this->depth.supported)
+	if (this->depth.supported && !this->depth_swapchains.empty())
 	{
+		//Depth can only be submitted when the runtime enabled the extension and we asked for it
+		bool submit_depth = this->depth.submit && this->depth.extension_enabled;
+
 		this->depth.depth_info.resize(view_count);
 		for (uint32_t i = 0; i < view_count; i++) 
 		{
+			uint32_t swapchain_index = (multiview || instanced) ? 0 : i;
 			this->depth.depth_info[i].type = XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR;
-			this->depth.depth_info[i].subImage.swapchain = this->depth_swapchains[i];
-			this->depth.depth_info[i].subImage.imageArrayIndex = 0;
-			this->depth.depth_info[i].subImage.imageRect.offset.x = 0;
-			this->depth.depth_info[i].subImage.imageRect.offset.y = 0;
-			this->depth.depth_info[i].subImage.imageRect.extent.height = this->xr_config_views[i].recommendedImageRectHeight;
-			this->depth.depth_info[i].subImage.imageRect.extent.width = this->xr_config_views[i].recommendedImageRectWidth;
-			//this->projection_views[i].next = &this->depth.depth_info[i];
+			this->depth.depth_info[i].next = NULL;
+			this->depth.depth_info[i].subImage.swapchain = this->depth_swapchains[swapchain_index];
+			this->depth.depth_info[i].subImage.imageArrayIndex = multiview ? i : 0;
+
+			//The depth images hold the default glDepthRange of a projection built from near_z and far_z
+			this->depth.depth_info[i].minDepth = 0.0f;
+			this->depth.depth_info[i].maxDepth = 1.0f;
+			this->depth.depth_info[i].nearZ = this->near_z;
+			this->depth.depth_info[i].farZ = this->far_z;
+
+			if (submit_depth)
+			{
+				this->projection_views[i].next = &this->depth.depth_info[i];
+			}
 		}
-		
+
+		if (this->depth.submit && !submit_depth)
+		{
+			printf("XR_KHR_composition_layer_depth not enabled, depth won't be submitted\n");
+		}
+	}
+
+	this->render_extents.resize(this->swapchains.size());
+	this->updateViewRects(this->dynamic_resolution.getScale());
+
+	//Frame data points into projection_views, so it goes last
+	if (!createFrameData(view_count))
+	{
+		return false;
 	}
 
 	return true;
 }
 
+bool XrProgram::createFrameData(int view_count)
+{
+	this->frame_data.wait_info.type = XR_TYPE_FRAME_WAIT_INFO;
+	this->frame_data.wait_info.next = XR_NULL_HANDLE;
+
+	this->frame_data.begin_info.type = XR_TYPE_FRAME_BEGIN_INFO;
+	this->frame_data.begin_info.next = XR_NULL_HANDLE;
+
+	this->frame_data.view_locate_info.type = XR_TYPE_VIEW_LOCATE_INFO;
+	this->frame_data.view_locate_info.next = XR_NULL_HANDLE;
+	this->frame_data.view_locate_info.viewConfigurationType = this->view_type;
+	this->frame_data.view_locate_info.displayTime = 0;
+	this->frame_data.view_locate_info.space = this->reference_space;
+
+	this->frame_data.view_state.type = XR_TYPE_VIEW_STATE;
+	this->frame_data.view_state.next = XR_NULL_HANDLE;
+
+	this->frame_data.views.resize(view_count, { XR_TYPE_VIEW, nullptr });
+
+	this->late_latch.view_state.type = XR_TYPE_VIEW_STATE;
+	this->late_latch.view_state.next = XR_NULL_HANDLE;
+	this->late_latch.views.resize(view_count, { XR_TYPE_VIEW, nullptr });
+
+	this->frame_data.acquire_info.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO;
+	this->frame_data.acquire_info.next = XR_NULL_HANDLE;
+
+	this->frame_data.image_wait_info.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO;
+	this->frame_data.image_wait_info.next = XR_NULL_HANDLE;
+	this->frame_data.image_wait_info.timeout = 1000;
+
+	this->frame_data.release_info.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO;
+	this->frame_data.release_info.next = XR_NULL_HANDLE;
+
+	//A zeroed fov never matches a real one, so the first frame builds every projection
+	this->frame_data.fovs.resize(view_count, { 0, 0, 0, 0 });
+	this->frame_data.projection_matrices.resize(view_count);
+	this->frame_data.view_matrices.resize(view_count);
+	this->frame_data.vp_matrices.resize(view_count);
+
+	this->frame_data.projection_layer.type = XR_TYPE_COMPOSITION_LAYER_PROJECTION;
+	this->frame_data.projection_layer.next = XR_NULL_HANDLE;
+	this->frame_data.projection_layer.layerFlags = 0;
+	this->frame_data.projection_layer.space = this->reference_space;
+	this->frame_data.projection_layer.viewCount = view_count;
+	this->frame_data.projection_layer.views = this->projection_views.data();
+
+	this->frame_data.layers.resize(1 + this->ui_layers.size());
+	this->frame_data.layers[0] = (XrCompositionLayerBaseHeader*)&this->frame_data.projection_layer;
+
+	this->frame_data.end_info.type = XR_TYPE_FRAME_END_INFO;
+	this->frame_data.end_info.next = NULL;
+	this->frame_data.end_info.displayTime = 0;
+	this->frame_data.end_info.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
+	this->frame_data.end_info.layerCount = 1;
+	this->frame_data.end_info.layers = this->frame_data.layers.data();
+	return true;
+}
+
+XrExtent2Di XrProgram::getViewExtent(int view, float scale)
+{
+	XrExtent2Di extent;
+	extent.width = (int32_t)(this->xr_config_views[view].recommendedImageRectWidth * scale);
+	extent.height = (int32_t)(this->xr_config_views[view].recommendedImageRectHeight * scale);
+
+	if (extent.width > (int32_t)this->xr_config_views[view].maxImageRectWidth)
+	{
+		extent.width = this->xr_config_views[view].maxImageRectWidth;
+	}
+	if (extent.height > (int32_t)this->xr_config_views[view].maxImageRectHeight)
+	{
+		extent.height = this->xr_config_views[view].maxImageRectHeight;
+	}
+	if (extent.width < 1)
+	{
+		extent.width = 1;
+	}
+	if (extent.height < 1)
+	{
+		extent.height = 1;
+	}
+	return extent;
+}
+
+XrExtent2Di XrProgram::getSharedViewExtent(float scale)
+{
+	XrExtent2Di shared = { 0, 0 };
+	for (int i = 0; i < static_cast<int>(this->xr_config_views.size()); i++)
+	{
+		XrExtent2Di extent = this->getViewExtent(i, scale);
+		if (extent.width > shared.width)
+		{
+			shared.width = extent.width;
+		}
+		if (extent.height > shared.height)
+		{
+			shared.height = extent.height;
+		}
+	}
+	return shared;
+}
+
+void XrProgram::updateViewRects(float scale)
+{
+	bool multiview = this->stereo_mode == STEREO_MODE_MULTIVIEW;
+	bool instanced = this->stereo_mode == STEREO_MODE_INSTANCED;
+	int view_count = static_cast<int>(this->projection_views.size());
+
+	//Single pass modes draw every view with one viewport size
+	XrExtent2Di shared = this->getSharedViewExtent(scale);
+
+	for (int i = 0; i < view_count; i++)
+	{
+		int swapchain_index = (multiview || instanced) ? 0 : i;
+		XrExtent2Di view_extent = (multiview || instanced) ? shared : this->getViewExtent(i, scale);
+
+		//Rounding must never push a view past what the swapchain was allocated with
+		int32_t max_width = instanced ? this->swapchain_extents[0].width / view_count : this->swapchain_extents[swapchain_index].width;
+		if (view_extent.width > max_width)
+		{
+			view_extent.width = max_width;
+		}
+		if (view_extent.height > this->swapchain_extents[swapchain_index].height)
+		{
+			view_extent.height = this->swapchain_extents[swapchain_index].height;
+		}
+
+		XrRect2Di rect;
+		rect.offset.x = instanced ? i * view_extent.width : 0;
+		rect.offset.y = 0;
+		rect.extent = view_extent;
+
+		this->projection_views[i].subImage.imageRect = rect;
+		if (i < static_cast<int>(this->depth.depth_info.size()))
+		{
+			this->depth.depth_info[i].subImage.imageRect = rect;
+		}
+
+		//Instanced stereo renders every view side by side, the rest render one view or layer size
+		this->render_extents[swapchain_index] = view_extent;
+		if (instanced)
+		{
+			this->render_extents[0].width = view_extent.width * view_count;
+		}
+	}
+
+	this->render_scale = scale;
+}
+
 bool XrProgram::checkViewConfigs(XrViewConfigurationType view_type)
 {
 	uint32_t config_count = 0;
@@ -307,378 +578,1662 @@ bool XrProgram::checkViewConfigs(XrViewConfigurationType view_type)
 	return true;
 }
 
-bool XrProgram::createSwapchains(int view_count) 
+bool XrProgram::chooseStereoMode(int view_count)
 {
-	int64_t preffered_format = GL_SRGB8_ALPHA8;
-	if (!checkSwapchainImageSupport(preffered_format)) 
+	//The single pass shaders are written for exactly two views
+	if (view_count != 2)
 	{
-		printf("Preferred Swapchain format %s not supported\n", "GL_SRGB8_APLHA8");
+		this->stereo_mode = STEREO_MODE_PER_VIEW;
 	}
 
-	this->swapchains.resize(view_count);
-
-	for (int i = 0; i < view_count; i++) 
+	//Camera data goes through a persistently mapped ring when we can, so the poses can be refreshed after the draws are submitted
+	//Laid out like the std140 ViewBuffer block, two sets of matrices then the published and drawn set indices
+	this->late_latch.published_set_offset = 2 * view_count * sizeof(XrMatrix4x4f);
+	this->late_latch.view_set_offset = this->late_latch.published_set_offset + sizeof(uint32_t);
+	if (this->late_latch.enabled && !this->late_latch.ring.init(this->late_latch.view_set_offset + sizeof(uint32_t), true))
 	{
-		XrSwapchainCreateInfo swapchain_create_info;
-		swapchain_create_info.type = XR_TYPE_SWAPCHAIN_CREATE_INFO;
-		swapchain_create_info.next = NULL;
-		swapchain_create_info.createFlags = 0;
-		swapchain_create_info.usageFlags = XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT | XR_SWAPCHAIN_USAGE_SAMPLED_BIT;
-		swapchain_create_info.format = this->swapchain_format;
-		swapchain_create_info.sampleCount = this->xr_config_views[i].recommendedSwapchainSampleCount;
-		swapchain_create_info.width = this->xr_config_views[i].recommendedImageRectWidth;
-		swapchain_create_info.height = this->xr_config_views[i].recommendedImageRectHeight;
-		swapchain_create_info.faceCount = 1;
-		swapchain_create_info.arraySize = 1;
-		swapchain_create_info.mipCount = 1;
+		printf("ARB_buffer_storage not supported, late latching disabled\n");
+		this->late_latch.enabled = false;
+	}
+	std::string view_buffer_define = this->late_latch.enabled ? "#define VIEW_BUFFER\n" : "";
 
-		if (!checkXrResult(xrCreateSwapchain(this->session, &swapchain_create_info, &this->swapchains[i]))) 
-		{
-			printf("Unable to create Swapchain for view %d\n", i);
-			return false;
-		}
+	//Objects sharing a mesh are drawn as instances of one draw, their transforms read from the instance buffer
+	if (this->instancing.enabled && !this->instancing.buffer.init())
+	{
+		printf("Unable to create the instance buffer, drawing objects one at a time\n");
+		this->instancing.enabled = false;
 	}
+	std::string instance_define = this->instancing.enabled ? "#define INSTANCED_OBJECTS\n" : "";
 
-	if (this->depth_swapchain_format != -1 && this->depth.supported) 
+	if (this->stereo_mode == STEREO_MODE_MULTIVIEW)
 	{
-		this->depth_swapchains.resize(view_count);
-		for (int i = 0; i < view_count; i++)
+		this->multiview.supported = GLEW_OVR_multiview;
+		if (this->multiview.supported)
 		{
-			XrSwapchainCreateInfo depth_swapchain_create_info;
-			depth_swapchain_create_info.type = XR_TYPE_SWAPCHAIN_CREATE_INFO;
-			depth_swapchain_create_info.next = NULL;
-			depth_swapchain_create_info.createFlags = 0;
-			depth_swapchain_create_info.usageFlags = XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-			depth_swapchain_create_info.format = this->depth_swapchain_format;
-			depth_swapchain_create_info.sampleCount = this->xr_config_views[i].recommendedSwapchainSampleCount;
-			depth_swapchain_create_info.width = this->xr_config_views[i].recommendedImageRectWidth;
-			depth_swapchain_create_info.height = this->xr_config_views[i].recommendedImageRectHeight;
-			depth_swapchain_create_info.faceCount = 1;
-			depth_swapchain_create_info.arraySize = 1;
-			depth_swapchain_create_info.mipCount = 1;
-			if (!checkXrResult(xrCreateSwapchain(this->session, &depth_swapchain_create_info, &this->depth_swapchains[i])))
+			try
 			{
-				printf("Unable to create Depth Swapchain for view %d\n", i);
-				return false;
+				std::string defines = "#define MULTIVIEW\n" + view_buffer_define + instance_define;
+				this->multiview.shader = new Shader("Shaders\\vert.vsh", "Shaders\\frag.fg", defines.c_str());
+				this->multiview.view_projection_location = glGetUniformLocation(this->multiview.shader->getProgram(), "view_projection");
+				this->multiview.model_location = glGetUniformLocation(this->multiview.shader->getProgram(), "model");
+				this->multiview.color_location = glGetUniformLocation(this->multiview.shader->getProgram(), "material_color");
+				this->bindViewBuffer(this->multiview.shader);
+			}
+			catch (std::runtime_error&)
+			{
+				this->multiview.supported = false;
 			}
 		}
-	}
-
-	return true;
-}
 
-bool XrProgram::checkSwapchainImageSupport(int64_t image_format)
-{
-	uint32_t format_count = 0;
-	if (!checkXrResult(xrEnumerateSwapchainFormats(this->session, format_count, &format_count, NULL))) 
-	{
-		printf("Couldn't get Swapchain image formats\n");
-		return false;
-	}
-	std::vector<int64_t> swapchain_image_formats(format_count);
-	if (!checkXrResult(xrEnumerateSwapchainFormats(this->session, format_count, &format_count, swapchain_image_formats.data())))
-	{
-		printf("Couldn't get Swapchain image formats\n");
-		return false;
+		if (!this->multiview.supported)
+		{
+			printf("OVR_multiview not supported, falling back to instanced stereo\n");
+			this->stereo_mode = STEREO_MODE_INSTANCED;
+		}
 	}
-	bool preferred = false;
-	bool depth_preferred = false;
-
-	//Temporary Depth preferred format
-	int64_t depth_pref_format = GL_DEPTH_COMPONENT32F;
 
-	this->swapchain_format = swapchain_image_formats[0];
-	this->depth_swapchain_format = -1;
-	for (int i = 0; i < swapchain_image_formats.size(); i++) 
+	if (this->stereo_mode == STEREO_MODE_INSTANCED)
 	{
-		if (swapchain_image_formats[i] == image_format) 
+		//Route each eye to its own viewport from the vertex shader when we can, otherwise split the one viewport with a clip plane
+		this->instanced.viewport_array = GLEW_ARB_viewport_array && GLEW_ARB_shader_viewport_layer_array;
+		this->instanced.supported = true;
+		try
 		{
-			this->swapchain_format = image_format;
-			preferred = true;
-			printf("Prefered format found\n");
+			std::string defines = this->instanced.viewport_array ? "#define INSTANCED_STEREO\n#define VIEWPORT_ARRAY\n" : "#define INSTANCED_STEREO\n";
+			defines += view_buffer_define + instance_define;
+			this->instanced.shader = new Shader("Shaders\\vert.vsh", "Shaders\\frag.fg", defines.c_str());
+			this->instanced.view_projection_location = glGetUniformLocation(this->instanced.shader->getProgram(), "view_projection");
+			this->instanced.model_location = glGetUniformLocation(this->instanced.shader->getProgram(), "model");
+			this->instanced.color_location = glGetUniformLocation(this->instanced.shader->getProgram(), "material_color");
+			this->bindViewBuffer(this->instanced.shader);
+		}
+		catch (std::runtime_error&)
+		{
+			this->instanced.supported = false;
 		}
 
-		if (swapchain_image_formats[i] == depth_pref_format) 
+		if (!this->instanced.supported)
 		{
-			this->depth_swapchain_format = depth_pref_format;
-			depth_preferred = true;;
-			printf("Preferred depth format found\n");
+			printf("Instanced stereo not supported, falling back to per view rendering\n");
+			this->stereo_mode = STEREO_MODE_PER_VIEW;
 		}
 	}
-	if (!preferred) 
-	{
-		return false;
-	}
-	if (depth_preferred) 
+
+	GLuint default_program = Shader::default_shader->getProgram();
+	this->per_view.mvp_location = glGetUniformLocation(default_program, "mvp");
+	this->per_view.color_location = glGetUniformLocation(default_program, "material_color");
+
+	if (this->stereo_mode == STEREO_MODE_PER_VIEW && this->late_latch.enabled)
 	{
-		this->depth.supported = true;
+		//The default shader takes a plain mvp uniform, per view rendering needs its own shader to read the view buffer
+		try
+		{
+			std::string defines = view_buffer_define + instance_define + "#define VIEW_COUNT " + std::to_string(view_count) + "\n";
+			this->late_latch.per_view_shader = new Shader("Shaders\\vert.vsh", "Shaders\\frag.fg", defines.c_str());
+			this->late_latch.view_index_location = glGetUniformLocation(this->late_latch.per_view_shader->getProgram(), "view_index");
+			this->late_latch.model_location = glGetUniformLocation(this->late_latch.per_view_shader->getProgram(), "model");
+			this->late_latch.color_location = glGetUniformLocation(this->late_latch.per_view_shader->getProgram(), "material_color");
+			this->bindViewBuffer(this->late_latch.per_view_shader);
+		}
+		catch (std::runtime_error&)
+		{
+			printf("Unable to build the view buffer shader, late latching disabled\n");
+			this->late_latch.enabled = false;
+			this->late_latch.ring.destroy();
+		}
 	}
-	return true;
-}
 
-bool XrProgram::getSwapchainImages() 
-{
-	for (int i = 0; i < this->swapchains.size(); i++) 
+	if (this->stereo_mode == STEREO_MODE_PER_VIEW && !this->late_latch.enabled && this->instancing.enabled)
 	{
-		uint32_t image_count = 0;
-		if (!checkXrResult(xrEnumerateSwapchainImages(this->swapchains[i], image_count, &image_count, NULL))) 
+		//Without the view buffer the default shader's mvp would need the model matrix, so build a variant that takes it per instance
+		try
 		{
-			return false;
+			this->instancing.per_view_shader = new Shader("Shaders\\vert.vsh", "Shaders\\frag.fg", instance_define.c_str());
+			this->instancing.view_projection_location = glGetUniformLocation(this->instancing.per_view_shader->getProgram(), "mvp");
 		}
-		this->images[i].resize(image_count, { XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR, nullptr});
-
-		if (!checkXrResult(xrEnumerateSwapchainImages(this->swapchains[i], image_count, &image_count, (XrSwapchainImageBaseHeader*)this->images[i].data())))
+		catch (std::runtime_error&)
 		{
-			return false;
+			printf("Unable to build the instanced shader, drawing objects one at a time\n");
+			this->instancing.enabled = false;
 		}
 	}
-	if (this->depth.supported) {
-		for (int i = 0; i < this->depth_swapchains.size(); i++)
-		{
-			uint32_t image_count = 0;
-			if (!checkXrResult(xrEnumerateSwapchainImages(this->depth_swapchains[i], image_count, &image_count, NULL)))
-			{
-				return false;
-			}
-			this->depth_images[i].resize(image_count, { XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR, nullptr });
 
-			if (!checkXrResult(xrEnumerateSwapchainImages(this->depth_swapchains[i], image_count, &image_count, (XrSwapchainImageBaseHeader*)this->depth_images[i].data())))
-			{
-				return false;
-			}
-		}
+	//The cull shader writes instance data, so it can only feed the instanced draw path
+	if (this->gpu_culling.enabled && (!this->instancing.enabled || !this->gpu_culling.culler.init()))
+	{
+		printf("GPU culling not supported, culling on the CPU\n");
+		this->gpu_culling.enabled = false;
 	}
 	return true;
 }
 
-bool XrProgram::genFrameBuffers() 
+bool XrProgram::addUiLayer(UiLayer* layer)
 {
-	int view_count = static_cast<int>(this->xr_config_views.size());
-	this->framebuffers.resize(view_count);
-	for (int i = 0; i < view_count; i++) 
+	if (layer->shape == LAYER_SHAPE_CYLINDER && !this->cylinder_layers_supported)
 	{
-		this->framebuffers[i].resize(this->images[i].size());
-		glGenFramebuffers(this->framebuffers[i].size(), this->framebuffers[i].data());
+		printf("XR_KHR_composition_layer_cylinder not supported, can't add cylinder layer\n");
+		return false;
 	}
-	return true;
-}
 
-bool XrProgram::beginSession() 
-{
-	XrSessionBeginInfo session_begin_info;
-	session_begin_info.type = XR_TYPE_SESSION_BEGIN_INFO;
-	session_begin_info.primaryViewConfigurationType = this->view_type;
-	if (!checkXrResult(xrBeginSession(this->session, &session_begin_info)))
+	if (!layer->init(this->session, this->reference_space, this->swapchain_format))
 	{
-		printf("Unable to begin session\n");
+		layer->destroy();
 		return false;
 	}
+
+	this->ui_layers.push_back(layer);
+	this->frame_data.layers.resize(1 + this->ui_layers.size());
+	this->frame_data.end_info.layers = this->frame_data.layers.data();
 	return true;
 }
 
-bool XrProgram::XrMainFunction() 
+void XrProgram::waitJustInTime(XrTime display_time, XrDuration display_period)
 {
-	//this->depth_swapchain_format = -1;
-	this->checkEvents();
-	if (this->xr_shutdown == true)
+	//Nothing to estimate the frame's work from until some frames have been timed
+	if (this->frame_stats.gpu_bound_frames + this->frame_stats.cpu_bound_frames == 0)
 	{
-		return false;
+		return;
 	}
 
-	// Get FrameState
-	XrFrameState frame_state;
-	frame_state.type = XR_TYPE_FRAME_STATE;
-	frame_state.next = XR_NULL_HANDLE;
+	LARGE_INTEGER display_counter;
+	if (!checkXrResult(this->frame_timing.convert_time(this->instance, display_time, &display_counter)))
+	{
+		return;
+	}
+	LARGE_INTEGER now_counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&now_counter);
+	QueryPerformanceFrequency(&frequency);
 
-	XrFrameWaitInfo frame_wait_info;
-	frame_wait_info.next = XR_NULL_HANDLE;
-	frame_wait_info.type = XR_TYPE_FRAME_WAIT_INFO;
+	double period_ms = display_period / 1000000.0;
+	double lead_ms = this->frame_timing.compositor_lead_ms >= 0.0 ? this->frame_timing.compositor_lead_ms : period_ms;
 
-	if (!this->checkXrResult(xrWaitFrame(this->session, &frame_wait_info, &frame_state)))
+	//Pessimistic, as if the GPU only starts once the CPU has submitted everything
+	double work_ms = this->frame_stats.cpu_ms + this->frame_stats.gpu_ms;
+
+	double until_display_ms = (display_counter.QuadPart - now_counter.QuadPart) * 1000.0 / frequency.QuadPart;
+	double slack_ms = until_display_ms - lead_ms - work_ms - this->frame_timing.safety_margin_ms;
+	if (slack_ms <= 0.0)
 	{
-		printf("Unable to get Frame State\n");
-		return false;
+		return;
 	}
-	
-	XrViewLocateInfo view_locate_info;
-	view_locate_info.type = XR_TYPE_VIEW_LOCATE_INFO;
-	view_locate_info.next = XR_NULL_HANDLE;
-	view_locate_info.viewConfigurationType = this->view_type;
-	view_locate_info.displayTime = frame_state.predictedDisplayTime;
-	view_locate_info.space = this->reference_space;
-
-	uint32_t view_count = this->xr_config_views.size();
-	std::vector<XrView> views;
-	views.resize(view_count);
-	for (uint32_t i = 0; i < view_count; i++) 
+
+	//A bad estimate shouldn't be able to cost a whole frame
+	if (slack_ms > period_ms)
 	{
-		views[i].type = XR_TYPE_VIEW;
-		views[i].next = NULL;
+		slack_ms = period_ms;
 	}
+	LONGLONG wake_counter = now_counter.QuadPart + (LONGLONG)(slack_ms * frequency.QuadPart / 1000.0);
 
-	XrViewState view_state;
-	view_state.type = XR_TYPE_VIEW_STATE;
-	view_state.next = XR_NULL_HANDLE;
-	//view_state.viewStateFlags = 0;
-
-	if (!this->checkXrResult(xrLocateViews(this->session, &view_locate_info, &view_state, view_count, &view_count, views.data()))) 
+	double timer_ms = slack_ms - this->frame_timing.spin_ms;
+	if (timer_ms > 0.0 && this->frame_timing.wait_timer != NULL)
 	{
-		printf("Couldn't Locate Views\n");
-		return false;
+		//Negative due times are relative, in 100 ns units
+		LARGE_INTEGER due_time;
+		due_time.QuadPart = -(LONGLONG)(timer_ms * 10000.0);
+		if (SetWaitableTimerEx(this->frame_timing.wait_timer, &due_time, 0, NULL, NULL, NULL, 0))
+		{
+			WaitForSingleObject(this->frame_timing.wait_timer, INFINITE);
+		}
 	}
 
-	XrFrameBeginInfo frame_begin_info;
-	frame_begin_info.type = XR_TYPE_FRAME_BEGIN_INFO;
-	frame_begin_info.next = XR_NULL_HANDLE;
-
-	if (!this->checkXrResult(xrBeginFrame(this->session, &frame_begin_info))) 
+	//Spin out whatever the timer left, it is only accurate to a fraction of a millisecond
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	while (counter.QuadPart < wake_counter)
 	{
-		printf("Couldn't begin frame\n");
-		return false;
+		YieldProcessor();
+		QueryPerformanceCounter(&counter);
 	}
+	this->frame_timing.stats.delayed_frames++;
+	this->frame_timing.stats.total_delay_ms += slack_ms;
+}
 
-	for (uint32_t i = 0; i < view_count; i++) 
-	{
-		//Actual Creation of projection and View Matrix
-		XrMatrix4x4f Projection_matrix;
-		XrMatrix4x4f_CreateProjectionFov(&Projection_matrix, GRAPHICS_OPENGL, views[i].fov, near_z, far_z);
-		XrMatrix4x4f view_matrix;
-		XrMatrix4x4f_CreateViewMatrix(&view_matrix, &views[i].pose.position, &views[i].pose.orientation);
+double XrProgram::getNonXrBudgetMs()
+{
+	return (this->frame_timing.non_xr_deadline_ns - FrameTelemetry::now()) / 1000000.0;
+}
 
-		//Wait to aquire swapchain info
-		XrSwapchainImageAcquireInfo swapchain_image_aquire_info;
-		swapchain_image_aquire_info.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO;
-		swapchain_image_aquire_info.next = XR_NULL_HANDLE;
+void XrProgram::updateNonXrDeadline()
+{
+	//Work outside the frame has until the next frame state is due, but never more than its share of the period
+	int64_t frame_end_ns = FrameTelemetry::now();
+	int64_t next_frame_ns = this->frame_timing.frame_start_ns + this->frame_timing.period_ns;
+	int64_t budget_end_ns = frame_end_ns + (int64_t)(this->frame_timing.period_ns * this->frame_timing.non_xr_fraction);
+	this->frame_timing.non_xr_deadline_ns = next_frame_ns < budget_end_ns ? next_frame_ns : budget_end_ns;
+}
+
+bool XrProgram::initVisibilityMask()
+{
+	if (this->visibility_mask.get_mask == nullptr)
+	{
+		return false;
+	}
+
+	//Same routing of views as the scene shaders
+	int view_count = static_cast<int>(this->xr_config_views.size());
+	std::string defines = "#define VIEW_COUNT " + std::to_string(view_count) + "\n";
+	if (this->stereo_mode == STEREO_MODE_MULTIVIEW)
+	{
+		defines += "#define MULTIVIEW\n";
+	}
+	else if (this->stereo_mode == STEREO_MODE_INSTANCED)
+	{
+		defines += this->instanced.viewport_array ? "#define INSTANCED_STEREO\n#define VIEWPORT_ARRAY\n" : "#define INSTANCED_STEREO\n";
+	}
+	try
+	{
+		this->visibility_mask.shader = new Shader("Shaders\\mask.vsh", "Shaders\\frag.fg", defines.c_str());
+	}
+	catch (std::runtime_error&)
+	{
+		return false;
+	}
+	this->visibility_mask.projection_location = glGetUniformLocation(this->visibility_mask.shader->getProgram(), "projection");
+
+	glGenVertexArrays(1, &this->visibility_mask.vao);
+	glGenBuffers(1, &this->visibility_mask.vbo);
+	glBindVertexArray(this->visibility_mask.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, this->visibility_mask.vbo);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+
+	this->visibility_mask.first_vertex.resize(view_count, 0);
+	this->visibility_mask.vertex_count.resize(view_count, 0);
+	this->visibility_mask.hidden_fraction.resize(view_count, 0.0f);
+	this->visibility_mask.dirty = true;
+	return true;
+}
+
+bool XrProgram::updateVisibilityMask()
+{
+	uint32_t view_count = static_cast<uint32_t>(this->xr_config_views.size());
+	this->visibility_mask.vertices.clear();
+
+	for (uint32_t view = 0; view < view_count; view++)
+	{
+		XrVisibilityMaskKHR mask = { XR_TYPE_VISIBILITY_MASK_KHR, nullptr };
+		if (!checkXrResult(this->visibility_mask.get_mask(this->session, this->view_type, view, XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR, &mask)))
+		{
+			return false;
+		}
+
+		this->visibility_mask.mask_vertices.resize(mask.vertexCountOutput);
+		this->visibility_mask.mask_indices.resize(mask.indexCountOutput);
+		mask.vertexCapacityInput = mask.vertexCountOutput;
+		mask.vertices = this->visibility_mask.mask_vertices.data();
+		mask.indexCapacityInput = mask.indexCountOutput;
+		mask.indices = this->visibility_mask.mask_indices.data();
+		if (mask.vertexCapacityInput > 0 && !checkXrResult(this->visibility_mask.get_mask(this->session, this->view_type, view, XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR, &mask)))
+		{
+			return false;
+		}
+
+		//Flatten into plain triangles tagged with their view, so one draw can cover every view
+		this->visibility_mask.first_vertex[view] = static_cast<GLint>(this->visibility_mask.vertices.size() / 3);
+		this->visibility_mask.vertex_count[view] = static_cast<GLsizei>(mask.indexCountOutput);
+		for (uint32_t i = 0; i < mask.indexCountOutput; i++)
+		{
+			XrVector2f vertex = this->visibility_mask.mask_vertices[this->visibility_mask.mask_indices[i]];
+			this->visibility_mask.vertices.push_back(vertex.x);
+			this->visibility_mask.vertices.push_back(vertex.y);
+			this->visibility_mask.vertices.push_back((float)view);
+		}
+
+		//The area covered in tangent space against the whole fov, on the z = -1 plane x and y are the tangents
+		XrFovf fov = this->frame_data.fovs[view];
+		float view_area = (tanf(fov.angleRight) - tanf(fov.angleLeft)) * (tanf(fov.angleUp) - tanf(fov.angleDown));
+		float hidden_area = 0.0f;
+		for (uint32_t i = 0; i + 2 < mask.indexCountOutput; i += 3)
+		{
+			XrVector2f a = this->visibility_mask.mask_vertices[this->visibility_mask.mask_indices[i]];
+			XrVector2f b = this->visibility_mask.mask_vertices[this->visibility_mask.mask_indices[i + 1]];
+			XrVector2f c = this->visibility_mask.mask_vertices[this->visibility_mask.mask_indices[i + 2]];
+			hidden_area += fabsf((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y)) * 0.5f;
+		}
+		this->visibility_mask.hidden_fraction[view] = view_area > 0.0f ? hidden_area / view_area : 0.0f;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, this->visibility_mask.vbo);
+	glBufferData(GL_ARRAY_BUFFER, this->visibility_mask.vertices.size() * sizeof(float), this->visibility_mask.vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	this->visibility_mask.dirty = false;
+	return true;
+}
+
+void XrProgram::drawVisibilityMask(int first_view, int count)
+{
+	if (!this->visibility_mask.enabled || this->visibility_mask.vertices.empty())
+	{
+		return;
+	}
+
+	GLsizei vertex_count = 0;
+	for (int view = first_view; view < first_view + count; view++)
+	{
+		vertex_count += this->visibility_mask.vertex_count[view];
+	}
+
+	//Only depth is written, and the mask's winding isn't specified so it can't be culled
+	GLboolean cull_face = glIsEnabled(GL_CULL_FACE);
+	glDisable(GL_CULL_FACE);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	glUseProgram(this->visibility_mask.shader->getProgram());
+	glUniformMatrix4fv(this->visibility_mask.projection_location, static_cast<GLsizei>(this->frame_data.projection_matrices.size()), GL_FALSE, this->frame_data.projection_matrices[0].m);
+	glBindVertexArray(this->visibility_mask.vao);
+	glDrawArrays(GL_TRIANGLES, this->visibility_mask.first_vertex[first_view], vertex_count);
+	glBindVertexArray(0);
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	if (cull_face)
+	{
+		glEnable(GL_CULL_FACE);
+	}
+}
+
+void XrProgram::mirrorSwapchain(int swapchain, uint32_t index)
+{
+	GLuint texture = this->images[swapchain][index].image;
+	int view_count = static_cast<int>(this->projection_views.size());
+	for (int view = 0; view < view_count; view++)
+	{
+		//Per view rendering gives every view its own swapchain, the stereo modes put them all in the one
+		if (this->stereo_mode == STEREO_MODE_PER_VIEW && view != swapchain)
+		{
+			continue;
+		}
+		int layer = this->stereo_mode == STEREO_MODE_MULTIVIEW ? view : -1;
+		this->mirror.blitView(view, texture, layer, this->projection_views[view].subImage.imageRect);
+	}
+}
+
+void XrProgram::bindViewBuffer(Shader* shader)
+{
+	GLuint program = shader->getProgram();
+	GLuint block_index = glGetUniformBlockIndex(program, "ViewBuffer");
+	if (block_index != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, block_index, VIEW_BUFFER_BINDING);
+	}
+}
+
+bool XrProgram::lateLatchViews()
+{
+	//Once the GPU is past the fence in front of the copy the frame's set is chosen, locating the views again is wasted
+	GLenum status = glClientWaitSync(this->late_latch.draw_fence, 0, 0);
+	if (status != GL_TIMEOUT_EXPIRED)
+	{
+		this->late_latch.stats.skipped_frames++;
+		return false;
+	}
+
+	uint32_t view_count = static_cast<uint32_t>(this->late_latch.views.size());
+	if (!this->checkXrResult(xrLocateViews(this->session, &this->frame_data.view_locate_info, &this->late_latch.view_state, view_count, &view_count, this->late_latch.views.data())))
+	{
+		this->late_latch.stats.skipped_frames++;
+		return false;
+	}
+
+	XrViewStateFlags required = XR_VIEW_STATE_ORIENTATION_VALID_BIT | XR_VIEW_STATE_POSITION_VALID_BIT;
+	if ((this->late_latch.view_state.viewStateFlags & required) != required)
+	{
+		this->late_latch.stats.skipped_frames++;
+		return false;
+	}
+
+	//Keep the projection the frame was drawn with, only the pose is refreshed. The second set is never read before it is
+	//published, so the GPU can't see it half written
+	uint8_t* slot = (uint8_t*)this->late_latch.ring.getSlot();
+	XrMatrix4x4f* latched_set = (XrMatrix4x4f*)slot + view_count;
+	for (uint32_t i = 0; i < view_count; i++)
+	{
+		XrView& view = this->late_latch.views[i];
+		XrMatrix4x4f view_matrix;
+		XrMatrix4x4f_CreateViewMatrix(&view_matrix, &view.pose.position, &view.pose.orientation);
+		XrMatrix4x4f_Multiply(&latched_set[i], &this->frame_data.projection_matrices[i], &view_matrix);
+	}
+
+	//One aligned 32 bit store publishes the whole set, the copy reads either the old index or the new one
+	std::atomic_thread_fence(std::memory_order_release);
+	*(volatile uint32_t*)(slot + this->late_latch.published_set_offset) = 1;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	//Still short of the fence, so the copy and every draw after it will see the new set
+	bool latched = glClientWaitSync(this->late_latch.draw_fence, 0, 0) == GL_TIMEOUT_EXPIRED;
+	if (!latched)
+	{
+		//The GPU got to the copy while the set was being published. It runs right behind the fence, so wait for it and read back which set it took
+		GLenum result = glClientWaitSync(this->late_latch.copy_fence, GL_SYNC_FLUSH_COMMANDS_BIT, this->fence_timeout);
+		if (result == GL_WAIT_FAILED || result == GL_TIMEOUT_EXPIRED)
+		{
+			printf("Timed out waiting on the late latch copy\n");
+			this->late_latch.stats.skipped_frames++;
+			return false;
+		}
+		latched = *(volatile uint32_t*)(slot + this->late_latch.view_set_offset) == 1;
+	}
+
+	if (!latched)
+	{
+		this->late_latch.stats.skipped_frames++;
+		return false;
+	}
+
+	//Only now is it certain the image matches these poses, so only now are they what the compositor gets
+	for (uint32_t i = 0; i < view_count; i++)
+	{
+		this->projection_views[i].pose = this->late_latch.views[i].pose;
+	}
+	this->late_latch.stats.applied_frames++;
+	return true;
+}
+
+bool XrProgram::createSwapchains(int view_count) 
+{
+	int64_t preffered_format = GL_SRGB8_ALPHA8;
+	if (!checkSwapchainImageSupport(preffered_format)) 
+	{
+		printf("Preferred Swapchain format %s not supported\n", "GL_SRGB8_APLHA8");
+	}
+
+	//Multiview renders every view into the layers of one array swapchain, instanced stereo side by side into one double wide swapchain
+	bool multiview = this->stereo_mode == STEREO_MODE_MULTIVIEW;
+	bool instanced = this->stereo_mode == STEREO_MODE_INSTANCED;
+	int swapchain_count = (multiview || instanced) ? 1 : view_count;
+	uint32_t array_size = multiview ? view_count : 1;
+
+	//Allocate at the largest scale dynamic resolution may pick, so the swapchains never have to be recreated
+	float allocation_scale = this->dynamic_resolution.getAllocationScale();
+	this->swapchain_extents.resize(swapchain_count);
+	for (int i = 0; i < swapchain_count; i++)
+	{
+		this->swapchain_extents[i] = this->getViewExtent(i, allocation_scale);
+	}
+	if (multiview || instanced)
+	{
+		//Every view shares one size, so it has to fit the largest view
+		this->swapchain_extents[0] = this->getSharedViewExtent(allocation_scale);
+	}
+	if (instanced)
+	{
+		this->swapchain_extents[0].width *= view_count;
+	}
+
+	this->swapchains.resize(swapchain_count);
+
+	for (int i = 0; i < swapchain_count; i++) 
+	{
+		XrSwapchainCreateInfo swapchain_create_info;
+		swapchain_create_info.type = XR_TYPE_SWAPCHAIN_CREATE_INFO;
+		swapchain_create_info.next = NULL;
+		swapchain_create_info.createFlags = 0;
+		swapchain_create_info.usageFlags = XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT | XR_SWAPCHAIN_USAGE_SAMPLED_BIT;
+		swapchain_create_info.format = this->swapchain_format;
+		swapchain_create_info.sampleCount = this->xr_config_views[i].recommendedSwapchainSampleCount;
+		swapchain_create_info.width = this->swapchain_extents[i].width;
+		swapchain_create_info.height = this->swapchain_extents[i].height;
+		swapchain_create_info.faceCount = 1;
+		swapchain_create_info.arraySize = array_size;
+		swapchain_create_info.mipCount = 1;
+
+		if (!checkXrResult(xrCreateSwapchain(this->session, &swapchain_create_info, &this->swapchains[i]))) 
+		{
+			printf("Unable to create Swapchain for view %d\n", i);
+			return false;
+		}
+	}
+
+	if (this->depth_swapchain_format != -1 && this->depth.supported) 
+	{
+		this->depth_swapchains.resize(swapchain_count);
+		for (int i = 0; i < swapchain_count; i++)
+		{
+			XrSwapchainCreateInfo depth_swapchain_create_info;
+			depth_swapchain_create_info.type = XR_TYPE_SWAPCHAIN_CREATE_INFO;
+			depth_swapchain_create_info.next = NULL;
+			depth_swapchain_create_info.createFlags = 0;
+			depth_swapchain_create_info.usageFlags = XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+			depth_swapchain_create_info.format = this->depth_swapchain_format;
+			depth_swapchain_create_info.sampleCount = this->xr_config_views[i].recommendedSwapchainSampleCount;
+			depth_swapchain_create_info.width = this->swapchain_extents[i].width;
+			depth_swapchain_create_info.height = this->swapchain_extents[i].height;
+			depth_swapchain_create_info.faceCount = 1;
+			depth_swapchain_create_info.arraySize = array_size;
+			depth_swapchain_create_info.mipCount = 1;
+			if (!checkXrResult(xrCreateSwapchain(this->session, &depth_swapchain_create_info, &this->depth_swapchains[i])))
+			{
+				printf("Unable to create Depth Swapchain for view %d\n", i);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool XrProgram::checkSwapchainImageSupport(int64_t image_format)
+{
+	uint32_t format_count = 0;
+	if (!checkXrResult(xrEnumerateSwapchainFormats(this->session, format_count, &format_count, NULL))) 
+	{
+		printf("Couldn't get Swapchain image formats\n");
+		return false;
+	}
+	std::vector<int64_t> swapchain_image_formats(format_count);
+	if (!checkXrResult(xrEnumerateSwapchainFormats(this->session, format_count, &format_count, swapchain_image_formats.data())))
+	{
+		printf("Couldn't get Swapchain image formats\n");
+		return false;
+	}
+	bool preferred = false;
+	bool depth_preferred = false;
+
+	//Temporary Depth preferred format
+	int64_t depth_pref_format = GL_DEPTH_COMPONENT32F;
+
+	this->swapchain_format = swapchain_image_formats[0];
+	this->depth_swapchain_format = -1;
+	for (int i = 0; i < swapchain_image_formats.size(); i++) 
+	{
+		if (swapchain_image_formats[i] == image_format) 
+		{
+			this->swapchain_format = image_format;
+			preferred = true;
+			printf("Prefered format found\n");
+		}
+
+		if (swapchain_image_formats[i] == depth_pref_format) 
+		{
+			this->depth_swapchain_format = depth_pref_format;
+			depth_preferred = true;;
+			printf("Preferred depth format found\n");
+		}
+	}
+	if (!preferred) 
+	{
+		return false;
+	}
+	if (depth_preferred) 
+	{
+		this->depth.supported = true;
+	}
+	return true;
+}
+
+bool XrProgram::getSwapchainImages() 
+{
+	for (int i = 0; i < this->swapchains.size(); i++) 
+	{
+		uint32_t image_count = 0;
+		if (!checkXrResult(xrEnumerateSwapchainImages(this->swapchains[i], image_count, &image_count, NULL))) 
+		{
+			return false;
+		}
+		this->images[i].resize(image_count, { XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR, nullptr});
+
+		if (!checkXrResult(xrEnumerateSwapchainImages(this->swapchains[i], image_count, &image_count, (XrSwapchainImageBaseHeader*)this->images[i].data())))
+		{
+			return false;
+		}
+	}
+	if (this->depth.supported) {
+		for (int i = 0; i < this->depth_swapchains.size(); i++)
+		{
+			uint32_t image_count = 0;
+			if (!checkXrResult(xrEnumerateSwapchainImages(this->depth_swapchains[i], image_count, &image_count, NULL)))
+			{
+				return false;
+			}
+			this->depth_images[i].resize(image_count, { XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR, nullptr });
+
+			if (!checkXrResult(xrEnumerateSwapchainImages(this->depth_swapchains[i], image_count, &image_count, (XrSwapchainImageBaseHeader*)this->depth_images[i].data())))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool XrProgram::genFrameBuffers() 
+{
+	int swapchain_count = static_cast<int>(this->images.size());
+	GLsizei view_count = static_cast<GLsizei>(this->xr_config_views.size());
+	this->framebuffers.resize(swapchain_count);
+	for (int i = 0; i < swapchain_count; i++) 
+	{
+		//The color and depth swapchains hand out their images independently, so build one framebuffer per pairing
+		uint32_t color_count = static_cast<uint32_t>(this->images[i].size());
+		uint32_t depth_count = this->getDepthImageCount(i);
+		uint32_t pair_count = color_count * (depth_count > 0 ? depth_count : 1);
+
+		this->framebuffers[i].resize(pair_count);
+		glGenFramebuffers(pair_count, this->framebuffers[i].data());
+
+		for (uint32_t color = 0; color < color_count; color++)
+		{
+			for (uint32_t depth = 0; depth < pair_count / color_count; depth++)
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER, this->getFramebuffer(i, color, depth_count > 0 ? depth : UINT32_MAX));
+
+				if (this->stereo_mode == STEREO_MODE_MULTIVIEW)
+				{
+					//Attach every layer of the array images, one layer per view
+					glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->images[i][color].image, 0, 0, view_count);
+					if (depth_count > 0)
+					{
+						glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->depth_images[i][depth].image, 0, 0, view_count);
+					}
+				}
+				else
+				{
+					glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->images[i][color].image, 0);
+					if (depth_count > 0)
+					{
+						glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depth_images[i][depth].image, 0);
+					}
+				}
+
+				//Completeness only has to be checked once, the attachments never change after this
+				GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+				if (status != GL_FRAMEBUFFER_COMPLETE)
+				{
+					printf("Framebuffer for swapchain %d color image %u depth image %u is incomplete: 0x%x\n", i, color, depth, status);
+					glBindFramebuffer(GL_FRAMEBUFFER, 0);
+					return false;
+				}
+			}
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return true;
+}
+
+bool XrProgram::genMultiresTargets()
+{
+	bool multiview = this->stereo_mode == STEREO_MODE_MULTIVIEW;
+	GLsizei view_count = static_cast<GLsizei>(this->xr_config_views.size());
+	GLsizei layer_count = multiview ? view_count : 1;
+	GLenum target = multiview ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	GLenum depth_format = this->depth_swapchain_format != -1 ? (GLenum)this->depth_swapchain_format : GL_DEPTH_COMPONENT32F;
+
+	//Big enough for the periphery of the largest swapchain, every swapchain renders its periphery through it in turn
+	GLsizei width = 1;
+	GLsizei height = 1;
+	for (int i = 0; i < static_cast<int>(this->swapchain_extents.size()); i++)
+	{
+		GLsizei low_width = (GLsizei)(this->swapchain_extents[i].width * this->multires.periphery_scale) + 1;
+		GLsizei low_height = (GLsizei)(this->swapchain_extents[i].height * this->multires.periphery_scale) + 1;
+		width = low_width > width ? low_width : width;
+		height = low_height > height ? low_height : height;
+	}
+
+	glGenTextures(1, &this->multires.color_texture);
+	glGenTextures(1, &this->multires.depth_texture);
+	GLuint textures[2] = { this->multires.color_texture, this->multires.depth_texture };
+	GLenum formats[2] = { (GLenum)this->swapchain_format, depth_format };
+	for (int i = 0; i < 2; i++)
+	{
+		glBindTexture(target, textures[i]);
+		if (multiview)
+		{
+			glTexStorage3D(target, 1, formats[i], width, height, layer_count);
+		}
+		else
+		{
+			glTexStorage2D(target, 1, formats[i], width, height);
+		}
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	glBindTexture(target, 0);
+
+	glGenFramebuffers(1, &this->multires.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->multires.framebuffer);
+	if (multiview)
+	{
+		glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->multires.color_texture, 0, 0, view_count);
+		glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->multires.depth_texture, 0, 0, view_count);
+	}
+	else
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->multires.color_texture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->multires.depth_texture, 0);
+	}
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return false;
+	}
+
+	if (multiview)
+	{
+		//Blits only work one layer at a time, so each layer of the periphery and of every swapchain image pairing gets its own framebuffer
+		this->multires.layer_framebuffers.resize(layer_count);
+		glGenFramebuffers(layer_count, this->multires.layer_framebuffers.data());
+		for (GLsizei layer = 0; layer < layer_count; layer++)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, this->multires.layer_framebuffers[layer]);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->multires.color_texture, 0, layer);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->multires.depth_texture, 0, layer);
+		}
+
+		uint32_t color_count = static_cast<uint32_t>(this->images[0].size());
+		uint32_t depth_count = this->getDepthImageCount(0);
+		uint32_t depth_stride = depth_count > 0 ? depth_count : 1;
+		this->multires.image_layer_framebuffers.resize(color_count * depth_stride * layer_count);
+		glGenFramebuffers(static_cast<GLsizei>(this->multires.image_layer_framebuffers.size()), this->multires.image_layer_framebuffers.data());
+		for (uint32_t color = 0; color < color_count; color++)
+		{
+			for (uint32_t depth = 0; depth < depth_stride; depth++)
+			{
+				for (GLsizei layer = 0; layer < layer_count; layer++)
+				{
+					glBindFramebuffer(GL_FRAMEBUFFER, this->getLayerFramebuffer(color, depth_count > 0 ? depth : UINT32_MAX, layer));
+					glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->images[0][color].image, 0, layer);
+					if (depth_count > 0)
+					{
+						glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->depth_images[0][depth].image, 0, layer);
+					}
+				}
+			}
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return true;
+}
+
+GLuint XrProgram::getLayerFramebuffer(uint32_t color_index, uint32_t depth_index, int layer)
+{
+	int layer_count = static_cast<int>(this->multires.layer_framebuffers.size());
+	uint32_t pair = depth_index == UINT32_MAX ? color_index : color_index * this->getDepthImageCount(0) + depth_index;
+	return this->multires.image_layer_framebuffers[pair * layer_count + layer];
+}
+
+void XrProgram::addGpuPasses()
+{
+	//Names have to outlive the timer
+	static const char* swapchain_names[] = { "swapchain 0", "swapchain 1", "swapchain 2", "swapchain 3" };
+
+	int swapchain_count = static_cast<int>(this->swapchains.size());
+	this->gpu_passes.swapchains.resize(swapchain_count);
+	for (int i = 0; i < swapchain_count; i++)
+	{
+		this->gpu_passes.swapchains[i] = i < 4 ? this->gpu_timer.addPass(swapchain_names[i]) : -1;
+	}
+
+	if (this->multires.enabled)
+	{
+		this->gpu_passes.periphery = this->gpu_timer.addPass("multires periphery");
+		this->gpu_passes.upsample = this->gpu_timer.addPass("multires upsample");
+		this->gpu_passes.inner = this->gpu_timer.addPass("multires inner");
+	}
+}
+
+bool XrProgram::collectFrameStats()
+{
+	GpuTimer::FrameTimes times;
+	if (!this->gpu_timer.collect(&times))
+	{
+		return false;
+	}
+
+	//Pair the GPU time with the CPU time recorded for the same frame
+	int cpu_slot = times.frame % GpuTimer::FRAME_LATENCY;
+	this->frame_stats.frame = times.frame;
+	this->frame_stats.gpu_ms = times.frame_ms;
+	this->frame_stats.cpu_ms = this->frame_stats.cpu_frame_ms[cpu_slot];
+	this->frame_stats.cpu_render_ms = this->frame_stats.cpu_render_frame_ms[cpu_slot];
+	for (int pass = 0; pass < GpuTimer::MAX_PASSES; pass++)
+	{
+		this->frame_stats.pass_ms[pass] = times.pass_timed[pass] ? times.pass_ms[pass] : -1.0;
+	}
+
+	this->frame_stats.gpu_bound = this->frame_stats.gpu_ms > this->frame_stats.cpu_ms;
+	if (this->frame_stats.gpu_bound)
+	{
+		this->frame_stats.gpu_bound_frames++;
+	}
+	else
+	{
+		this->frame_stats.cpu_bound_frames++;
+	}
+	return true;
+}
+
+uint32_t XrProgram::getDepthImageCount(int swapchain)
+{
+	if (swapchain >= static_cast<int>(this->depth_images.size()))
+	{
+		return 0;
+	}
+	return static_cast<uint32_t>(this->depth_images[swapchain].size());
+}
+
+GLuint XrProgram::getFramebuffer(int swapchain, uint32_t color_index, uint32_t depth_index)
+{
+	if (depth_index == UINT32_MAX)
+	{
+		return this->framebuffers[swapchain][color_index];
+	}
+	return this->framebuffers[swapchain][color_index * this->getDepthImageCount(swapchain) + depth_index];
+}
+
+bool XrProgram::genFences()
+{
+	int swapchain_count = static_cast<int>(this->images.size());
+	this->image_fences.resize(swapchain_count);
+	for (int i = 0; i < swapchain_count; i++)
+	{
+		this->image_fences[i].resize(this->images[i].size(), nullptr);
+	}
+	return true;
+}
+
+bool XrProgram::waitImageFence(int view, uint32_t image_index)
+{
+	GLsync fence = this->image_fences[view][image_index];
+	if (fence == nullptr)
+	{
+		return true;
+	}
+
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, this->fence_timeout);
+	if (result == GL_WAIT_FAILED || result == GL_TIMEOUT_EXPIRED)
+	{
+		printf("Timed out waiting on fence for view %d image %u\n", view, image_index);
+		return false;
+	}
+
+	glDeleteSync(fence);
+	this->image_fences[view][image_index] = nullptr;
+	return true;
+}
+
+void XrProgram::placeImageFence(int view, uint32_t image_index)
+{
+	if (this->image_fences[view][image_index] != nullptr)
+	{
+		glDeleteSync(this->image_fences[view][image_index]);
+	}
+	this->image_fences[view][image_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	//Hand the commands to the GPU now so the next eye queues behind them instead of waiting on them. With late latching
+	//the frame is held back until the views are located again, otherwise the GPU is already drawing with the old ones
+	if (!this->late_latch.enabled)
+	{
+		glFlush();
+	}
+}
+
+bool XrProgram::beginSession() 
+{
+	XrSessionBeginInfo session_begin_info;
+	session_begin_info.type = XR_TYPE_SESSION_BEGIN_INFO;
+	session_begin_info.next = NULL;
+	session_begin_info.primaryViewConfigurationType = this->view_type;
+	if (!checkXrResult(xrBeginSession(this->session, &session_begin_info)))
+	{
+		printf("Unable to begin session\n");
+		return false;
+	}
+	this->session_running = true;
+
+	if (this->pacing_thread && !this->frame_pacer.start(this->session))
+	{
+		printf("Unable to start frame pacing thread\n");
+		return false;
+	}
+	return true;
+}
+
+bool XrProgram::endSession()
+{
+	//The pacing thread waits on and begins frames, it has to be out of the session first
+	this->frame_pacer.stop();
+
+	this->session_running = false;
+	if (!checkXrResult(xrEndSession(this->session)))
+	{
+		printf("Unable to end session\n");
+		return false;
+	}
+	return true;
+}
+
+bool XrProgram::isSessionRunning()
+{
+	return this->session_running;
+}
+
+bool XrProgram::submitEmptyFrame(XrTime display_time, uint64_t frame)
+{
+	if (!this->pacing_thread)
+	{
+		if (!this->checkXrResult(xrBeginFrame(this->session, &this->frame_data.begin_info)))
+		{
+			printf("Couldn't begin frame\n");
+			return false;
+		}
+	}
+
+	//Nothing is drawn, the frame is only ended to keep the frame loop in step with the runtime
+	int64_t phase_start = FrameTelemetry::now();
+	this->frame_data.end_info.displayTime = display_time;
+	this->frame_data.end_info.layerCount = 0;
+	if (!this->checkXrResult(xrEndFrame(this->session, &this->frame_data.end_info)))
+	{
+		printf("Unable to End Frame\n");
+		return false;
+	}
+	this->telemetry.record(PHASE_END_FRAME, frame, phase_start);
+
+	if (this->pacing_thread)
+	{
+		this->frame_pacer.frameEnded();
+	}
+
+	//Input and the desktop window still get their share of the frame while nothing is rendered
+	this->updateNonXrDeadline();
+	this->frame_count++;
+	return true;
+}
+
+bool XrProgram::XrMainFunction() 
+{
+#ifdef _DEBUG
+	uint64_t allocations_before = AllocCounter::threadAllocations();
+#endif
+
+	uint64_t frame = this->frame_count;
+	int64_t phase_start = FrameTelemetry::now();
+
+	//this->depth_swapchain_format = -1;
+	if (!this->checkEvents())
+	{
+		return false;
+	}
+	this->telemetry.record(PHASE_CHECK_EVENTS, frame, phase_start);
+	if (this->xr_shutdown == true)
+	{
+		return false;
+	}
+
+	//Frames can only be waited on between READY and STOPPING, main_loop idles until then
+	if (!this->session_running)
+	{
+		return true;
+	}
+
+	// Get FrameState
+	XrFrameState frame_state;
+	frame_state.type = XR_TYPE_FRAME_STATE;
+	frame_state.next = XR_NULL_HANDLE;
+
+	phase_start = FrameTelemetry::now();
+	if (this->pacing_thread)
+	{
+		//The pacing thread has already waited on and begun this frame, it records those phases itself
+		if (!this->frame_pacer.acquireFrame(&frame_state))
+		{
+			printf("Frame pacing stopped\n");
+			return false;
+		}
+		this->telemetry.record(PHASE_ACQUIRE_FRAME, frame, phase_start);
+	}
+	else
+	{
+		if (!this->checkXrResult(xrWaitFrame(this->session, &this->frame_data.wait_info, &frame_state)))
+		{
+			printf("Unable to get Frame State\n");
+			return false;
+		}
+		this->telemetry.record(PHASE_WAIT_FRAME, frame, phase_start);
+	}
+
+	this->frame_timing.frame_start_ns = FrameTelemetry::now();
+	this->frame_timing.period_ns = frame_state.predictedDisplayPeriod;
+
+	//The runtime isn't showing this frame, eg the session is only SYNCHRONIZED, so don't render anything for it
+	if (!frame_state.shouldRender)
+	{
+		return this->submitEmptyFrame(frame_state.predictedDisplayTime, frame);
+	}
+
+	if (this->frame_timing.just_in_time)
+	{
+		phase_start = FrameTelemetry::now();
+		this->waitJustInTime(frame_state.predictedDisplayTime, frame_state.predictedDisplayPeriod);
+		this->telemetry.record(PHASE_JUST_IN_TIME, frame, phase_start);
+	}
+
+	//Everything from here to xrEndFrame is CPU work for this frame, apart from waiting on swapchain images
+	int64_t cpu_start = FrameTelemetry::now();
+	int64_t cpu_wait_ns = 0;
+	int64_t cpu_render_ns = 0;
+
+	//Resize the rendered part of each swapchain image to keep the GPU inside its frame budget
+	if (this->collectFrameStats())
+	{
+		float scale = this->dynamic_resolution.update(this->frame_stats.gpu_ms, frame_state.predictedDisplayPeriod / 1000000.0);
+		if (scale != this->render_scale)
+		{
+			this->updateViewRects(scale);
+		}
+	}
+
+	this->frame_data.view_locate_info.displayTime = frame_state.predictedDisplayTime;
+
+	phase_start = FrameTelemetry::now();
+	uint32_t view_count = static_cast<uint32_t>(this->frame_data.views.size());
+	if (!this->checkXrResult(xrLocateViews(this->session, &this->frame_data.view_locate_info, &this->frame_data.view_state, view_count, &view_count, this->frame_data.views.data()))) 
+	{
+		printf("Couldn't Locate Views\n");
+		return false;
+	}
+	this->telemetry.record(PHASE_LOCATE_VIEWS, frame, phase_start);
+
+	if (!this->pacing_thread)
+	{
+		phase_start = FrameTelemetry::now();
+		if (!this->checkXrResult(xrBeginFrame(this->session, &this->frame_data.begin_info))) 
+		{
+			printf("Couldn't begin frame\n");
+			return false;
+		}
+		this->telemetry.record(PHASE_BEGIN_FRAME, frame, phase_start);
+	}
+
+	//Actual Creation of projection and View Matrix, every view up front since multiview draws them all in one pass
+	XrView* views = this->frame_data.views.data();
+	XrMatrix4x4f* projection_matrices = this->frame_data.projection_matrices.data();
+	XrMatrix4x4f* view_matrices = this->frame_data.view_matrices.data();
+	XrMatrix4x4f* vp_matrices = this->frame_data.vp_matrices.data();
+	for (uint32_t i = 0; i < view_count; i++)
+	{
+		//The fov hardly ever changes, so only rebuild the projection when it does
+		if (memcmp(&this->frame_data.fovs[i], &views[i].fov, sizeof(XrFovf)) != 0)
+		{
+			XrMatrix4x4f_CreateProjectionFov(&projection_matrices[i], GRAPHICS_OPENGL, views[i].fov, near_z, far_z);
+			this->frame_data.fovs[i] = views[i].fov;
+		}
+		XrMatrix4x4f_CreateViewMatrix(&view_matrices[i], &views[i].pose.position, &views[i].pose.orientation);
+		XrMatrix4x4f_Multiply(&vp_matrices[i], &projection_matrices[i], &view_matrices[i]);
+
+		this->projection_views[i].fov = views[i].fov;
+		this->projection_views[i].pose = views[i].pose;
+	}
 
-		uint32_t index;
-		if (!this->checkXrResult(xrAcquireSwapchainImage(this->swapchains[i], &swapchain_image_aquire_info, &index))) 
+	if (this->late_latch.enabled)
+	{
+		if (!this->late_latch.ring.beginFrame())
 		{
-			printf("Unable to aquire swapchain Image Index");
 			return false;
 		}
+		uint8_t* slot = (uint8_t*)this->late_latch.ring.getSlot();
+		memcpy(slot, vp_matrices, view_count * sizeof(XrMatrix4x4f));
+		*(uint32_t*)(slot + this->late_latch.published_set_offset) = 0;
+		this->late_latch.ring.bind(VIEW_BUFFER_BINDING);
+
+		//The GPU picks the set for the whole frame with one copy ahead of the draws. The server waits on the fence first,
+		//so while the fence is unsignaled the copy hasn't started and will see whatever set is published by then
+		if (this->late_latch.draw_fence != nullptr)
+		{
+			glDeleteSync(this->late_latch.draw_fence);
+		}
+		this->late_latch.draw_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glWaitSync(this->late_latch.draw_fence, 0, GL_TIMEOUT_IGNORED);
+		this->late_latch.ring.copyInSlot(this->late_latch.published_set_offset, this->late_latch.view_set_offset, sizeof(uint32_t));
+		if (this->late_latch.copy_fence != nullptr)
+		{
+			glDeleteSync(this->late_latch.copy_fence);
+		}
+		this->late_latch.copy_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
 
-		XrSwapchainImageWaitInfo swapchain_image_wait_info;
-		swapchain_image_wait_info.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO;
-		swapchain_image_wait_info.next = XR_NULL_HANDLE;
-		swapchain_image_wait_info.timeout = 1000;
+	//Objects moved since last frame get their model matrices before any view draws them
+	if (this->scene != nullptr)
+	{
+		phase_start = FrameTelemetry::now();
+		this->scene->update();
 
-		if (!this->checkXrResult(xrWaitSwapchainImage(this->swapchains[i], &swapchain_image_wait_info))) 
+		//Culled once against a frustum covering every view, all the views draw from the same list
+		this->culler.setViews(views, view_count, this->near_z, this->far_z);
+		uint32_t object_count = this->scene->getCount();
+		if (this->gpu_culling.enabled)
 		{
-			printf("Unable to wait for swapchain image\n");
+			//Only moved objects are uploaded, testing and compacting happens in the cull shader
+			GLuint views_per_instance = this->stereo_mode == STEREO_MODE_INSTANCED ? view_count : 1;
+			this->gpu_culling.culler.update(this->scene);
+			this->gpu_culling.culler.cull(this->culler.getFrusta(), this->culler.getFrustumCount(), views_per_instance);
+			if (this->gpu_culling.verify)
+			{
+				this->culler.cull(this->scene->bounds.data(), object_count);
+				this->gpu_culling.culler.verify(this->scene, this->culler.visible.data(), this->culler.visible_count, views_per_instance);
+			}
+		}
+		else
+		{
+			if (this->bvh.enabled && object_count >= this->bvh.min_objects)
+			{
+				this->bvh.tree.update(this->scene);
+				this->culler.cull(this->bvh.tree, this->scene->bounds.data());
+			}
+			else
+			{
+				this->culler.cull(this->scene->bounds.data(), object_count);
+			}
+			if (this->instancing.enabled)
+			{
+				this->instancing.buffer.update(this->scene, this->culler.visible.data(), this->culler.visible_count);
+			}
+		}
+		this->telemetry.record(PHASE_SCENE, frame, phase_start);
+	}
+
+	if (this->visibility_mask.enabled && this->visibility_mask.dirty && !this->updateVisibilityMask())
+	{
+		printf("Unable to get the visibility mask, hidden areas will be shaded\n");
+		this->visibility_mask.enabled = false;
+	}
+
+	//Only rendered frames tick the GPU timer, so their CPU times are kept under its frame number rather than frame_count
+	uint64_t timed_frame = this->gpu_timer.getFrame();
+	this->gpu_timer.beginFrame();
+
+	this->multires.stats.shaded_pixels = 0;
+	this->multires.stats.full_pixels = 0;
+
+	bool mirroring = this->mirror.beginFrame();
+
+	//One swapchain per view, or a single swapchain holding every view with multiview and instanced stereo
+	uint32_t swapchain_count = static_cast<uint32_t>(this->swapchains.size());
+	for (uint32_t i = 0; i < swapchain_count; i++) 
+	{
+		//Wait to aquire swapchain info
+		phase_start = FrameTelemetry::now();
+		uint32_t index;
+		if (!this->checkXrResult(xrAcquireSwapchainImage(this->swapchains[i], &this->frame_data.acquire_info, &index))) 
+		{
+			printf("Unable to aquire swapchain Image Index");
 			return false;
 		}
 
 		uint32_t depth_index = UINT32_MAX;
-		if (this->depth_swapchain_format != -1) 
+		bool has_depth = this->getDepthImageCount(i) > 0;
+		if (has_depth)
 		{
 			//Wait to aquire swapchain info
-			XrSwapchainImageAcquireInfo depth_swapchain_image_aquire_info;
-			depth_swapchain_image_aquire_info.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO;
-			depth_swapchain_image_aquire_info.next = XR_NULL_HANDLE;
-
-			if (!this->checkXrResult(xrAcquireSwapchainImage(this->depth_swapchains[i], &depth_swapchain_image_aquire_info, &depth_index)))
+			if (!this->checkXrResult(xrAcquireSwapchainImage(this->depth_swapchains[i], &this->frame_data.acquire_info, &depth_index)))
 			{
 				printf("Unable to aquire depth swapchain Image Index");
 				return false;
 			}
+		}
+		this->telemetry.record(PHASE_ACQUIRE_IMAGE, frame, phase_start, i);
+
+		phase_start = FrameTelemetry::now();
+		if (!this->checkXrResult(xrWaitSwapchainImage(this->swapchains[i], &this->frame_data.image_wait_info))) 
+		{
+			printf("Unable to wait for swapchain image\n");
+			return false;
+		}
 
-			XrSwapchainImageWaitInfo depth_swapchain_image_wait_info;
-			depth_swapchain_image_wait_info.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO;
-			depth_swapchain_image_wait_info.next = XR_NULL_HANDLE;
-			depth_swapchain_image_wait_info.timeout = 1000;
-			if (!this->checkXrResult(xrWaitSwapchainImage(this->depth_swapchains[i], &depth_swapchain_image_wait_info)))
+		if (has_depth)
+		{
+			if (!this->checkXrResult(xrWaitSwapchainImage(this->depth_swapchains[i], &this->frame_data.image_wait_info)))
 			{
 				printf("Unable to wait for depth swapchain image\n");
 				return false;
 			}
 		}
-		this->projection_views[i].fov = views[i].fov;
-		this->projection_views[i].pose = views[i].pose;
 
-		GLuint depth_image = this->depth_swapchain_format != -1 ? this->depth_images[i][depth_index].image : UINT32_MAX;
+		if (this->pipelined_release && !this->waitImageFence(i, index))
+		{
+			return false;
+		}
+		this->telemetry.record(PHASE_WAIT_IMAGE, frame, phase_start, i);
+		cpu_wait_ns += FrameTelemetry::now() - phase_start;
+
+		//The framebuffer for this pairing of color and depth image was built up front
+		GLuint framebuffer = this->getFramebuffer(i, index, depth_index);
+
+		int width = this->render_extents[i].width;
+		int height = this->render_extents[i].height;
 
-		bool result = renderFrame(this->xr_config_views[i].recommendedImageRectWidth, this->xr_config_views[i].recommendedImageRectHeight, Projection_matrix, view_matrix, this->framebuffers[i][index], depth_image, this->images[i][index], frame_state.predictedDisplayTime);
+		phase_start = FrameTelemetry::now();
+		this->gpu_timer.beginPass(this->gpu_passes.swapchains[i]);
+		bool result;
+		if (this->multires.enabled)
+		{
+			result = renderMultires(i, index, depth_index, width, height, frame_state.predictedDisplayTime);
+		}
+		else
+		{
+			result = renderPass(i, framebuffer, width, height, frame_state.predictedDisplayTime);
+		}
+		this->gpu_timer.endPass(this->gpu_passes.swapchains[i]);
 		if (!result) 
 		{
 			printf("unable to render frame\n");
 			return false;
 		}
-		//Wait for all openGL calls to be done before contiuing
-		glFinish();
 
-		XrSwapchainImageReleaseInfo swapchain_image_release_info;
-		swapchain_image_release_info.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO;
-		swapchain_image_release_info.next = XR_NULL_HANDLE;
+		//Copy the views out for the desktop window while the image is still ours, the fence below covers the copy too
+		if (mirroring)
+		{
+			this->mirrorSwapchain(i, index);
+		}
+
+		if (this->pipelined_release)
+		{
+			this->placeImageFence(i, index);
+		}
+		else
+		{
+			//Wait for all openGL calls to be done before contiuing
+			glFinish();
+		}
+		this->telemetry.record(PHASE_RENDER, frame, phase_start, i);
+		cpu_render_ns += FrameTelemetry::now() - phase_start;
 
-		if (!this->checkXrResult(xrReleaseSwapchainImage(this->swapchains[i], &swapchain_image_release_info))) 
+		phase_start = FrameTelemetry::now();
+		if (!this->checkXrResult(xrReleaseSwapchainImage(this->swapchains[i], &this->frame_data.release_info))) 
 		{
 			printf("Unable to release swapchain Image\n");
 			return false;
 		}
 		
-		if (this->depth_swapchain_format != -1) 
+		if (has_depth)
 		{
-			XrSwapchainImageReleaseInfo depth_swapchain_image_release_info;
-			depth_swapchain_image_release_info.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO;
-			depth_swapchain_image_release_info.next = XR_NULL_HANDLE;
-
-			if (!this->checkXrResult(xrReleaseSwapchainImage(this->depth_swapchains[i], &depth_swapchain_image_release_info)))
+			if (!this->checkXrResult(xrReleaseSwapchainImage(this->depth_swapchains[i], &this->frame_data.release_info)))
 			{
 				printf("Unable to release depth swapchain Image\n");
 				return false;
 			}
 		}
+		this->telemetry.record(PHASE_RELEASE_IMAGE, frame, phase_start, i);
 	}
 
-	XrCompositionLayerProjection projection_layer;
-	projection_layer.type = XR_TYPE_COMPOSITION_LAYER_PROJECTION;
-	projection_layer.next = XR_NULL_HANDLE;
-	projection_layer.layerFlags = 0;
-	projection_layer.space = this->reference_space;
-	projection_layer.viewCount = view_count;
-	projection_layer.views = this->projection_views.data();
+	//UI layers only draw when their content changes, the compositor resamples their last image every other frame
+	phase_start = FrameTelemetry::now();
+	uint32_t layer_count = 1;
+	bool layers_updated = true;
+	for (UiLayer* layer : this->ui_layers)
+	{
+		//The frame has been begun, so it is still ended with the layers gathered so far before the error is returned
+		if (!layer->update(frame))
+		{
+			layers_updated = false;
+			break;
+		}
+		XrCompositionLayerBaseHeader* header = layer->getLayer();
+		if (header != nullptr)
+		{
+			this->frame_data.layers[layer_count] = header;
+			layer_count++;
+		}
+	}
+	this->frame_data.end_info.layerCount = layer_count;
+	this->telemetry.record(PHASE_UI_LAYERS, frame, phase_start);
+
+	this->gpu_timer.endFrame();
 
-	XrCompositionLayerBaseHeader* composition_layers[1];
-	composition_layers[0] = (XrCompositionLayerBaseHeader *)&projection_layer;
-	XrFrameEndInfo frame_end_info;
-	frame_end_info.type = XR_TYPE_FRAME_END_INFO;
-	frame_end_info.next = NULL;
-	frame_end_info.displayTime = frame_state.predictedDisplayTime;
-	frame_end_info.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
-	frame_end_info.layerCount = 1;
-	frame_end_info.layers = composition_layers;
+	if (this->late_latch.enabled)
+	{
+		this->late_latch.ring.endFrame();
+
+		//Locate the views again as close to submission as possible and publish them to the draws the GPU hasn't run yet,
+		//then let the GPU start on the frame
+		phase_start = FrameTelemetry::now();
+		this->lateLatchViews();
+		glFlush();
+		this->telemetry.record(PHASE_LATE_LATCH, frame, phase_start);
+	}
 
-	if (!this->checkXrResult(xrEndFrame(this->session, &frame_end_info))) 
+	this->frame_data.end_info.displayTime = frame_state.predictedDisplayTime;
+
+	phase_start = FrameTelemetry::now();
+	if (!this->checkXrResult(xrEndFrame(this->session, &this->frame_data.end_info))) 
 	{
 		printf("Unable to End Frame\n");
 		return false;
 	}
+	this->telemetry.record(PHASE_END_FRAME, frame, phase_start);
+
+	//Kept until the GPU timings of this frame come back
+	int cpu_slot = timed_frame % GpuTimer::FRAME_LATENCY;
+	this->frame_stats.cpu_frame_ms[cpu_slot] = (FrameTelemetry::now() - cpu_start - cpu_wait_ns) / 1000000.0;
+	this->frame_stats.cpu_render_frame_ms[cpu_slot] = cpu_render_ns / 1000000.0;
+
+	if (this->pacing_thread)
+	{
+		this->frame_pacer.frameEnded();
+	}
+
+	if (!layers_updated)
+	{
+		return false;
+	}
+
+	this->updateNonXrDeadline();
+
+	//Swapping after xrEndFrame, with vsync off, so the window never delays the submission
+	if (mirroring)
+	{
+		phase_start = FrameTelemetry::now();
+		this->mirror.present();
+		this->telemetry.record(PHASE_MIRROR, frame, phase_start);
+	}
+
+	this->frame_count++;
+
+#ifdef _DEBUG
+	//Once the first frames have settled, nothing in the frame loop may touch the heap
+	assert(this->frame_count <= this->warmup_frames || AllocCounter::threadAllocations() == allocations_before);
+#endif
+
+	return true;
+}
+
+bool XrProgram::renderPass(int swapchain, GLuint framebuffer, int width, int height, XrTime predicted_time)
+{
+	if (this->stereo_mode == STEREO_MODE_MULTIVIEW)
+	{
+		return renderFrameMultiview(width, height, this->frame_data.vp_matrices.data(), framebuffer, predicted_time);
+	}
+	else if (this->stereo_mode == STEREO_MODE_INSTANCED)
+	{
+		return renderFrameInstanced(width, height, this->frame_data.vp_matrices.data(), framebuffer, predicted_time);
+	}
+	return renderFrame(width, height, this->frame_data.projection_matrices[swapchain], this->frame_data.view_matrices[swapchain], framebuffer, predicted_time, swapchain);
+}
+
+XrRect2Di XrProgram::getInnerRect(int view)
+{
+	XrRect2Di rect = this->projection_views[view].subImage.imageRect;
+	XrFovf fov = this->projection_views[view].fov;
+
+	//Centre on where the view direction lands, the fov is usually asymmetric so that isn't the middle of the image
+	float tan_left = tanf(fov.angleLeft);
+	float tan_right = tanf(fov.angleRight);
+	float tan_down = tanf(fov.angleDown);
+	float tan_up = tanf(fov.angleUp);
+	float center_x = -tan_left / (tan_right - tan_left);
+	float center_y = -tan_down / (tan_up - tan_down);
+
+	XrRect2Di inner;
+	inner.extent.width = (int32_t)(rect.extent.width * this->multires.inner_fraction);
+	inner.extent.height = (int32_t)(rect.extent.height * this->multires.inner_fraction);
+	inner.offset.x = (int32_t)(rect.extent.width * center_x) - inner.extent.width / 2;
+	inner.offset.y = (int32_t)(rect.extent.height * center_y) - inner.extent.height / 2;
+
+	//Keep it inside the view
+	if (inner.offset.x < 0)
+	{
+		inner.offset.x = 0;
+	}
+	if (inner.offset.y < 0)
+	{
+		inner.offset.y = 0;
+	}
+	if (inner.offset.x + inner.extent.width > rect.extent.width)
+	{
+		inner.offset.x = rect.extent.width - inner.extent.width;
+	}
+	if (inner.offset.y + inner.extent.height > rect.extent.height)
+	{
+		inner.offset.y = rect.extent.height - inner.extent.height;
+	}
+
+	inner.offset.x += rect.offset.x;
+	inner.offset.y += rect.offset.y;
+	return inner;
+}
+
+bool XrProgram::renderMultires(int swapchain, uint32_t index, uint32_t depth_index, int width, int height, XrTime predicted_time)
+{
+	bool multiview = this->stereo_mode == STEREO_MODE_MULTIVIEW;
+	bool instanced = this->stereo_mode == STEREO_MODE_INSTANCED;
+	int view_count = static_cast<int>(this->projection_views.size());
+	int layer_count = multiview ? view_count : 1;
+	bool has_depth = depth_index != UINT32_MAX;
+	GLuint framebuffer = this->getFramebuffer(swapchain, index, depth_index);
+
+	//Draw the whole view at reduced resolution
+	int low_width = (int)(width * this->multires.periphery_scale);
+	int low_height = (int)(height * this->multires.periphery_scale);
+	this->gpu_timer.beginPass(this->gpu_passes.periphery);
+	if (!renderPass(swapchain, this->multires.framebuffer, low_width, low_height, predicted_time))
+	{
+		return false;
+	}
+	this->gpu_timer.endPass(this->gpu_passes.periphery);
+	this->gpu_timer.beginPass(this->gpu_passes.upsample);
+
+	//Upsample it over the whole swapchain image, depth comes along so the runtime still gets a usable depth image
+	for (int layer = 0; layer < layer_count; layer++)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, multiview ? this->multires.layer_framebuffers[layer] : this->multires.framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, multiview ? this->getLayerFramebuffer(index, depth_index, layer) : framebuffer);
+		glBlitFramebuffer(0, 0, low_width, low_height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		if (has_depth)
+		{
+			glBlitFramebuffer(0, 0, low_width, low_height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	this->gpu_timer.endPass(this->gpu_passes.upsample);
+
+	//Redraw only the inner region at full resolution
+	glEnable(GL_SCISSOR_TEST);
+	uint64_t inner_pixels = 0;
+	if (instanced)
+	{
+		//glClear only goes through scissor 0, so each eye's inner region is cleared here, otherwise the upsampled depth
+		//left in the other eye's region would reject its full resolution redraw
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		for (int i = view_count - 1; i >= 0; i--)
+		{
+			XrRect2Di inner = this->getInnerRect(i);
+			glScissorIndexed(0, inner.offset.x, inner.offset.y, inner.extent.width, inner.extent.height);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glScissorIndexed(i, inner.offset.x, inner.offset.y, inner.extent.width, inner.extent.height);
+			inner_pixels += (uint64_t)inner.extent.width * inner.extent.height;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	else
+	{
+		//The pass's clear respects the scissor. Multiview's layers share one scissor, so it covers every view's inner region
+		//in its own layer, instanced stereo without the viewport array never gets here
+		int first_view = (multiview || instanced) ? 0 : swapchain;
+		int last_view = (multiview || instanced) ? view_count - 1 : swapchain;
+		XrRect2Di bounds = this->getInnerRect(first_view);
+		int32_t right = bounds.offset.x + bounds.extent.width;
+		int32_t top = bounds.offset.y + bounds.extent.height;
+		for (int i = first_view + 1; i <= last_view; i++)
+		{
+			XrRect2Di inner = this->getInnerRect(i);
+			if (inner.offset.x < bounds.offset.x)
+			{
+				bounds.offset.x = inner.offset.x;
+			}
+			if (inner.offset.y < bounds.offset.y)
+			{
+				bounds.offset.y = inner.offset.y;
+			}
+			if (inner.offset.x + inner.extent.width > right)
+			{
+				right = inner.offset.x + inner.extent.width;
+			}
+			if (inner.offset.y + inner.extent.height > top)
+			{
+				top = inner.offset.y + inner.extent.height;
+			}
+		}
+		glScissor(bounds.offset.x, bounds.offset.y, right - bounds.offset.x, top - bounds.offset.y);
+		inner_pixels = (uint64_t)(right - bounds.offset.x) * (top - bounds.offset.y) * layer_count;
+	}
+
+	this->gpu_timer.beginPass(this->gpu_passes.inner);
+	bool result = renderPass(swapchain, framebuffer, width, height, predicted_time);
+	glDisable(GL_SCISSOR_TEST);
+	this->gpu_timer.endPass(this->gpu_passes.inner);
+
+	this->multires.stats.shaded_pixels += (uint64_t)low_width * low_height * layer_count + inner_pixels;
+	this->multires.stats.full_pixels += (uint64_t)width * height * layer_count;
+	return result;
+}
+
+void XrProgram::drawScene(GLint model_location, GLint color_location, GLsizei instance_count, const glm::mat4* view_projection)
+{
+	if (this->scene == nullptr)
+	{
+		return;
+	}
+
+	Scene* scene = this->scene;
+	if (this->gpu_culling.enabled)
+	{
+		//Counts and instances were written by the cull shader, the CPU doesn't know what is visible
+		this->gpu_culling.culler.draw(scene, instance_count);
+		return;
+	}
+	if (this->instancing.enabled)
+	{
+		//The program takes transforms and colors per instance, the uniforms aren't there
+		this->instancing.buffer.draw(scene, instance_count);
+		return;
+	}
+
+	const uint32_t* visible = this->culler.visible.data();
+	uint32_t count = this->culler.visible_count;
+	for (uint32_t j = 0; j < count; j++)
+	{
+		uint32_t i = visible[j];
+		if (view_projection != nullptr)
+		{
+			glm::mat4 mvp = *view_projection * scene->model_matrices[i];
+			glUniformMatrix4fv(model_location, 1, GL_FALSE, &mvp[0][0]);
+		}
+		else
+		{
+			glUniformMatrix4fv(model_location, 1, GL_FALSE, &scene->model_matrices[i][0][0]);
+		}
+		glUniform3fv(color_location, 1, &scene->materials[scene->material_ids[i]].color[0]);
+		scene->meshes[scene->mesh_ids[i]].geometry->drawGeometry(instance_count);
+	}
+}
+
+bool XrProgram::renderFrame(int width, int height, XrMatrix4x4f perspective_matrix, XrMatrix4x4f view_matrix, GLuint framebuffer, XrTime predicted_time, int view_index)
+{
+	//Bind the framebuffer to openGL
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	glViewport(0, 0, width, height);
+
+	//Clear the framebuffer, its images were attached once in genFrameBuffers
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	this->drawVisibilityMask(view_index, 1);
+
+	if (this->late_latch.enabled)
+	{
+		//The matrix comes from the view buffer, which can still be rewritten before the frame ends
+		glUseProgram(this->late_latch.per_view_shader->getProgram());
+		glUniform1i(this->late_latch.view_index_location, view_index);
+		this->drawScene(this->late_latch.model_location, this->late_latch.color_location, 1, nullptr);
+	}
+	else
+	{
+		XrMatrix4x4f vp_matrix_xr;
+		XrMatrix4x4f_Multiply(&vp_matrix_xr, &perspective_matrix, &view_matrix);
+		if (this->instancing.enabled)
+		{
+			glUseProgram(this->instancing.per_view_shader->getProgram());
+			glUniformMatrix4fv(this->instancing.view_projection_location, 1, GL_FALSE, vp_matrix_xr.m);
+			this->drawScene(-1, -1, 1, nullptr);
+		}
+		else
+		{
+			glm::mat4 vp_matrix = glm::make_mat4(vp_matrix_xr.m);
+			glUseProgram(Shader::default_shader->getProgram());
+			this->drawScene(this->per_view.mvp_location, this->per_view.color_location, 1, &vp_matrix);
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	return true;
 }
 
-bool XrProgram::renderFrame(int width, int height, XrMatrix4x4f perspective_matrix, XrMatrix4x4f view_matrix, GLuint framebuffer, GLuint depthbuffer, XrSwapchainImageOpenGLKHR image, XrTime predicted_time)
+bool XrProgram::renderFrameMultiview(int width, int height, const XrMatrix4x4f* vp_matrices, GLuint framebuffer, XrTime predicted_time)
 {
+	GLsizei view_count = static_cast<GLsizei>(this->xr_config_views.size());
+
 	//Bind the framebuffer to openGL
 	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
 	glViewport(0, 0, width, height);
-	glScissor(0, 0, width, height);
 
-	//Clear the framebuffer
+	//Clear the framebuffer, this clears every layer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	this->drawVisibilityMask(0, view_count);
+
+	//One draw covers both eyes, the shader picks the matrix with gl_ViewID_OVR
+	glUseProgram(this->multiview.shader->getProgram());
+	glUniformMatrix4fv(this->multiview.view_projection_location, view_count, GL_FALSE, vp_matrices[0].m);
+	this->drawScene(this->multiview.model_location, this->multiview.color_location, 1, nullptr);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return true;
+}
+
+bool XrProgram::renderFrameInstanced(int width, int height, const XrMatrix4x4f* vp_matrices, GLuint framebuffer, XrTime predicted_time)
+{
+	GLsizei view_count = static_cast<GLsizei>(this->xr_config_views.size());
+
+	//Bind the framebuffer to openGL, the one double wide image holds every view
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	glViewport(0, 0, width, height);
+
+	//Clear the framebuffer, both halves at once
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	//Attach depth buffers
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, image.image, 0);
-	if (depthbuffer != UINT32_MAX) {
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthbuffer, 0);
+	if (this->instanced.viewport_array)
+	{
+		//One viewport per view side by side, the shader routes each instance with gl_ViewportIndex
+		GLfloat view_width = (GLfloat)(width / view_count);
+		for (GLsizei i = 0; i < view_count; i++)
+		{
+			glViewportIndexedf(i, i * view_width, 0.0f, view_width, (GLfloat)height);
+		}
+	}
+	else
+	{
+		//The shader squashes each instance into its half and clips it against the middle
+		glEnable(GL_CLIP_DISTANCE0);
 	}
 
-	XrMatrix4x4f vp_matrix_xr;
-	XrMatrix4x4f_Multiply(&vp_matrix_xr, &perspective_matrix, &view_matrix);
-	glm::mat4 vp_matrix = glm::make_mat4(vp_matrix_xr.m);
-	this->square->draw(vp_matrix);
+	this->drawVisibilityMask(0, view_count);
+
+	//Instances alternate between eyes, so every object is drawn with view_count instances
+	glUseProgram(this->instanced.shader->getProgram());
+	glUniformMatrix4fv(this->instanced.view_projection_location, view_count, GL_FALSE, vp_matrices[0].m);
+	this->drawScene(this->instanced.model_location, this->instanced.color_location, view_count, nullptr);
+
+	if (!this->instanced.viewport_array)
+	{
+		glDisable(GL_CLIP_DISTANCE0);
+	}
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -699,14 +2254,38 @@ bool XrProgram::checkEvents()
 		case(XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING):
 			this->xr_shutdown = true;
 			break;
+		case(XR_TYPE_EVENT_DATA_VISIBILITY_MASK_CHANGED_KHR):
+			//Usually after an IPD change, fetch it again before the next frame draws
+			this->visibility_mask.dirty = true;
+			break;
 		case(XR_TYPE_EVENT_DATA_INTERACTION_PROFILE_CHANGED):
 
 			break;
 		case(XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED):
 			this->state = ((XrEventDataSessionStateChanged*)&runtime_event)->state;
-			if (this->state == XR_SESSION_STATE_STOPPING) 
+			switch (this->state)
 			{
+			case(XR_SESSION_STATE_READY):
+				//The runtime is ready for frames, begin the session and start pacing them
+				if (!this->beginSession())
+				{
+					return false;
+				}
+				break;
+			case(XR_SESSION_STATE_STOPPING):
+				//Stop submitting frames, the session goes back to IDLE and can be begun again on the next READY
+				if (!this->endSession())
+				{
+					return false;
+				}
+				break;
+			case(XR_SESSION_STATE_EXITING):
+			case(XR_SESSION_STATE_LOSS_PENDING):
 				this->xr_shutdown = true;
+				break;
+			default:
+				//IDLE, SYNCHRONIZED, VISIBLE and FOCUSED need nothing here, shouldRender tells frames whether to draw
+				break;
 			}
 			break;
 		default:
@@ -714,13 +2293,29 @@ bool XrProgram::checkEvents()
 		}
 
 		//Grab next event
-		XrEventDataBuffer runtime_event = { XR_TYPE_EVENT_DATA_BUFFER };
+		runtime_event = { XR_TYPE_EVENT_DATA_BUFFER };
 		runtime_event.next = NULL;
 		result = xrPollEvent(this->instance, &runtime_event);
 	}
 	return true;
 }
 
+bool XrProgram::waitForEvents(double timeout_seconds)
+{
+	//OpenXR has no blocking wait for events, so poll them at a low rate and sleep on the window's events in between
+	using clock = std::chrono::steady_clock;
+	auto deadline = clock::now() + std::chrono::duration<double>(timeout_seconds);
+	while (!this->session_running && !this->xr_shutdown && clock::now() < deadline)
+	{
+		glfwWaitEventsTimeout(this->idle_poll_interval);
+		if (!this->checkEvents())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 bool XrProgram::checkXrResult(XrResult result) 
 {
 	if (result != XR_SUCCESS) 
@@ -732,6 +2327,98 @@ bool XrProgram::checkXrResult(XrResult result)
 
 void XrProgram::destroy()
 {
+	//The pacing thread calls into the session, so it has to go first
+	this->frame_pacer.stop();
+
+	if (this->frame_timing.wait_timer != NULL)
+	{
+		CloseHandle(this->frame_timing.wait_timer);
+		this->frame_timing.wait_timer = NULL;
+	}
+	if (this->frame_timing.raised_timer_period)
+	{
+		timeEndPeriod(1);
+		this->frame_timing.raised_timer_period = false;
+	}
+
+	if (this->telemetry_trace_path != NULL)
+	{
+		this->telemetry.printPercentiles();
+		//How much of each view the mask kept from being shaded, -bench shows what that buys
+		if (this->visibility_mask.enabled)
+		{
+			for (size_t view = 0; view < this->visibility_mask.hidden_fraction.size(); view++)
+			{
+				printf("Visibility mask  view %zu hides %.1f%% of the image\n", view, this->visibility_mask.hidden_fraction[view] * 100.0f);
+			}
+		}
+		this->telemetry.exportChromeTrace(this->telemetry_trace_path);
+	}
+
+	this->gpu_timer.destroy();
+
+	this->instancing.buffer.destroy();
+	this->gpu_culling.culler.destroy();
+
+	this->mirror.destroy();
+
+	//The stereo and per view variants built in chooseStereoMode, the default shader belongs to the sample
+	Shader** shaders[] = { &this->multiview.shader, &this->instanced.shader, &this->late_latch.per_view_shader,
+		&this->instancing.per_view_shader, &this->visibility_mask.shader };
+	for (Shader** shader : shaders)
+	{
+		delete *shader;
+		*shader = nullptr;
+	}
+
+	if (this->visibility_mask.vao != 0)
+	{
+		glDeleteVertexArrays(1, &this->visibility_mask.vao);
+		glDeleteBuffers(1, &this->visibility_mask.vbo);
+	}
+
+	this->late_latch.ring.destroy();
+	if (this->late_latch.draw_fence != nullptr)
+	{
+		glDeleteSync(this->late_latch.draw_fence);
+		this->late_latch.draw_fence = nullptr;
+	}
+	if (this->late_latch.copy_fence != nullptr)
+	{
+		glDeleteSync(this->late_latch.copy_fence);
+		this->late_latch.copy_fence = nullptr;
+	}
+
+	if (this->multires.framebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &this->multires.framebuffer);
+		glDeleteFramebuffers(static_cast<GLsizei>(this->multires.layer_framebuffers.size()), this->multires.layer_framebuffers.data());
+		glDeleteFramebuffers(static_cast<GLsizei>(this->multires.image_layer_framebuffers.size()), this->multires.image_layer_framebuffers.data());
+		glDeleteTextures(1, &this->multires.color_texture);
+		glDeleteTextures(1, &this->multires.depth_texture);
+	}
+
+	for (int i = 0; i < this->framebuffers.size(); i++)
+	{
+		glDeleteFramebuffers(static_cast<GLsizei>(this->framebuffers[i].size()), this->framebuffers[i].data());
+	}
+
+	for (int i = 0; i < this->image_fences.size(); i++)
+	{
+		for (int j = 0; j < this->image_fences[i].size(); j++)
+		{
+			if (this->image_fences[i][j] != nullptr)
+			{
+				glDeleteSync(this->image_fences[i][j]);
+			}
+		}
+	}
+
+	for (UiLayer* layer : this->ui_layers)
+	{
+		layer->destroy();
+	}
+
 	for (int i = 0; i < this->swapchains.size(); i++)
 	{
 		if (this->swapchains[i] != XR_NULL_HANDLE)
@@ -18,7 +18,27 @@
 #include <string>
 #include <fstream>
 #include <vector>
-#include "square.hpp"
+#include "scene.hpp"
+#include "instancebuffer.hpp"
+#include "culling.hpp"
+#include "gpuculling.hpp"
+#include "shader.hpp"
+#include "framepacer.hpp"
+#include "alloccounter.hpp"
+#include "gputimer.hpp"
+#include "dynamicresolution.hpp"
+#include "frametelemetry.hpp"
+#include "uniformring.hpp"
+#include "uilayer.hpp"
+#include "mirror.hpp"
+
+//How the views of a stereo frame are rendered
+enum StereoMode
+{
+	STEREO_MODE_PER_VIEW,	//One swapchain and one pass over the scene per view
+	STEREO_MODE_MULTIVIEW,	//One array swapchain, every view drawn at once with OVR_multiview
+	STEREO_MODE_INSTANCED	//One double wide swapchain, every view drawn at once as alternating instances
+};
 
 class XrProgram
 {
@@ -27,7 +47,7 @@ private:
 
 	std::vector<char*> required_extensions{ (char*)XR_KHR_OPENGL_ENABLE_EXTENSION_NAME };
 	
-	std::vector<char*> optional_extensions{ (char*)XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME };
+	std::vector<char*> optional_extensions{ (char*)XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME, (char*)XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME, (char*)XR_KHR_WIN32_CONVERT_PERFORMANCE_COUNTER_TIME_EXTENSION_NAME, (char*)XR_KHR_VISIBILITY_MASK_EXTENSION_NAME };
 
 	std::vector<char*> enabled_extensions;
 
@@ -37,7 +57,8 @@ public:
 
 	XrInstance instance;
 
-	Square* square;
+	//What gets drawn into the projection layer, walked once per pass
+	Scene* scene = nullptr;
 
 	XrSession session;
 
@@ -57,9 +78,33 @@ public:
 
 	bool xr_shutdown = false;
 
-	// An array of arrays of framebuffers, one per texture/XR image
+	//Whether the session is between READY and STOPPING, frames can only be submitted then
+	bool session_running = false;
+
+	//How often events are polled while the session isn't running, in seconds
+	double idle_poll_interval = 0.1;
+
+	//The stereo mode to try for, createViews falls back from multiview to instanced to per view as support runs out
+	StereoMode stereo_mode = STEREO_MODE_MULTIVIEW;
+
+	// An array of arrays of framebuffers, one per pairing of color and depth image in each swapchain, complete and ready to bind
 	std::vector<std::vector<GLuint>> framebuffers;
 
+	//Run xrWaitFrame and xrBeginFrame on a pacing thread so they overlap rendering of the previous frame
+	bool pacing_thread = true;
+
+	//Set thread_priority and affinity_mask on this before init to place the pacing thread
+	FramePacer frame_pacer;
+
+	//Release swapchain images behind a fence instead of draining the GPU with glFinish
+	bool pipelined_release = true;
+
+	//Longest time in nanoseconds to block on an image's previous fence before rendering into it again
+	GLuint64 fence_timeout = 100000000;
+
+	//An array of arrays of fences, one per swapchain image, signalled once the last frame rendered into that image completes
+	std::vector<std::vector<GLsync>> image_fences;
+
 	//The preffered swapchain format
 	int64_t swapchain_format;
 
@@ -72,12 +117,54 @@ public:
 	//An array of arrays of images for depth info swapchain
 	std::vector<std::vector<XrSwapchainImageOpenGLKHR>> depth_images;
 
-	//an array of swapchains for the projection views, 1 swapchain per view
+	//an array of swapchains for the projection views, 1 swapchain per view (a single array swapchain with multiview)
 	std::vector<XrSwapchain> swapchains;
 
 	//an array of swapchains for the projectionViews Depth attachment
 	std::vector<XrSwapchain> depth_swapchains;
 
+	//The allocated size of each projection swapchain, shared by its depth swapchain
+	std::vector<XrExtent2Di> swapchain_extents;
+
+	//The part of each swapchain rendered to, smaller than swapchain_extents when dynamic resolution scales down
+	std::vector<XrExtent2Di> render_extents;
+
+	//The scale the image rects and render_extents were last built for
+	float render_scale = 1.0f;
+
+	//Measures whole frame and per pass GPU time without stalling on the results
+	GpuTimer gpu_timer;
+
+	//Timer pass ids, -1 when a pass isn't timed
+	struct {
+		std::vector<int> swapchains;
+		int periphery = -1;
+		int upsample = -1;
+		int inner = -1;
+	} gpu_passes;
+
+	//Timings of the newest frame the GPU has finished, a few frames behind the one being rendered
+	struct {
+		uint64_t frame = 0;
+		double gpu_ms = 0.0;
+		//CPU time from getting the frame state to xrEndFrame returning, not counting waits on swapchain images
+		double cpu_ms = 0.0;
+		//CPU time spent submitting draws, part of cpu_ms
+		double cpu_render_ms = 0.0;
+		//GPU time of each pass, named by gpu_timer.getPassName, -1 if it didn't run that frame
+		double pass_ms[GpuTimer::MAX_PASSES] = {};
+		//Whether the GPU took longer than the CPU over that frame
+		bool gpu_bound = false;
+		uint64_t gpu_bound_frames = 0;
+		uint64_t cpu_bound_frames = 0;
+		//CPU times of the frames still waiting on GPU results, indexed by the GPU timer's frame number
+		double cpu_frame_ms[GpuTimer::FRAME_LATENCY] = {};
+		double cpu_render_frame_ms[GpuTimer::FRAME_LATENCY] = {};
+	} frame_stats;
+
+	//Scales render_extents from measured GPU time, set its bounds and budget before init
+	DynamicResolution dynamic_resolution;
+
 	//An array of projection views, used for rendering to each eye
 	std::vector<XrCompositionLayerProjectionView>	projection_views;
 	
@@ -86,13 +173,217 @@ public:
 
 	struct {
 		bool supported = false;
+		//XR_KHR_composition_layer_depth was found and enabled on the instance
+		bool extension_enabled = false;
+		//Chain each view's depth into its projection view so the runtime can reproject positionally on a missed frame
+		bool submit = true;
 		std::vector<XrCompositionLayerDepthInfoKHR> depth_info;
 	} depth;
 
+	//Fixed foveated rendering: the whole view is drawn at reduced resolution and upsampled, then only an inner region is redrawn at full resolution
+	struct {
+		bool enabled = false;
+		//Size of the full resolution inner region, as a fraction of each view's width and height
+		float inner_fraction = 0.5f;
+		//Resolution of the periphery relative to the full image
+		float periphery_scale = 0.5f;
+		GLuint framebuffer = 0;
+		GLuint color_texture = 0;
+		GLuint depth_texture = 0;
+		//With multiview, a framebuffer per layer of the periphery and per layer of each swapchain image pairing, for blitting
+		std::vector<GLuint> layer_framebuffers;
+		std::vector<GLuint> image_layer_framebuffers;
+		//Pixels shaded last frame against what full resolution would have shaded
+		struct {
+			uint64_t shaded_pixels = 0;
+			uint64_t full_pixels = 0;
+		} stats;
+	} multires;
+
+	//Everything XrMainFunction needs per frame, allocated once in createViews so the steady state loop never touches the heap
+	struct {
+		XrFrameWaitInfo wait_info;
+		XrFrameBeginInfo begin_info;
+		XrFrameEndInfo end_info;
+		XrViewLocateInfo view_locate_info;
+		XrViewState view_state;
+		std::vector<XrView> views;
+		XrSwapchainImageAcquireInfo acquire_info;
+		XrSwapchainImageWaitInfo image_wait_info;
+		XrSwapchainImageReleaseInfo release_info;
+		//The fov each cached projection matrix was built from
+		std::vector<XrFovf> fovs;
+		std::vector<XrMatrix4x4f> projection_matrices;
+		std::vector<XrMatrix4x4f> view_matrices;
+		std::vector<XrMatrix4x4f> vp_matrices;
+		XrCompositionLayerProjection projection_layer;
+		//The projection layer followed by the UI layers, sized when layers are added
+		std::vector<XrCompositionLayerBaseHeader*> layers;
+	} frame_data;
+
+	//The parts of each view the lenses never show, drawn into depth at the near plane before the scene so nothing is shaded there
+	struct {
+		bool enabled = true;
+		//Whether the runtime has XR_KHR_visibility_mask
+		bool supported = false;
+		PFN_xrGetVisibilityMaskKHR get_mask = nullptr;
+		//Set when the runtime reports the mask changed, it is fetched again before the next frame renders
+		bool dirty = true;
+		Shader* shader = nullptr;
+		GLint projection_location = -1;
+		GLuint vao = 0;
+		GLuint vbo = 0;
+		//Triangles of every view, x and y on the z = -1 plane followed by the view index
+		std::vector<float> vertices;
+		std::vector<GLint> first_vertex;
+		std::vector<GLsizei> vertex_count;
+		//Scratch for the runtime's indexed mesh, keeps its capacity across refreshes
+		std::vector<XrVector2f> mask_vertices;
+		std::vector<uint32_t> mask_indices;
+		//Fraction of each view's image the mask covers, the fill rate it saves
+		std::vector<float> hidden_fraction;
+	} visibility_mask;
+
+	//Where each frame sits in the runtime's display period, for just in time starts and budgeting work outside the XR frame
+	struct {
+		//Delay each frame's CPU work so it finishes shortly before the compositor needs it, rather than as soon as xrWaitFrame returns
+		bool just_in_time = false;
+		//Kept between the estimated end of the frame's work and the compositor's deadline
+		double safety_margin_ms = 2.0;
+		//End of the delay spent spinning on the performance counter, the timer can wake this late
+		double spin_ms = 0.5;
+		//High resolution waitable timer the delay sleeps on, where it isn't available a plain one with the timer period raised to 1 ms
+		HANDLE wait_timer = NULL;
+		bool raised_timer_period = false;
+		//How long before the display time the compositor needs the frame, negative to use one display period
+		double compositor_lead_ms = -1.0;
+		//Most of a display period the work between frames may take
+		double non_xr_fraction = 0.25;
+		//Needs XR_KHR_win32_convert_performance_counter_time to put display times on the CPU clock
+		bool time_conversion_supported = false;
+		PFN_xrConvertTimeToWin32PerformanceCounterKHR convert_time = nullptr;
+		//When the current frame's state arrived and the display period it was given, on FrameTelemetry's clock
+		int64_t frame_start_ns = 0;
+		int64_t period_ns = 0;
+		int64_t non_xr_deadline_ns = 0;
+		struct {
+			uint64_t delayed_frames = 0;
+			double total_delay_ms = 0.0;
+		} stats;
+	} frame_timing;
+
+	//Copies the eye images to the desktop window, enable it and pick the view before init
+	DesktopMirror mirror;
+
+	//Quad and cylinder layers submitted after the projection layer in the order they were added, owned by whoever added them
+	std::vector<UiLayer*> ui_layers;
+
+	//Whether the runtime has XR_KHR_composition_layer_cylinder
+	bool cylinder_layers_supported = false;
+
+	//Frames rendered so far, debug builds check for heap allocations after warmup_frames
+	uint64_t frame_count = 0;
+
+	//Timing of every phase of the last few hundred frames
+	FrameTelemetry telemetry;
+
+	//Where destroy writes the telemetry as a Chrome trace, NULL to skip it
+	const char* telemetry_trace_path = NULL;
+
+	uint64_t warmup_frames = 3;
+
+	struct {
+		bool supported = false;
+		Shader* shader = nullptr;
+		GLint view_projection_location = -1;
+		GLint model_location = -1;
+		GLint color_location = -1;
+	} multiview;
+
+	//Uniform block binding the view buffer is bound to
+	static const GLuint VIEW_BUFFER_BINDING = 0;
+
+	//View projection matrices live in a persistently mapped ring, so the views can be located again right before xrEndFrame.
+	//Opt in before init: the frame is held back from the GPU until the latch, so it gives up the overlap pipelined_release's
+	//per swapchain flush provides
+	struct {
+		bool enabled = false;
+		UniformRing ring;
+		//Per view rendering's shader, the stereo modes' shaders read the view buffer themselves
+		Shader* per_view_shader = nullptr;
+		GLint view_index_location = -1;
+		GLint model_location = -1;
+		GLint color_location = -1;
+		//Where published_set and view_set sit in a slot, after both sets of matrices
+		GLintptr published_set_offset = 0;
+		GLintptr view_set_offset = 0;
+		//Placed before the copy of published_set into view_set, while it is unsignaled a newly published set still makes it into the frame
+		GLsync draw_fence = nullptr;
+		//Placed after that copy, once it signals view_set says which set the frame was drawn with
+		GLsync copy_fence = nullptr;
+		XrViewState view_state;
+		std::vector<XrView> views;
+		struct {
+			uint64_t applied_frames = 0;
+			uint64_t skipped_frames = 0;
+		} stats;
+	} late_latch;
+
+	struct {
+		bool supported = false;
+		//Route instances with viewport arrays instead of clip plane splitting
+		bool viewport_array = false;
+		Shader* shader = nullptr;
+		GLint view_projection_location = -1;
+		GLint model_location = -1;
+		GLint color_location = -1;
+	} instanced;
+
+	//Picks the objects in view once per frame, everything drawn comes from its visible list
+	FrustumCuller culler;
+
+	//Hierarchy over the scene's bounds, lets culling drop or keep whole groups of objects at once
+	struct {
+		bool enabled = true;
+		//Below this many objects testing every box is quicker than walking the tree
+		uint32_t min_objects = 256;
+		Bvh tree;
+	} bvh;
+
+	//Culling and compaction in a compute shader feeding indirect draws, for scenes dense enough that the CPU can't keep up
+	struct {
+		bool enabled = false;
+		//Cull on the CPU as well every frame and compare, stalls on a readback so only for testing
+		bool verify = false;
+		GpuCuller culler;
+	} gpu_culling;
+
+	//Every object sharing a mesh goes out in one instanced draw, otherwise one draw and uniform upload per object
+	struct {
+		bool enabled = true;
+		InstanceBuffer buffer;
+		//Per view rendering without the view buffer, takes the view projection in mvp
+		Shader* per_view_shader = nullptr;
+		GLint view_projection_location = -1;
+	} instancing;
+
+	//Per view rendering without the view buffer draws with the default shader, which takes a whole mvp per object
+	struct {
+		GLint mvp_location = -1;
+		GLint color_location = -1;
+	} per_view;
+
 	bool init();
 
 	void destroy();
 
+	/*
+	 addUiLayer: Create a quad or cylinder layer's swapchain and submit it every frame from now on, call after init
+	 inputs:     The layer, with its shape, size and update policy set
+	 returns:    false if its swapchain couldn't be created or cylinders aren't supported
+	*/
+	bool addUiLayer(UiLayer* layer);
+
 	bool createInstance();
 
 	bool createSession();
@@ -105,6 +396,21 @@ public:
 
 	bool checkViewConfigs(XrViewConfigurationType view_type);
 
+	//A view's recommended size times scale, clamped to what the runtime allows
+	XrExtent2Di getViewExtent(int view, float scale);
+
+	//The smallest size that fits every view at the given scale
+	XrExtent2Di getSharedViewExtent(float scale);
+
+	//Lay every view's image rect and each swapchain's render extent out for a render scale
+	void updateViewRects(float scale);
+
+	//Fill in the per frame structures reused by every call to XrMainFunction
+	bool createFrameData(int view_count);
+
+	//Settle on the stereo mode the driver supports, building any shaders it needs
+	bool chooseStereoMode(int view_count);
+
 	bool createSwapchains(int view_count);
 
 	bool checkSwapchainImageSupport(int64_t format);
@@ -114,15 +420,117 @@ public:
 
 	bool genFrameBuffers();
 
+	//Number of images in a swapchain's depth swapchain, 0 without depth
+	uint32_t getDepthImageCount(int swapchain);
+
+	//The prebuilt framebuffer for a color image and depth image, UINT32_MAX as the depth index when there's no depth
+	GLuint getFramebuffer(int swapchain, uint32_t color_index, uint32_t depth_index);
+
+	/*
+	 waitJustInTime: Sleep until the frame's work, estimated from the last measured frame, would end just before the compositor's deadline
+	 inputs:         The frame's predicted display time and display period
+	 returns:        None
+	*/
+	void waitJustInTime(XrTime display_time, XrDuration display_period);
+
+	//Milliseconds left for work outside the XR frame before the next frame should start
+	double getNonXrBudgetMs();
+
+	//Start the budget for work outside the XR frame, call once the frame has been ended
+	void updateNonXrDeadline();
+
+	//Create the hidden area mask's shader and buffers for the chosen stereo mode
+	bool initVisibilityMask();
+
+	//Fetch every view's hidden triangle mesh from the runtime and upload it
+	bool updateVisibilityMask();
+
+	//Draw the hidden area of views first_view to first_view + count - 1 into the bound framebuffer's depth
+	void drawVisibilityMask(int first_view, int count);
+
+	//Blit the views a swapchain image holds into the mirror window
+	void mirrorSwapchain(int swapchain, uint32_t index);
+
+	//Point a shader's ViewBuffer block at VIEW_BUFFER_BINDING
+	void bindViewBuffer(Shader* shader);
+
+	/*
+	 lateLatchViews: Locate the views again just before xrEndFrame, write them into the view buffer's spare set and publish it
+	 inputs:         None
+	 returns:        false if the frame was drawn with the old poses, which are then the ones submitted
+	*/
+	bool lateLatchViews();
+
+	//Register the GPU timer passes for each swapchain and the multires steps
+	void addGpuPasses();
+
+	//Read back finished GPU timings into frame_stats, returns false if none have finished
+	bool collectFrameStats();
+
+	//Create the reduced resolution periphery target for multires rendering
+	bool genMultiresTargets();
+
+	//With multiview, the framebuffer holding one layer of a color and depth image pairing
+	GLuint getLayerFramebuffer(uint32_t color_index, uint32_t depth_index, int layer);
+
+	bool genFences();
+
+	//Block until the GPU has finished the last frame rendered into this image, bounding how far the CPU runs ahead
+	bool waitImageFence(int view, uint32_t image_index);
+
+	//Replace the image's fence with one covering the commands just issued and flush them to the GPU
+	void placeImageFence(int view, uint32_t image_index);
+
+	//Begin the session and start the pacing thread, on READY
 	bool beginSession();
 
+	//Stop the pacing thread and end the session, on STOPPING
+	bool endSession();
+
+	bool isSessionRunning();
+
+	//End a frame with no layers, for frames the runtime doesn't want rendered
+	bool submitEmptyFrame(XrTime display_time, uint64_t frame);
+
 	bool checkXrResult(XrResult);
 
+	//Handle every pending runtime event, beginning and ending the session as its state changes
 	bool checkEvents();
 
+	/*
+	 waitForEvents:  Sleep while the session isn't running, until it starts, shuts down or the timeout passes
+	 inputs:         The longest to wait in seconds
+	 returns:        false if handling an event failed
+	*/
+	bool waitForEvents(double timeout_seconds);
+
 	bool XrMainFunction();
 
-	bool renderFrame(int width, int height, XrMatrix4x4f perspective_matrix, XrMatrix4x4f view_matrix, GLuint framebuffer, GLuint depthbuffer, XrSwapchainImageOpenGLKHR image, XrTime predicted_time);
+	//Draw the scene once into a framebuffer with whichever stereo mode is active
+	bool renderPass(int swapchain, GLuint framebuffer, int width, int height, XrTime predicted_time);
+
+	//Draw the periphery at reduced resolution, upsample it into the swapchain image and redraw the inner region over it
+	bool renderMultires(int swapchain, uint32_t index, uint32_t depth_index, int width, int height, XrTime predicted_time);
+
+	//The full resolution inner region of a view, in swapchain image pixels
+	XrRect2Di getInnerRect(int view);
+
+	/*
+	 drawScene:  Draw every visible object in the scene with the program that is already bound
+	 inputs:     The program's model and material color uniforms, the instances per object, and a view projection
+	             matrix to premultiply into model_location for programs that take a whole mvp, or nullptr.
+	             With instancing the uniforms aren't used, the instance buffer carries them
+	 returns:    None
+	*/
+	void drawScene(GLint model_location, GLint color_location, GLsizei instance_count, const glm::mat4* view_projection);
+
+	bool renderFrame(int width, int height, XrMatrix4x4f perspective_matrix, XrMatrix4x4f view_matrix, GLuint framebuffer, XrTime predicted_time, int view_index);
+
+	//Render every view in one pass into the layers of an array swapchain image
+	bool renderFrameMultiview(int width, int height, const XrMatrix4x4f* vp_matrices, GLuint framebuffer, XrTime predicted_time);
+
+	//Render every view in one pass into its half of a double wide swapchain image
+	bool renderFrameInstanced(int width, int height, const XrMatrix4x4f* vp_matrices, GLuint framebuffer, XrTime predicted_time);
 
 	XrProgram(const char* application_name, GLFWwindow* window);
 
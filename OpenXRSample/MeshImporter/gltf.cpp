@@ -0,0 +1,710 @@
+#include "gltf.hpp"
+#include "gtc/matrix_transform.hpp"
+#include "gtc/quaternion.hpp"
+#include "gtx/quaternion.hpp"
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+
+namespace
+{
+	const uint32_t GLB_MAGIC = 0x46546C67;
+	const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+	const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+	const uint32_t COMPONENT_BYTE = 5120;
+	const uint32_t COMPONENT_UNSIGNED_BYTE = 5121;
+	const uint32_t COMPONENT_SHORT = 5122;
+	const uint32_t COMPONENT_UNSIGNED_SHORT = 5123;
+	const uint32_t COMPONENT_UNSIGNED_INT = 5125;
+	const uint32_t COMPONENT_FLOAT = 5126;
+
+	//Byte offsets and lengths past this can't be held exactly in a JSON number
+	const double MAX_BYTES = 9007199254740992.0;
+
+	//The spec's largest byteStride
+	const double MAX_BYTE_STRIDE = 252.0;
+
+	//Accessors without a buffer view are all zeros and nothing in the file bounds their count, so this does
+	const uint32_t MAX_ZERO_ACCESSOR_COUNT = 1 << 24;
+
+	/*
+	 wholeMember: Read an optional member the spec says is a non negative integer, rather than letting a cast wrap a bad value
+	 inputs:      The object, the member's key, the largest value allowed, the value to use when it's absent, and the output
+	 returns:     false if the member isn't a whole number from 0 to max
+	*/
+	bool wholeMember(const JsonValue& object, const char* key, double max, uint64_t fallback, uint64_t* out)
+	{
+		const JsonValue* value = object.get(key);
+		if (value == nullptr)
+		{
+			*out = fallback;
+			return true;
+		}
+		if (value->type != JSON_NUMBER || !(value->number >= 0.0) || value->number > max || value->number != floor(value->number))
+		{
+			return false;
+		}
+		*out = (uint64_t)value->number;
+		return true;
+	}
+
+	/*
+	 indexMember: Read an optional member holding the index of another object, range checked later against what it indexes
+	 inputs:      The object, the member's key, and the output, -1 when the member is absent
+	 returns:     false if the member isn't a whole number from 0 to INT_MAX
+	*/
+	bool indexMember(const JsonValue& object, const char* key, int* out)
+	{
+		uint64_t index;
+		if (!wholeMember(object, key, INT_MAX, UINT64_MAX, &index))
+		{
+			return false;
+		}
+		*out = index == UINT64_MAX ? -1 : (int)index;
+		return true;
+	}
+
+	uint32_t componentSize(uint32_t component_type)
+	{
+		switch (component_type)
+		{
+		case COMPONENT_BYTE:
+		case COMPONENT_UNSIGNED_BYTE:
+			return 1;
+		case COMPONENT_SHORT:
+		case COMPONENT_UNSIGNED_SHORT:
+			return 2;
+		case COMPONENT_UNSIGNED_INT:
+		case COMPONENT_FLOAT:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	uint32_t typeComponents(const char* type)
+	{
+		static const struct { const char* name; uint32_t components; } types[] = {
+			{ "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 }, { "MAT2", 4 }, { "MAT3", 9 }, { "MAT4", 16 } };
+		for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+		{
+			if (!strcmp(type, types[i].name))
+			{
+				return types[i].components;
+			}
+		}
+		return 0;
+	}
+
+	bool readFile(const std::string& path, std::vector<uint8_t>* data)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		std::streamoff size = file.tellg();
+		file.seekg(0);
+		data->resize((size_t)size);
+		file.read((char*)data->data(), size);
+		return file.good() || (size == 0);
+	}
+
+	bool decodeBase64(const char* text, std::vector<uint8_t>* data)
+	{
+		uint32_t bits = 0;
+		int bit_count = 0;
+		for (const char* c = text; *c != '\0' && *c != '='; c++)
+		{
+			int value;
+			if (*c >= 'A' && *c <= 'Z') value = *c - 'A';
+			else if (*c >= 'a' && *c <= 'z') value = *c - 'a' + 26;
+			else if (*c >= '0' && *c <= '9') value = *c - '0' + 52;
+			else if (*c == '+') value = 62;
+			else if (*c == '/') value = 63;
+			else return false;
+			bits = (bits << 6) | value;
+			bit_count += 6;
+			if (bit_count >= 8)
+			{
+				bit_count -= 8;
+				data->push_back((uint8_t)(bits >> bit_count));
+			}
+		}
+		return true;
+	}
+
+	//URIs are percent encoded, relative paths in practice only use it for spaces and the like
+	std::string decodeUri(const char* uri)
+	{
+		std::string path;
+		for (const char* c = uri; *c != '\0'; c++)
+		{
+			unsigned int code;
+			if (*c == '%' && c[1] != '\0' && c[2] != '\0' && sscanf(c + 1, "%2x", &code) == 1)
+			{
+				path.push_back((char)code);
+				c += 2;
+			}
+			else
+			{
+				path.push_back(*c);
+			}
+		}
+		return path;
+	}
+
+	float normalizedComponent(const uint8_t* data, uint32_t component_type)
+	{
+		switch (component_type)
+		{
+		case COMPONENT_BYTE:
+		{
+			float value = *(const int8_t*)data / 127.0f;
+			return value < -1.0f ? -1.0f : value;
+		}
+		case COMPONENT_UNSIGNED_BYTE:
+			return *data / 255.0f;
+		case COMPONENT_SHORT:
+		{
+			int16_t value;
+			memcpy(&value, data, sizeof(value));
+			float normalized = value / 32767.0f;
+			return normalized < -1.0f ? -1.0f : normalized;
+		}
+		case COMPONENT_UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			memcpy(&value, data, sizeof(value));
+			return value / 65535.0f;
+		}
+		case COMPONENT_UNSIGNED_INT:
+		{
+			uint32_t value;
+			memcpy(&value, data, sizeof(value));
+			return (float)(value / 4294967295.0);
+		}
+		default:
+		{
+			float value;
+			memcpy(&value, data, sizeof(value));
+			return value;
+		}
+		}
+	}
+
+	float component(const uint8_t* data, uint32_t component_type)
+	{
+		switch (component_type)
+		{
+		case COMPONENT_BYTE:
+			return *(const int8_t*)data;
+		case COMPONENT_UNSIGNED_BYTE:
+			return *data;
+		case COMPONENT_SHORT:
+		{
+			int16_t value;
+			memcpy(&value, data, sizeof(value));
+			return value;
+		}
+		case COMPONENT_UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			memcpy(&value, data, sizeof(value));
+			return value;
+		}
+		case COMPONENT_UNSIGNED_INT:
+		{
+			uint32_t value;
+			memcpy(&value, data, sizeof(value));
+			return (float)value;
+		}
+		default:
+		{
+			float value;
+			memcpy(&value, data, sizeof(value));
+			return value;
+		}
+		}
+	}
+}
+
+bool GltfDocument::load(const char* path, ThreadPool* pool)
+{
+	std::string full_path = path;
+	size_t slash = full_path.find_last_of("/\\");
+	this->directory = slash == std::string::npos ? "" : full_path.substr(0, slash + 1);
+
+	std::vector<uint8_t> file;
+	if (!readFile(full_path, &file))
+	{
+		printf("Couldn't read %s\n", path);
+		return false;
+	}
+	this->input_bytes = file.size();
+
+	//A .glb is a header and chunks, the first chunk the JSON and the optional second one the binary buffer
+	uint32_t magic = 0;
+	if (file.size() >= 4)
+	{
+		memcpy(&magic, file.data(), 4);
+	}
+	if (magic == GLB_MAGIC)
+	{
+		uint32_t header[3];
+		if (file.size() < 20)
+		{
+			printf("%s is a truncated GLB\n", path);
+			return false;
+		}
+		memcpy(header, file.data(), sizeof(header));
+		if (header[1] != 2)
+		{
+			printf("%s is GLB version %u, only 2 is supported\n", path, header[1]);
+			return false;
+		}
+
+		const char* json_text = nullptr;
+		size_t json_length = 0;
+		size_t offset = 12;
+		while (offset + 8 <= file.size())
+		{
+			uint32_t chunk[2];
+			memcpy(chunk, file.data() + offset, sizeof(chunk));
+			offset += 8;
+			if (chunk[0] > file.size() - offset)
+			{
+				printf("%s has a truncated chunk\n", path);
+				return false;
+			}
+			if (chunk[1] == GLB_CHUNK_JSON && json_text == nullptr)
+			{
+				json_text = (const char*)file.data() + offset;
+				json_length = chunk[0];
+			}
+			else if (chunk[1] == GLB_CHUNK_BIN && this->buffers.empty())
+			{
+				this->buffers.emplace_back(file.begin() + offset, file.begin() + offset + chunk[0]);
+			}
+			//Chunks are padded to 4 bytes
+			offset += (chunk[0] + 3) & ~3u;
+		}
+		if (json_text == nullptr)
+		{
+			printf("%s has no JSON chunk\n", path);
+			return false;
+		}
+		if (!this->parseJson(path, json_text, json_length))
+		{
+			return false;
+		}
+	}
+	else if (!this->parseJson(path, (const char*)file.data(), file.size()))
+	{
+		return false;
+	}
+
+	return this->loadBuffers(path, pool);
+}
+
+bool GltfDocument::parseJson(const char* path, const char* text, size_t length)
+{
+	JsonParser parser;
+	if (!parser.parse(text, length, &this->json))
+	{
+		printf("%s is not valid JSON: %s\n", path, parser.getError().c_str());
+		return false;
+	}
+
+	const JsonValue* asset = this->json.get("asset");
+	const char* version = asset != nullptr ? asset->getString("version", "") : "";
+	if (strncmp(version, "2.", 2) != 0)
+	{
+		printf("%s is glTF version '%s', only 2.x is supported\n", path, version);
+		return false;
+	}
+
+	//Compressed geometry extensions change what the accessors mean, importing without them would be garbage.
+	//Material and texture extensions don't touch geometry, and KHR_mesh_quantization is just more component types
+	const JsonValue* required = this->json.get("extensionsRequired");
+	if (required != nullptr)
+	{
+		for (size_t i = 0; i < required->items.size(); i++)
+		{
+			const std::string& extension = required->items[i].string;
+			if (extension == "KHR_draco_mesh_compression" || extension == "EXT_meshopt_compression")
+			{
+				printf("%s requires the unsupported extension %s\n", path, extension.c_str());
+				return false;
+			}
+		}
+	}
+
+	const JsonValue* views = this->json.get("bufferViews");
+	if (views != nullptr)
+	{
+		for (size_t i = 0; i < views->items.size(); i++)
+		{
+			const JsonValue& view = views->items[i];
+			GltfBufferView out;
+			uint64_t buffer;
+			uint64_t byte_stride;
+			if (!wholeMember(view, "buffer", UINT32_MAX, 0, &buffer) || !wholeMember(view, "byteOffset", MAX_BYTES, 0, &out.byte_offset) ||
+				!wholeMember(view, "byteLength", MAX_BYTES, 0, &out.byte_length) || !wholeMember(view, "byteStride", MAX_BYTE_STRIDE, 0, &byte_stride))
+			{
+				printf("%s: buffer view %u has a bad buffer, offset, length or stride\n", path, (uint32_t)i);
+				return false;
+			}
+			out.buffer = (uint32_t)buffer;
+			out.byte_stride = (uint32_t)byte_stride;
+			this->buffer_views.push_back(out);
+		}
+	}
+
+	const JsonValue* accessors = this->json.get("accessors");
+	if (accessors != nullptr)
+	{
+		for (size_t i = 0; i < accessors->items.size(); i++)
+		{
+			const JsonValue& accessor = accessors->items[i];
+			if (accessor.get("sparse") != nullptr)
+			{
+				printf("%s uses sparse accessors, which aren't supported\n", path);
+				return false;
+			}
+			GltfAccessor out;
+			uint64_t buffer_view;
+			uint64_t component_type;
+			uint64_t count;
+			if (!wholeMember(accessor, "bufferView", INT_MAX, UINT64_MAX, &buffer_view) || !wholeMember(accessor, "byteOffset", MAX_BYTES, 0, &out.byte_offset) ||
+				!wholeMember(accessor, "componentType", UINT32_MAX, 0, &component_type) || !wholeMember(accessor, "count", UINT32_MAX, 0, &count))
+			{
+				printf("%s: accessor %u has a bad buffer view, offset, component type or count\n", path, (uint32_t)i);
+				return false;
+			}
+			out.buffer_view = buffer_view == UINT64_MAX ? -1 : (int)buffer_view;
+			out.component_type = (uint32_t)component_type;
+			out.components = typeComponents(accessor.getString("type", ""));
+			out.count = (uint32_t)count;
+			out.normalized = accessor.getBool("normalized", false);
+			//With a buffer view the count is bounded by the buffer, without one only by this
+			if (out.buffer_view < 0 && out.count > MAX_ZERO_ACCESSOR_COUNT)
+			{
+				printf("%s: accessor %u has %u elements and no buffer view\n", path, (uint32_t)i, out.count);
+				return false;
+			}
+			this->accessors.push_back(out);
+		}
+	}
+
+	const JsonValue* meshes = this->json.get("meshes");
+	if (meshes != nullptr)
+	{
+		for (size_t i = 0; i < meshes->items.size(); i++)
+		{
+			this->meshes.emplace_back();
+			const JsonValue* primitives = meshes->items[i].get("primitives");
+			if (primitives == nullptr)
+			{
+				continue;
+			}
+			for (size_t p = 0; p < primitives->items.size(); p++)
+			{
+				const JsonValue& primitive = primitives->items[p];
+				GltfPrimitive out;
+				const JsonValue* attributes = primitive.get("attributes");
+				bool valid = attributes == nullptr || (indexMember(*attributes, "POSITION", &out.position) && indexMember(*attributes, "NORMAL", &out.normal) &&
+					indexMember(*attributes, "TEXCOORD_0", &out.texcoord) && indexMember(*attributes, "TANGENT", &out.tangent));
+				uint64_t mode;
+				valid = valid && indexMember(primitive, "indices", &out.indices) && wholeMember(primitive, "mode", INT_MAX, 4, &mode);
+				if (!valid)
+				{
+					printf("%s: mesh %u primitive %u has a bad accessor index or mode\n", path, (uint32_t)i, (uint32_t)p);
+					return false;
+				}
+				out.mode = (int)mode;
+				this->meshes.back().push_back(out);
+			}
+		}
+	}
+
+	const JsonValue* nodes = this->json.get("nodes");
+	if (nodes != nullptr)
+	{
+		this->nodes.resize(nodes->items.size());
+		for (size_t i = 0; i < nodes->items.size(); i++)
+		{
+			if (!this->parseNode(nodes->items[i], &this->nodes[i]))
+			{
+				printf("%s has a bad node %u\n", path, (uint32_t)i);
+				return false;
+			}
+		}
+	}
+
+	//Nodes have to form strict trees. A node listed twice, or under two parents, would be walked once per path to it,
+	//which doubles with every level
+	std::vector<uint8_t> has_parent(this->nodes.size(), 0);
+	for (size_t i = 0; i < this->nodes.size(); i++)
+	{
+		for (size_t c = 0; c < this->nodes[i].children.size(); c++)
+		{
+			int child = this->nodes[i].children[c];
+			if ((size_t)child >= this->nodes.size() || has_parent[child])
+			{
+				printf("%s: node %u has a child that is missing or already has a parent\n", path, (uint32_t)i);
+				return false;
+			}
+			has_parent[child] = 1;
+		}
+	}
+
+	const JsonValue* scenes = this->json.get("scenes");
+	if (scenes != nullptr && !scenes->items.empty())
+	{
+		uint64_t default_scene;
+		if (!wholeMember(this->json, "scene", INT_MAX, 0, &default_scene))
+		{
+			printf("%s has a bad default scene\n", path);
+			return false;
+		}
+		int scene = default_scene < scenes->items.size() ? (int)default_scene : 0;
+		const JsonValue* roots = scenes->items[scene].get("nodes");
+		if (roots != nullptr)
+		{
+			//Roots can't be anyone's child, then a cycle of nodes can never be reached from them
+			for (size_t i = 0; i < roots->items.size(); i++)
+			{
+				double root = roots->items[i].number;
+				if (roots->items[i].type != JSON_NUMBER || !(root >= 0.0) || root >= (double)this->nodes.size() || root != floor(root) || has_parent[(size_t)root])
+				{
+					printf("%s: scene %d has a root node that is missing or not a root\n", path, scene);
+					return false;
+				}
+				has_parent[(size_t)root] = 1;
+				this->scene_nodes.push_back((int)root);
+			}
+		}
+	}
+	return true;
+}
+
+bool GltfDocument::parseNode(const JsonValue& node, GltfNode* out)
+{
+	if (!indexMember(node, "mesh", &out->mesh))
+	{
+		return false;
+	}
+	const JsonValue* children = node.get("children");
+	if (children != nullptr)
+	{
+		for (size_t i = 0; i < children->items.size(); i++)
+		{
+			//Checked against the node count once every node is parsed
+			double child = children->items[i].number;
+			if (children->items[i].type != JSON_NUMBER || !(child >= 0.0) || child > INT_MAX || child != floor(child))
+			{
+				return false;
+			}
+			out->children.push_back((int)child);
+		}
+	}
+
+	//Either a column major matrix or translation, rotation and scale
+	const JsonValue* matrix = node.get("matrix");
+	if (matrix != nullptr)
+	{
+		if (matrix->items.size() != 16)
+		{
+			return false;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			out->local[i / 4][i % 4] = (float)matrix->items[i].number;
+		}
+		return true;
+	}
+
+	glm::vec3 translation(0.0f);
+	glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 scale(1.0f);
+	const JsonValue* t = node.get("translation");
+	if (t != nullptr && t->items.size() == 3)
+	{
+		translation = glm::vec3(t->items[0].number, t->items[1].number, t->items[2].number);
+	}
+	const JsonValue* r = node.get("rotation");
+	if (r != nullptr && r->items.size() == 4)
+	{
+		//glTF stores x, y, z, w
+		rotation = glm::quat((float)r->items[3].number, (float)r->items[0].number, (float)r->items[1].number, (float)r->items[2].number);
+	}
+	const JsonValue* s = node.get("scale");
+	if (s != nullptr && s->items.size() == 3)
+	{
+		scale = glm::vec3(s->items[0].number, s->items[1].number, s->items[2].number);
+	}
+	out->local = glm::translate(glm::mat4(1.0f), translation) * glm::toMat4(rotation) * glm::scale(glm::mat4(1.0f), scale);
+	return true;
+}
+
+bool GltfDocument::loadBuffers(const char* path, ThreadPool* pool)
+{
+	const JsonValue* buffers = this->json.get("buffers");
+	size_t buffer_count = buffers != nullptr ? buffers->items.size() : 0;
+
+	//A .glb's binary chunk is buffer 0, which then has no uri
+	bool has_glb_buffer = !this->buffers.empty();
+	this->buffers.resize(buffer_count > this->buffers.size() ? buffer_count : this->buffers.size());
+
+	//External buffers are separate files, read them all at once
+	std::vector<uint8_t> loaded(buffer_count, 1);
+	pool->parallelFor(static_cast<uint32_t>(buffer_count), [&](uint32_t i)
+		{
+			const char* uri = buffers->items[i].getString("uri", nullptr);
+			if (uri == nullptr)
+			{
+				loaded[i] = i == 0 && has_glb_buffer;
+				return;
+			}
+			this->buffers[i].clear();
+			if (!strncmp(uri, "data:", 5))
+			{
+				const char* base64 = strstr(uri, ";base64,");
+				loaded[i] = base64 != nullptr && decodeBase64(base64 + 8, &this->buffers[i]);
+				return;
+			}
+			loaded[i] = readFile(this->directory + decodeUri(uri), &this->buffers[i]);
+		});
+
+	for (size_t i = 0; i < buffer_count; i++)
+	{
+		if (!loaded[i])
+		{
+			printf("%s: couldn't load buffer %u\n", path, (uint32_t)i);
+			return false;
+		}
+		uint64_t byte_length = (uint64_t)buffers->items[i].getNumber("byteLength", 0);
+		if (this->buffers[i].size() < byte_length)
+		{
+			printf("%s: buffer %u is shorter than its byteLength\n", path, (uint32_t)i);
+			return false;
+		}
+		//The GLB chunk was already counted with the file
+		if (!(i == 0 && has_glb_buffer))
+		{
+			this->input_bytes += this->buffers[i].size();
+		}
+	}
+
+	//Check every accessor once here, so decoding never needs to
+	for (size_t i = 0; i < this->accessors.size(); i++)
+	{
+		const GltfAccessor& accessor = this->accessors[i];
+		uint32_t element_size = componentSize(accessor.component_type) * accessor.components;
+		if (element_size == 0)
+		{
+			printf("%s: accessor %u has an unknown type\n", path, (uint32_t)i);
+			return false;
+		}
+		if (accessor.buffer_view < 0 || accessor.count == 0)
+		{
+			continue;
+		}
+		if ((size_t)accessor.buffer_view >= this->buffer_views.size())
+		{
+			printf("%s: accessor %u has no buffer view\n", path, (uint32_t)i);
+			return false;
+		}
+		const GltfBufferView& view = this->buffer_views[accessor.buffer_view];
+		uint64_t stride = view.byte_stride != 0 ? view.byte_stride : element_size;
+		uint64_t last = accessor.byte_offset + stride * (accessor.count - 1) + element_size;
+		if (view.buffer >= this->buffers.size() || view.byte_offset + view.byte_length > this->buffers[view.buffer].size() || last > view.byte_length)
+		{
+			printf("%s: accessor %u is outside its buffer\n", path, (uint32_t)i);
+			return false;
+		}
+	}
+	return true;
+}
+
+const uint8_t* GltfDocument::element(const GltfAccessor& accessor, uint32_t index) const
+{
+	if (accessor.buffer_view < 0)
+	{
+		return nullptr;
+	}
+	const GltfBufferView& view = this->buffer_views[accessor.buffer_view];
+	uint64_t stride = view.byte_stride != 0 ? view.byte_stride : componentSize(accessor.component_type) * accessor.components;
+	return this->buffers[view.buffer].data() + view.byte_offset + accessor.byte_offset + stride * index;
+}
+
+bool GltfDocument::readFloats(int accessor_index, uint32_t components, float* out) const
+{
+	if (accessor_index < 0 || (size_t)accessor_index >= this->accessors.size())
+	{
+		return false;
+	}
+	const GltfAccessor& accessor = this->accessors[accessor_index];
+	uint32_t component_size = componentSize(accessor.component_type);
+	for (uint32_t i = 0; i < accessor.count; i++)
+	{
+		const uint8_t* data = this->element(accessor, i);
+		for (uint32_t c = 0; c < components; c++)
+		{
+			float value = 0.0f;
+			if (data != nullptr && c < accessor.components)
+			{
+				const uint8_t* source = data + c * component_size;
+				value = accessor.normalized ? normalizedComponent(source, accessor.component_type) : component(source, accessor.component_type);
+			}
+			out[i * components + c] = value;
+		}
+	}
+	return true;
+}
+
+bool GltfDocument::readIndices(int accessor_index, uint32_t* out) const
+{
+	if (accessor_index < 0 || (size_t)accessor_index >= this->accessors.size())
+	{
+		return false;
+	}
+	const GltfAccessor& accessor = this->accessors[accessor_index];
+	if (accessor.components != 1)
+	{
+		return false;
+	}
+	for (uint32_t i = 0; i < accessor.count; i++)
+	{
+		const uint8_t* data = this->element(accessor, i);
+		if (data == nullptr)
+		{
+			out[i] = 0;
+			continue;
+		}
+		switch (accessor.component_type)
+		{
+		case COMPONENT_UNSIGNED_BYTE:
+			out[i] = *data;
+			break;
+		case COMPONENT_UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			memcpy(&value, data, sizeof(value));
+			out[i] = value;
+			break;
+		}
+		case COMPONENT_UNSIGNED_INT:
+			memcpy(&out[i], data, sizeof(uint32_t));
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#ifndef GLTF_HPP
+#define GLTF_HPP
+
+#include "glm.hpp"
+#include "json.hpp"
+#include "threadpool.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct GltfBufferView
+{
+	uint32_t buffer = 0;
+	uint64_t byte_offset = 0;
+	uint64_t byte_length = 0;
+	//0 means tightly packed
+	uint32_t byte_stride = 0;
+};
+
+struct GltfAccessor
+{
+	//-1 means every element is zero
+	int buffer_view = -1;
+	uint64_t byte_offset = 0;
+	uint32_t component_type = 0;
+	uint32_t components = 0;
+	uint32_t count = 0;
+	bool normalized = false;
+};
+
+//Accessor indices, -1 when the primitive doesn't have that attribute
+struct GltfPrimitive
+{
+	int position = -1;
+	int normal = -1;
+	int texcoord = -1;
+	int tangent = -1;
+	int indices = -1;
+	int mode = 4;
+};
+
+struct GltfNode
+{
+	glm::mat4 local = glm::mat4(1.0f);
+	int mesh = -1;
+	std::vector<int> children;
+};
+
+/*
+ The parts of a glTF 2.0 asset needed to pull triangle geometry out of it, from either a .gltf
+ with its buffers in separate files or data URIs, or a .glb with the buffer in its binary chunk.
+ Accessors are decoded on demand, so primitives can be decoded on different threads at once.
+*/
+class GltfDocument
+{
+private:
+	JsonValue json;
+	std::string directory;
+
+	bool parseJson(const char* path, const char* text, size_t length);
+	bool loadBuffers(const char* path, ThreadPool* pool);
+	bool parseNode(const JsonValue& node, GltfNode* out);
+
+	/*
+	 element:    Find an element of an accessor in its buffer
+	 inputs:     The accessor and the element index
+	 returns:    The element's first byte, nullptr for accessors without a buffer view
+	*/
+	const uint8_t* element(const GltfAccessor& accessor, uint32_t index) const;
+
+public:
+	std::vector<std::vector<uint8_t>> buffers;
+	std::vector<GltfBufferView> buffer_views;
+	std::vector<GltfAccessor> accessors;
+	std::vector<std::vector<GltfPrimitive>> meshes;
+	std::vector<GltfNode> nodes;
+
+	//Nodes of the default scene, empty if the asset has no scenes
+	std::vector<int> scene_nodes;
+
+	//Bytes read from disk, the JSON and every buffer
+	uint64_t input_bytes = 0;
+
+	/*
+	 load:       Read and check a .gltf or .glb file and every buffer it uses
+	 inputs:     Path to the file and the pool external buffers are read on
+	 returns:    false if the file can't be read, isn't glTF 2.0, or needs an extension that isn't supported
+	*/
+	bool load(const char* path, ThreadPool* pool);
+
+	/*
+	 readFloats: Decode an accessor to floats, converting normalized integers to their float values
+	 inputs:     The accessor, the components to write per element, padding with zeros or dropping extras, and the output, count * components floats
+	 returns:    false if the accessor is out of range
+	*/
+	bool readFloats(int accessor, uint32_t components, float* out) const;
+
+	/*
+	 readIndices: Decode an index accessor, widening 8 and 16 bit indices to 32 bits
+	 inputs:      The accessor and the output, count indices
+	 returns:     false if the accessor is out of range or not an index type
+	*/
+	bool readIndices(int accessor, uint32_t* out) const;
+};
+
+#endif
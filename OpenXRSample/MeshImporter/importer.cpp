@@ -0,0 +1,412 @@
+#include "importer.hpp"
+#include "meshfile.hpp"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <fstream>
+
+namespace
+{
+	const int TRIANGLES = 4;
+	const int TRIANGLE_STRIP = 5;
+	const int TRIANGLE_FAN = 6;
+
+	//Node hierarchies are trees, this only stops a broken file with a cycle from looping forever
+	const int MAX_NODE_DEPTH = 64;
+
+	struct NodeVisit
+	{
+		int node;
+		glm::mat4 world;
+		int depth;
+	};
+
+	//Any unit vector at right angles to normal
+	glm::vec3 perpendicular(glm::vec3 normal)
+	{
+		glm::vec3 axis = fabsf(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		return glm::normalize(glm::cross(normal, axis));
+	}
+}
+
+Importer::Importer(ThreadPool* pool, ImportOptions options)
+{
+	this->pool = pool;
+	this->options = options;
+}
+
+bool Importer::importFile(const char* input, const char* output, ImportStats* stats)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	GltfDocument document;
+	if (!document.load(input, this->pool))
+	{
+		return false;
+	}
+
+	std::vector<const GltfPrimitive*> primitives;
+	std::vector<glm::mat4> transforms;
+	this->collectPrimitives(document, &primitives, &transforms);
+
+	std::vector<ImportedPrimitive> imported(primitives.size());
+	this->pool->parallelFor(static_cast<uint32_t>(primitives.size()), [&](uint32_t i)
+		{
+			this->decodePrimitive(document, *primitives[i], transforms[i], &imported[i]);
+		});
+
+	//Concatenate, each primitive's indices move up by the vertices before it
+	uint64_t vertex_total = 0;
+	uint64_t index_total = 0;
+	for (size_t i = 0; i < imported.size(); i++)
+	{
+		if (imported[i].ok)
+		{
+			vertex_total += imported[i].vertices.size();
+			index_total += imported[i].indices.size();
+		}
+	}
+	if (index_total == 0)
+	{
+		printf("%s has no triangles to import\n", input);
+		return false;
+	}
+	if (vertex_total > UINT32_MAX || index_total > UINT32_MAX)
+	{
+		printf("%s is too big for one mesh file\n", input);
+		return false;
+	}
+
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	vertices.reserve((size_t)vertex_total);
+	indices.reserve((size_t)index_total);
+	glm::vec3 bounds_min(FLT_MAX);
+	glm::vec3 bounds_max(-FLT_MAX);
+	for (size_t i = 0; i < imported.size(); i++)
+	{
+		const ImportedPrimitive& primitive = imported[i];
+		if (!primitive.ok)
+		{
+			continue;
+		}
+		uint32_t base = static_cast<uint32_t>(vertices.size());
+		vertices.insert(vertices.end(), primitive.vertices.begin(), primitive.vertices.end());
+		for (size_t j = 0; j < primitive.indices.size(); j++)
+		{
+			indices.push_back(base + primitive.indices[j]);
+		}
+		bounds_min = glm::min(bounds_min, primitive.bounds_min);
+		bounds_max = glm::max(bounds_max, primitive.bounds_max);
+
+		stats->primitives++;
+		stats->generated_normals += primitive.generated_normals ? 1 : 0;
+		stats->generated_tangents += primitive.generated_tangents ? 1 : 0;
+	}
+
+	if (this->options.write)
+	{
+		if (!MeshFile::write(output, vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(), static_cast<uint32_t>(indices.size()),
+			bounds_min, bounds_max, nullptr, 0))
+		{
+			return false;
+		}
+		std::ifstream written(output, std::ios::binary | std::ios::ate);
+		stats->output_bytes += (uint64_t)written.tellg();
+	}
+
+	stats->input_bytes += document.input_bytes;
+	stats->vertices += vertices.size();
+	stats->triangles += indices.size() / 3;
+	stats->seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+void Importer::collectPrimitives(const GltfDocument& document, std::vector<const GltfPrimitive*>* primitives, std::vector<glm::mat4>* transforms)
+{
+	//Without a scene there is no hierarchy to follow, take every mesh as it is
+	if (document.scene_nodes.empty())
+	{
+		for (size_t mesh = 0; mesh < document.meshes.size(); mesh++)
+		{
+			for (size_t p = 0; p < document.meshes[mesh].size(); p++)
+			{
+				primitives->push_back(&document.meshes[mesh][p]);
+				transforms->push_back(glm::mat4(1.0f));
+			}
+		}
+		return;
+	}
+
+	std::vector<NodeVisit> stack;
+	for (size_t i = 0; i < document.scene_nodes.size(); i++)
+	{
+		stack.push_back({ document.scene_nodes[i], glm::mat4(1.0f), 0 });
+	}
+	while (!stack.empty())
+	{
+		NodeVisit visit = stack.back();
+		stack.pop_back();
+		if (visit.node < 0 || (size_t)visit.node >= document.nodes.size() || visit.depth > MAX_NODE_DEPTH)
+		{
+			continue;
+		}
+
+		const GltfNode& node = document.nodes[visit.node];
+		glm::mat4 world = visit.world * node.local;
+		if (node.mesh >= 0 && (size_t)node.mesh < document.meshes.size())
+		{
+			for (size_t p = 0; p < document.meshes[node.mesh].size(); p++)
+			{
+				primitives->push_back(&document.meshes[node.mesh][p]);
+				transforms->push_back(world);
+			}
+		}
+		for (size_t i = 0; i < node.children.size(); i++)
+		{
+			stack.push_back({ node.children[i], world, visit.depth + 1 });
+		}
+	}
+}
+
+void Importer::decodePrimitive(const GltfDocument& document, const GltfPrimitive& primitive, const glm::mat4& transform, ImportedPrimitive* out)
+{
+	if (primitive.position < 0 || (size_t)primitive.position >= document.accessors.size())
+	{
+		return;
+	}
+	if (primitive.mode != TRIANGLES && primitive.mode != TRIANGLE_STRIP && primitive.mode != TRIANGLE_FAN)
+	{
+		//Points and lines have nothing to draw as triangles
+		return;
+	}
+
+	uint32_t vertex_count = document.accessors[primitive.position].count;
+	std::vector<float> scratch((size_t)vertex_count * 4);
+	out->vertices.assign(vertex_count, MeshVertex());
+
+	if (!document.readFloats(primitive.position, 3, scratch.data()))
+	{
+		return;
+	}
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		out->vertices[v].position = glm::vec3(scratch[v * 3], scratch[v * 3 + 1], scratch[v * 3 + 2]);
+	}
+
+	//Attributes must have one element per vertex, anything else is ignored and regenerated
+	bool has_normals = primitive.normal >= 0 && (size_t)primitive.normal < document.accessors.size() &&
+		document.accessors[primitive.normal].count == vertex_count && document.readFloats(primitive.normal, 3, scratch.data());
+	if (has_normals)
+	{
+		for (uint32_t v = 0; v < vertex_count; v++)
+		{
+			out->vertices[v].normal = glm::vec3(scratch[v * 3], scratch[v * 3 + 1], scratch[v * 3 + 2]);
+		}
+	}
+	bool has_uvs = primitive.texcoord >= 0 && (size_t)primitive.texcoord < document.accessors.size() &&
+		document.accessors[primitive.texcoord].count == vertex_count && document.readFloats(primitive.texcoord, 2, scratch.data());
+	if (has_uvs)
+	{
+		for (uint32_t v = 0; v < vertex_count; v++)
+		{
+			out->vertices[v].uv = glm::vec2(scratch[v * 2], scratch[v * 2 + 1]);
+		}
+	}
+	bool has_tangents = has_normals && primitive.tangent >= 0 && (size_t)primitive.tangent < document.accessors.size() &&
+		document.accessors[primitive.tangent].count == vertex_count && document.readFloats(primitive.tangent, 4, scratch.data());
+	if (has_tangents)
+	{
+		for (uint32_t v = 0; v < vertex_count; v++)
+		{
+			out->vertices[v].tangent = glm::vec4(scratch[v * 4], scratch[v * 4 + 1], scratch[v * 4 + 2], scratch[v * 4 + 3]);
+		}
+	}
+
+	//Everything becomes a 32 bit triangle list, without indices the vertices are used in order
+	std::vector<uint32_t> source;
+	if (primitive.indices >= 0)
+	{
+		if ((size_t)primitive.indices >= document.accessors.size())
+		{
+			return;
+		}
+		source.resize(document.accessors[primitive.indices].count);
+		if (!document.readIndices(primitive.indices, source.data()))
+		{
+			return;
+		}
+	}
+	else
+	{
+		source.resize(vertex_count);
+		for (uint32_t v = 0; v < vertex_count; v++)
+		{
+			source[v] = v;
+		}
+	}
+	for (size_t i = 0; i < source.size(); i++)
+	{
+		if (source[i] >= vertex_count)
+		{
+			return;
+		}
+	}
+	if (primitive.mode == TRIANGLES)
+	{
+		source.resize(source.size() / 3 * 3);
+		out->indices.swap(source);
+	}
+	else if (source.size() >= 3)
+	{
+		out->indices.reserve((source.size() - 2) * 3);
+		for (size_t i = 0; i + 2 < source.size(); i++)
+		{
+			if (primitive.mode == TRIANGLE_STRIP)
+			{
+				//Every other triangle of a strip is wound backwards
+				out->indices.push_back(source[i]);
+				out->indices.push_back(source[i + 1 + (i % 2)]);
+				out->indices.push_back(source[i + 2 - (i % 2)]);
+			}
+			else
+			{
+				out->indices.push_back(source[i + 1]);
+				out->indices.push_back(source[i + 2]);
+				out->indices.push_back(source[0]);
+			}
+		}
+	}
+	if (out->indices.empty())
+	{
+		return;
+	}
+
+	//Bake the node transform in, a mirroring transform also flips the winding and the bitangent
+	glm::mat3 linear(transform);
+	glm::mat3 normal_matrix = glm::transpose(glm::inverse(linear));
+	bool mirrored = glm::determinant(linear) < 0.0f;
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		MeshVertex& vertex = out->vertices[v];
+		vertex.position = glm::vec3(transform * glm::vec4(vertex.position, 1.0f));
+		if (has_normals)
+		{
+			float length = glm::length(normal_matrix * vertex.normal);
+			vertex.normal = length > 0.0f ? normal_matrix * vertex.normal / length : vertex.normal;
+		}
+		if (has_tangents)
+		{
+			glm::vec3 tangent = linear * glm::vec3(vertex.tangent);
+			float length = glm::length(tangent);
+			tangent = length > 0.0f ? tangent / length : tangent;
+			vertex.tangent = glm::vec4(tangent, mirrored ? -vertex.tangent.w : vertex.tangent.w);
+		}
+	}
+	if (mirrored)
+	{
+		for (size_t i = 0; i < out->indices.size(); i += 3)
+		{
+			uint32_t swap = out->indices[i + 1];
+			out->indices[i + 1] = out->indices[i + 2];
+			out->indices[i + 2] = swap;
+		}
+	}
+
+	uint32_t index_count = static_cast<uint32_t>(out->indices.size());
+	if (!has_normals)
+	{
+		generateNormals(out->vertices.data(), vertex_count, out->indices.data(), index_count);
+		out->generated_normals = true;
+	}
+	if (!has_tangents)
+	{
+		generateTangents(out->vertices.data(), vertex_count, out->indices.data(), index_count);
+		out->generated_tangents = true;
+	}
+
+	if (this->options.optimize)
+	{
+		MeshOptimizer::optimizeVertexCache(out->indices.data(), index_count, vertex_count);
+		MeshOptimizer::optimizeOverdraw(out->indices.data(), index_count, out->vertices.data(), vertex_count, this->options.overdraw_threshold);
+		vertex_count = MeshOptimizer::optimizeVertexFetch(out->vertices.data(), vertex_count, out->indices.data(), index_count);
+		out->vertices.resize(vertex_count);
+	}
+
+	out->bounds_min = glm::vec3(FLT_MAX);
+	out->bounds_max = glm::vec3(-FLT_MAX);
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		out->bounds_min = glm::min(out->bounds_min, out->vertices[v].position);
+		out->bounds_max = glm::max(out->bounds_max, out->vertices[v].position);
+	}
+	out->ok = true;
+}
+
+void Importer::generateNormals(MeshVertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count)
+{
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		vertices[v].normal = glm::vec3(0.0f);
+	}
+	for (uint32_t i = 0; i + 2 < index_count; i += 3)
+	{
+		MeshVertex& a = vertices[indices[i]];
+		MeshVertex& b = vertices[indices[i + 1]];
+		MeshVertex& c = vertices[indices[i + 2]];
+		//The cross product's length is twice the area, which is the weighting wanted
+		glm::vec3 face = glm::cross(b.position - a.position, c.position - a.position);
+		a.normal += face;
+		b.normal += face;
+		c.normal += face;
+	}
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		float length = glm::length(vertices[v].normal);
+		vertices[v].normal = length > 0.0f ? vertices[v].normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+}
+
+void Importer::generateTangents(MeshVertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count)
+{
+	//Sums of the directions u and v increase in across each vertex's triangles
+	std::vector<glm::vec3> u_directions(vertex_count, glm::vec3(0.0f));
+	std::vector<glm::vec3> v_directions(vertex_count, glm::vec3(0.0f));
+	for (uint32_t i = 0; i + 2 < index_count; i += 3)
+	{
+		uint32_t corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+		const MeshVertex& a = vertices[corners[0]];
+		const MeshVertex& b = vertices[corners[1]];
+		const MeshVertex& c = vertices[corners[2]];
+		glm::vec3 edge1 = b.position - a.position;
+		glm::vec3 edge2 = c.position - a.position;
+		glm::vec2 duv1 = b.uv - a.uv;
+		glm::vec2 duv2 = c.uv - a.uv;
+		float determinant = duv1.x * duv2.y - duv2.x * duv1.y;
+		if (fabsf(determinant) < 1e-12f)
+		{
+			//No uv area, nothing to say about the tangent here
+			continue;
+		}
+		float r = 1.0f / determinant;
+		glm::vec3 u_direction = (edge1 * duv2.y - edge2 * duv1.y) * r;
+		glm::vec3 v_direction = (edge2 * duv1.x - edge1 * duv2.x) * r;
+		for (int k = 0; k < 3; k++)
+		{
+			u_directions[corners[k]] += u_direction;
+			v_directions[corners[k]] += v_direction;
+		}
+	}
+
+	for (uint32_t v = 0; v < vertex_count; v++)
+	{
+		glm::vec3 normal = vertices[v].normal;
+		//Gram-Schmidt, the tangent has to lie in the surface
+		glm::vec3 tangent = u_directions[v] - normal * glm::dot(normal, u_directions[v]);
+		float length = glm::length(tangent);
+		tangent = length > 1e-12f ? tangent / length : perpendicular(normal);
+		float handedness = glm::dot(glm::cross(normal, tangent), v_directions[v]) < 0.0f ? -1.0f : 1.0f;
+		vertices[v].tangent = glm::vec4(tangent, handedness);
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef IMPORTER_HPP
+#define IMPORTER_HPP
+
+#include "gltf.hpp"
+#include "meshoptimizer.hpp"
+#include "threadpool.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+struct ImportOptions
+{
+	//Run the vertex cache, overdraw and vertex fetch passes on every primitive
+	bool optimize = true;
+	float overdraw_threshold = 1.05f;
+
+	//Off to time decoding on its own
+	bool write = true;
+};
+
+struct ImportStats
+{
+	uint64_t input_bytes = 0;
+	uint64_t output_bytes = 0;
+	uint32_t primitives = 0;
+	uint64_t vertices = 0;
+	uint64_t triangles = 0;
+	uint32_t generated_normals = 0;
+	uint32_t generated_tangents = 0;
+	double seconds = 0.0;
+};
+
+//One primitive drawn by one node, decoded into the mesh file's vertex layout
+struct ImportedPrimitive
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	glm::vec3 bounds_min;
+	glm::vec3 bounds_max;
+	bool generated_normals = false;
+	bool generated_tangents = false;
+	bool ok = false;
+};
+
+/*
+ Turns a glTF asset into one mesh file. Every primitive of every mesh the default scene draws is
+ decoded on the pool: attributes to floats, indices widened to 32 bits, strips and fans turned
+ into lists, missing normals and tangents generated, the node transform baked in, and then
+ optimized. The primitives are concatenated into one indexed mesh, and MeshFile::write narrows
+ the indices back to 16 bits when they fit.
+*/
+class Importer
+{
+private:
+	ThreadPool* pool;
+	ImportOptions options;
+
+	void collectPrimitives(const GltfDocument& document, std::vector<const GltfPrimitive*>* primitives, std::vector<glm::mat4>* transforms);
+	void decodePrimitive(const GltfDocument& document, const GltfPrimitive& primitive, const glm::mat4& transform, ImportedPrimitive* out);
+
+public:
+	Importer(ThreadPool* pool, ImportOptions options);
+
+	/*
+	 importFile: Import one .gltf or .glb into a mesh file
+	 inputs:     The input path, the output path, and stats to fill in
+	 returns:    false if the input couldn't be read or had no triangles, or the output couldn't be written
+	*/
+	bool importFile(const char* input, const char* output, ImportStats* stats);
+
+	/*
+	 generateNormals:  Area weighted vertex normals from the triangles
+	 inputs:           The vertices, their count, the indices and their count
+	 returns:          None
+	*/
+	static void generateNormals(MeshVertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count);
+
+	/*
+	 generateTangents: Per vertex tangents from the uv gradients of the triangles around it, orthogonalized against the normal
+	 inputs:           The vertices, their count, the indices and their count
+	 returns:          None
+	*/
+	static void generateTangents(MeshVertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count);
+};
+
+#endif
@@ -0,0 +1,356 @@
+#include "json.hpp"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+	//Deeper than any glTF gets, stops hostile input running the stack out
+	const int MAX_DEPTH = 256;
+
+	void appendUtf8(std::string* string, unsigned long code_point)
+	{
+		if (code_point < 0x80)
+		{
+			string->push_back((char)code_point);
+		}
+		else if (code_point < 0x800)
+		{
+			string->push_back((char)(0xC0 | (code_point >> 6)));
+			string->push_back((char)(0x80 | (code_point & 0x3F)));
+		}
+		else if (code_point < 0x10000)
+		{
+			string->push_back((char)(0xE0 | (code_point >> 12)));
+			string->push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+			string->push_back((char)(0x80 | (code_point & 0x3F)));
+		}
+		else
+		{
+			string->push_back((char)(0xF0 | (code_point >> 18)));
+			string->push_back((char)(0x80 | ((code_point >> 12) & 0x3F)));
+			string->push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+			string->push_back((char)(0x80 | (code_point & 0x3F)));
+		}
+	}
+
+	bool parseHex4(const char* text, unsigned long* value)
+	{
+		*value = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			char c = text[i];
+			unsigned long digit;
+			if (c >= '0' && c <= '9')
+			{
+				digit = c - '0';
+			}
+			else if (c >= 'a' && c <= 'f')
+			{
+				digit = c - 'a' + 10;
+			}
+			else if (c >= 'A' && c <= 'F')
+			{
+				digit = c - 'A' + 10;
+			}
+			else
+			{
+				return false;
+			}
+			*value = (*value << 4) | digit;
+		}
+		return true;
+	}
+}
+
+const JsonValue* JsonValue::get(const char* key) const
+{
+	if (this->type != JSON_OBJECT)
+	{
+		return nullptr;
+	}
+	for (size_t i = 0; i < this->keys.size(); i++)
+	{
+		if (this->keys[i] == key)
+		{
+			return &this->items[i];
+		}
+	}
+	return nullptr;
+}
+
+double JsonValue::getNumber(const char* key, double fallback) const
+{
+	const JsonValue* value = this->get(key);
+	return value != nullptr && value->type == JSON_NUMBER ? value->number : fallback;
+}
+
+int JsonValue::getInt(const char* key, int fallback) const
+{
+	//Casting a double outside int's range is undefined, so those get the fallback too
+	double number = this->getNumber(key, fallback);
+	return number >= INT_MIN && number <= INT_MAX ? (int)number : fallback;
+}
+
+bool JsonValue::getBool(const char* key, bool fallback) const
+{
+	const JsonValue* value = this->get(key);
+	return value != nullptr && value->type == JSON_BOOL ? value->boolean : fallback;
+}
+
+const char* JsonValue::getString(const char* key, const char* fallback) const
+{
+	const JsonValue* value = this->get(key);
+	return value != nullptr && value->type == JSON_STRING ? value->string.c_str() : fallback;
+}
+
+bool JsonParser::parse(const char* text, size_t length, JsonValue* root)
+{
+	this->cursor = text;
+	this->end = text + length;
+	this->error.clear();
+
+	if (!this->parseValue(root, 0))
+	{
+		return false;
+	}
+	this->skipWhitespace();
+	if (this->cursor != this->end)
+	{
+		return this->fail("trailing characters after the document");
+	}
+	return true;
+}
+
+const std::string& JsonParser::getError()
+{
+	return this->error;
+}
+
+void JsonParser::skipWhitespace()
+{
+	while (this->cursor < this->end && (*this->cursor == ' ' || *this->cursor == '\t' || *this->cursor == '\n' || *this->cursor == '\r'))
+	{
+		this->cursor++;
+	}
+}
+
+bool JsonParser::fail(const char* message)
+{
+	if (this->error.empty())
+	{
+		this->error = message;
+	}
+	return false;
+}
+
+bool JsonParser::parseLiteral(const char* literal)
+{
+	size_t length = strlen(literal);
+	if ((size_t)(this->end - this->cursor) < length || memcmp(this->cursor, literal, length) != 0)
+	{
+		return this->fail("unexpected character");
+	}
+	this->cursor += length;
+	return true;
+}
+
+bool JsonParser::parseValue(JsonValue* value, int depth)
+{
+	if (depth > MAX_DEPTH)
+	{
+		return this->fail("nested too deeply");
+	}
+	this->skipWhitespace();
+	if (this->cursor >= this->end)
+	{
+		return this->fail("unexpected end of document");
+	}
+
+	switch (*this->cursor)
+	{
+	case '{':
+	{
+		value->type = JSON_OBJECT;
+		this->cursor++;
+		this->skipWhitespace();
+		if (this->cursor < this->end && *this->cursor == '}')
+		{
+			this->cursor++;
+			return true;
+		}
+		while (true)
+		{
+			this->skipWhitespace();
+			value->keys.emplace_back();
+			if (this->cursor >= this->end || *this->cursor != '"' || !this->parseString(&value->keys.back()))
+			{
+				return this->fail("expected a string key");
+			}
+			this->skipWhitespace();
+			if (this->cursor >= this->end || *this->cursor != ':')
+			{
+				return this->fail("expected ':'");
+			}
+			this->cursor++;
+			value->items.emplace_back();
+			if (!this->parseValue(&value->items.back(), depth + 1))
+			{
+				return false;
+			}
+			this->skipWhitespace();
+			if (this->cursor < this->end && *this->cursor == ',')
+			{
+				this->cursor++;
+				continue;
+			}
+			if (this->cursor < this->end && *this->cursor == '}')
+			{
+				this->cursor++;
+				return true;
+			}
+			return this->fail("expected ',' or '}'");
+		}
+	}
+	case '[':
+	{
+		value->type = JSON_ARRAY;
+		this->cursor++;
+		this->skipWhitespace();
+		if (this->cursor < this->end && *this->cursor == ']')
+		{
+			this->cursor++;
+			return true;
+		}
+		while (true)
+		{
+			value->items.emplace_back();
+			if (!this->parseValue(&value->items.back(), depth + 1))
+			{
+				return false;
+			}
+			this->skipWhitespace();
+			if (this->cursor < this->end && *this->cursor == ',')
+			{
+				this->cursor++;
+				continue;
+			}
+			if (this->cursor < this->end && *this->cursor == ']')
+			{
+				this->cursor++;
+				return true;
+			}
+			return this->fail("expected ',' or ']'");
+		}
+	}
+	case '"':
+		value->type = JSON_STRING;
+		return this->parseString(&value->string);
+	case 't':
+		value->type = JSON_BOOL;
+		value->boolean = true;
+		return this->parseLiteral("true");
+	case 'f':
+		value->type = JSON_BOOL;
+		value->boolean = false;
+		return this->parseLiteral("false");
+	case 'n':
+		value->type = JSON_NULL;
+		return this->parseLiteral("null");
+	default:
+		value->type = JSON_NUMBER;
+		return this->parseNumber(&value->number);
+	}
+}
+
+bool JsonParser::parseString(std::string* string)
+{
+	//Skip the opening quote
+	this->cursor++;
+	while (this->cursor < this->end)
+	{
+		char c = *this->cursor++;
+		if (c == '"')
+		{
+			return true;
+		}
+		if (c != '\\')
+		{
+			string->push_back(c);
+			continue;
+		}
+		if (this->cursor >= this->end)
+		{
+			break;
+		}
+		char escape = *this->cursor++;
+		switch (escape)
+		{
+		case '"': string->push_back('"'); break;
+		case '\\': string->push_back('\\'); break;
+		case '/': string->push_back('/'); break;
+		case 'b': string->push_back('\b'); break;
+		case 'f': string->push_back('\f'); break;
+		case 'n': string->push_back('\n'); break;
+		case 'r': string->push_back('\r'); break;
+		case 't': string->push_back('\t'); break;
+		case 'u':
+		{
+			unsigned long code_point;
+			if (this->end - this->cursor < 4 || !parseHex4(this->cursor, &code_point))
+			{
+				return this->fail("bad \\u escape");
+			}
+			this->cursor += 4;
+			//Characters outside the basic plane come as a surrogate pair
+			if (code_point >= 0xD800 && code_point < 0xDC00 && this->end - this->cursor >= 6 && this->cursor[0] == '\\' && this->cursor[1] == 'u')
+			{
+				unsigned long low;
+				if (parseHex4(this->cursor + 2, &low) && low >= 0xDC00 && low < 0xE000)
+				{
+					code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+					this->cursor += 6;
+				}
+			}
+			appendUtf8(string, code_point);
+			break;
+		}
+		default:
+			return this->fail("bad escape");
+		}
+	}
+	return this->fail("unterminated string");
+}
+
+bool JsonParser::parseNumber(double* number)
+{
+	//strtod needs a terminated string, numbers are short so copy the candidate characters out
+	char buffer[64];
+	size_t length = 0;
+	while (this->cursor + length < this->end && length < sizeof(buffer) - 1)
+	{
+		char c = this->cursor[length];
+		if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')
+		{
+			buffer[length++] = c;
+		}
+		else
+		{
+			break;
+		}
+	}
+	buffer[length] = '\0';
+	if (length == 0)
+	{
+		return this->fail("unexpected character");
+	}
+
+	char* parsed_end;
+	*number = strtod(buffer, &parsed_end);
+	if (parsed_end != buffer + length)
+	{
+		return this->fail("malformed number");
+	}
+	this->cursor += length;
+	return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+enum JsonType
+{
+	JSON_NULL,
+	JSON_BOOL,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT
+};
+
+/*
+ A parsed JSON value. Arrays keep their elements in items, objects keep their values in items
+ and the matching keys in keys, in file order. glTF objects are small so lookups are linear.
+*/
+struct JsonValue
+{
+	JsonType type = JSON_NULL;
+	bool boolean = false;
+	double number = 0.0;
+	std::string string;
+	std::vector<JsonValue> items;
+	std::vector<std::string> keys;
+
+	/*
+	 get:        Look up a member of an object
+	 inputs:     The key
+	 returns:    The member, nullptr if this isn't an object or has no such member
+	*/
+	const JsonValue* get(const char* key) const;
+
+	double getNumber(const char* key, double fallback) const;
+	int getInt(const char* key, int fallback) const;
+	bool getBool(const char* key, bool fallback) const;
+	const char* getString(const char* key, const char* fallback) const;
+};
+
+class JsonParser
+{
+private:
+	const char* cursor;
+	const char* end;
+	std::string error;
+
+	void skipWhitespace();
+	bool fail(const char* message);
+	bool parseValue(JsonValue* value, int depth);
+	bool parseString(std::string* string);
+	bool parseNumber(double* number);
+	bool parseLiteral(const char* literal);
+
+public:
+	/*
+	 parse:      Parse a whole document
+	 inputs:     The text, its length, and where to put the root value
+	 returns:    false on malformed input, getError says where
+	*/
+	bool parse(const char* text, size_t length, JsonValue* root);
+
+	const std::string& getError();
+};
+
+#endif
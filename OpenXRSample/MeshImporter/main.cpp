@@ -0,0 +1,158 @@
+#include "importer.hpp"
+#include "threadpool.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*
+ Offline converter from glTF 2.0 to the sample's mesh files, so the sample only ever maps
+ geometry that is ready to draw.
+
+ MeshImporter [-threads N] [-nooptimize] [-bench] <output directory> <input.gltf|input.glb>...
+
+ Every input becomes <output directory>\<input name>.xrmesh. Files are imported at the same time,
+ and so are the primitives within each file. -bench imports the whole set without writing
+ anything at 1, 2, 4... threads up to the hardware thread count, and prints how it scales.
+*/
+
+namespace
+{
+	void printUsage()
+	{
+		printf("MeshImporter [-threads N] [-nooptimize] [-bench] <output directory> <input.gltf|input.glb>...\n");
+	}
+
+	std::string outputPath(const std::string& directory, const char* input)
+	{
+		std::string name = input;
+		size_t slash = name.find_last_of("/\\");
+		if (slash != std::string::npos)
+		{
+			name = name.substr(slash + 1);
+		}
+		size_t dot = name.find_last_of('.');
+		if (dot != std::string::npos)
+		{
+			name = name.substr(0, dot);
+		}
+		return directory + "\\" + name + ".xrmesh";
+	}
+
+	/*
+	 importAll:  Import every input on a pool of the given size
+	 inputs:     The inputs, the output directory, the options, the thread count and the stats to add to
+	 returns:    The number of inputs that failed
+	*/
+	uint32_t importAll(const std::vector<const char*>& inputs, const std::string& directory, ImportOptions options, uint32_t threads, ImportStats* total, double* seconds)
+	{
+		ThreadPool pool;
+		pool.init(threads);
+		Importer importer(&pool, options);
+
+		std::vector<ImportStats> stats(inputs.size());
+		std::vector<uint8_t> failed(inputs.size(), 0);
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		pool.parallelFor(static_cast<uint32_t>(inputs.size()), [&](uint32_t i)
+			{
+				std::string output = outputPath(directory, inputs[i]);
+				failed[i] = !importer.importFile(inputs[i], output.c_str(), &stats[i]);
+			});
+		*seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		pool.destroy();
+
+		uint32_t failures = 0;
+		for (size_t i = 0; i < inputs.size(); i++)
+		{
+			failures += failed[i];
+			total->input_bytes += stats[i].input_bytes;
+			total->output_bytes += stats[i].output_bytes;
+			total->primitives += stats[i].primitives;
+			total->vertices += stats[i].vertices;
+			total->triangles += stats[i].triangles;
+			total->generated_normals += stats[i].generated_normals;
+			total->generated_tangents += stats[i].generated_tangents;
+			total->seconds += stats[i].seconds;
+		}
+		return failures;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	ImportOptions options;
+	uint32_t threads = 0;
+	bool bench = false;
+
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (!strcmp(argv[arg], "-threads") && arg + 1 < argc)
+		{
+			threads = (uint32_t)atoi(argv[++arg]);
+		}
+		else if (!strcmp(argv[arg], "-nooptimize"))
+		{
+			options.optimize = false;
+		}
+		else if (!strcmp(argv[arg], "-bench"))
+		{
+			bench = true;
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+	if (argc - arg < 2)
+	{
+		printUsage();
+		return 1;
+	}
+	std::string directory = argv[arg++];
+	std::vector<const char*> inputs(argv + arg, argv + argc);
+
+	if (bench)
+	{
+		//Decoding and optimizing only, writes would make it a disk benchmark
+		options.write = false;
+		uint32_t max_threads = threads != 0 ? threads : std::thread::hardware_concurrency();
+		double single_thread_seconds = 0.0;
+		printf("threads   seconds     MB/s   Mtris/s  speedup\n");
+		for (uint32_t count = 1; ; count = count * 2 < max_threads ? count * 2 : max_threads)
+		{
+			ImportStats total;
+			double seconds = 0.0;
+			if (importAll(inputs, directory, options, count, &total, &seconds) > 0)
+			{
+				return 1;
+			}
+			if (count == 1)
+			{
+				single_thread_seconds = seconds;
+			}
+			printf("%7u %9.3f %8.1f %9.2f %8.2f\n", count, seconds, total.input_bytes / seconds / 1e6,
+				total.triangles / seconds / 1e6, single_thread_seconds / seconds);
+			if (count == max_threads)
+			{
+				break;
+			}
+		}
+		return 0;
+	}
+
+	ImportStats total;
+	double seconds = 0.0;
+	uint32_t failures = importAll(inputs, directory, options, threads, &total, &seconds);
+	printf("Imported %u of %u files in %.3f seconds: %u primitives, %llu vertices, %llu triangles, %.1f MB in, %.1f MB out\n",
+		(uint32_t)inputs.size() - failures, (uint32_t)inputs.size(), seconds, total.primitives, (unsigned long long)total.vertices,
+		(unsigned long long)total.triangles, total.input_bytes / 1e6, total.output_bytes / 1e6);
+	if (total.generated_normals > 0 || total.generated_tangents > 0)
+	{
+		printf("Generated normals for %u primitives and tangents for %u\n", total.generated_normals, total.generated_tangents);
+	}
+	return failures > 0 ? 1 : 0;
+}
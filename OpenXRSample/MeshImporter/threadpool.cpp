@@ -0,0 +1,123 @@
+#include "threadpool.hpp"
+#include <atomic>
+#include <memory>
+
+namespace
+{
+	//Shared between the caller and the tasks, tasks that start after everything is claimed still touch it
+	struct ParallelForState
+	{
+		std::atomic<uint32_t> next{ 0 };
+		std::atomic<uint32_t> finished{ 0 };
+		uint32_t count = 0;
+		const std::function<void(uint32_t)>* body = nullptr;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+
+	void runItems(ParallelForState* state)
+	{
+		while (true)
+		{
+			uint32_t item = state->next.fetch_add(1);
+			if (item >= state->count)
+			{
+				return;
+			}
+			(*state->body)(item);
+			if (state->finished.fetch_add(1) + 1 == state->count)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->done.notify_all();
+			}
+		}
+	}
+}
+
+void ThreadPool::init(uint32_t thread_count)
+{
+	if (thread_count == 0)
+	{
+		thread_count = std::thread::hardware_concurrency();
+	}
+	//The caller is one of the threads
+	for (uint32_t i = 1; i < thread_count; i++)
+	{
+		this->workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+void ThreadPool::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wake.notify_all();
+	for (size_t i = 0; i < this->workers.size(); i++)
+	{
+		this->workers[i].join();
+	}
+	this->workers.clear();
+	this->stopping = false;
+}
+
+uint32_t ThreadPool::getThreadCount()
+{
+	return static_cast<uint32_t>(this->workers.size() + 1);
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wake.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+			if (this->tasks.empty())
+			{
+				return;
+			}
+			task = std::move(this->tasks.front());
+			this->tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)>& body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (count == 1 || this->workers.empty())
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			body(i);
+		}
+		return;
+	}
+
+	std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+	state->count = count;
+	state->body = &body;
+
+	//One helper per worker at most, each keeps claiming items until there are none left
+	uint32_t helpers = count - 1 < this->workers.size() ? count - 1 : static_cast<uint32_t>(this->workers.size());
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (uint32_t i = 0; i < helpers; i++)
+		{
+			this->tasks.push_back([state]() { runItems(state.get()); });
+		}
+	}
+	this->wake.notify_all();
+
+	runItems(state.get());
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->done.wait(lock, [&state]() { return state->finished.load() == state->count; });
+}
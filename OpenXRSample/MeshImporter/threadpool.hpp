@@ -0,0 +1,50 @@
+#pragma once
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ Fixed set of worker threads taking tasks off one queue. parallelFor is the only way work is
+ handed out: the calling thread claims items alongside the workers and returns once all of
+ them are done, so a parallelFor inside another one's body can't deadlock, the inner caller
+ just does the items nobody else picked up.
+*/
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void workerLoop();
+
+public:
+	/*
+	 init:        Start the workers
+	 inputs:      Threads to run items on including the caller, 0 for one per hardware thread
+	 returns:     None
+	*/
+	void init(uint32_t thread_count);
+
+	void destroy();
+
+	uint32_t getThreadCount();
+
+	/*
+	 parallelFor: Run body once for every index below count, spread over the pool
+	 inputs:      The number of items and the body, called with each item's index
+	 returns:     None, once every item has finished
+	*/
+	void parallelFor(uint32_t count, const std::function<void(uint32_t)>& body);
+};
+
+#endif